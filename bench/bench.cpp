@@ -0,0 +1,1290 @@
+// hot-path microbenchmarks: STATE encoding and decoding, the server's world
+// step and snapshot, TCP line framing, and the client's render-state interpolation. reports
+// ns/op plus heap allocations and allocated bytes per op, optionally as JSON
+// so two commits can be compared:
+//
+//   ./bench/bench --json before.json
+//   ./bench/bench --baseline before.json --threshold 10
+//
+// with --baseline the run exits 1 if any case got slower than the threshold
+// (percent) or allocates more per op than before.
+//
+// before the cases it runs the verify_* checks (the client's snapshot ring
+// and clock, STATE round trips, stream framing, slow readers, and that a
+// warmed-up server tick and client frame make no heap allocations at all)
+// and exits 1 if one fails.
+
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <random>
+#include <new>
+#include <thread>
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <charconv>
+#include <streambuf>
+#include <memory>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+
+#include "../common/utils.hpp"
+#include "../common/protocol.hpp"
+#include "../common/stream_framer.hpp"
+#include "../common/spsc_ring.hpp"
+#include "../common/timing_wheel.hpp"
+#include "../common/tick_arena.hpp"
+#include "../common/work_pool.hpp"
+#include "../common/snapshot_receiver.hpp"
+#include "../server/world.hpp"
+#include "bench_world.hpp"
+#include "../server/recording.hpp"
+#include "../server/outbound_queue.hpp"
+#include "../server/send_rate.hpp"
+#include "../server/interest.hpp"
+#include "../server/room.hpp"
+#include "../common/triple_buffer.hpp"
+#include "../client/render_state.hpp"
+#include "../client/snapshot_ring.hpp"
+#include "../client/net_state.hpp"
+
+using std::cout;
+using std::cerr;
+
+#define nl "\n"
+
+// ---- allocation counting ----
+
+// atomic since the zero-allocation check runs a WorkPool
+std::atomic<long> g_allocs{0};
+std::atomic<long> g_alloc_bytes{0};
+
+// every replaceable form of new goes through counted_alloc, so the
+// plain, array, aligned and nothrow forms are all counted and each delete
+// frees what its new allocated. aligned blocks come from aligned_alloc,
+// which free() also releases.
+void* counted_alloc(size_t n, size_t align){
+    g_allocs.fetch_add(1,std::memory_order_relaxed);
+    g_alloc_bytes.fetch_add(static_cast<long>(n),std::memory_order_relaxed);
+    if(n==0) n=1;
+    if(align<=alignof(std::max_align_t)) return std::malloc(n);
+    return std::aligned_alloc(align,(n+align-1)/align*align);
+}
+
+void* counted_new(size_t n, size_t align=0){
+    void* p=counted_alloc(n,align);
+    if(!p) throw std::bad_alloc();
+    return p;
+}
+
+void* operator new(size_t n){ return counted_new(n); }
+void* operator new[](size_t n){ return counted_new(n); }
+void* operator new(size_t n, std::align_val_t a){ return counted_new(n,static_cast<size_t>(a)); }
+void* operator new[](size_t n, std::align_val_t a){ return counted_new(n,static_cast<size_t>(a)); }
+void* operator new(size_t n, const std::nothrow_t&) noexcept{ return counted_alloc(n,0); }
+void* operator new[](size_t n, const std::nothrow_t&) noexcept{ return counted_alloc(n,0); }
+void* operator new(size_t n, std::align_val_t a, const std::nothrow_t&) noexcept{
+    return counted_alloc(n,static_cast<size_t>(a));
+}
+void* operator new[](size_t n, std::align_val_t a, const std::nothrow_t&) noexcept{
+    return counted_alloc(n,static_cast<size_t>(a));
+}
+
+void operator delete(void* p) noexcept{ std::free(p); }
+void operator delete[](void* p) noexcept{ std::free(p); }
+void operator delete(void* p, size_t) noexcept{ std::free(p); }
+void operator delete[](void* p, size_t) noexcept{ std::free(p); }
+void operator delete(void* p, std::align_val_t) noexcept{ std::free(p); }
+void operator delete[](void* p, std::align_val_t) noexcept{ std::free(p); }
+void operator delete(void* p, size_t, std::align_val_t) noexcept{ std::free(p); }
+void operator delete[](void* p, size_t, std::align_val_t) noexcept{ std::free(p); }
+void operator delete(void* p, const std::nothrow_t&) noexcept{ std::free(p); }
+void operator delete[](void* p, const std::nothrow_t&) noexcept{ std::free(p); }
+void operator delete(void* p, std::align_val_t, const std::nothrow_t&) noexcept{ std::free(p); }
+void operator delete[](void* p, std::align_val_t, const std::nothrow_t&) noexcept{ std::free(p); }
+
+// ---- timing ----
+
+struct BenchResult{
+    std::string name;
+    double ns_per_op=0.0;
+    double allocs_per_op=0.0;
+    double bytes_per_op=0.0;
+};
+
+double g_min_time=0.2; // seconds per timed run (--min-time)
+int g_repeats=3;        // timed runs per case, the fastest counts (--repeat)
+std::string g_filter;   // only cases whose name contains this (--filter)
+std::vector<BenchResult> g_results;
+
+// keeps results alive so the optimizer cannot drop the work
+volatile long g_sink=0;
+
+// run fn repeatedly for at least g_min_time, g_repeats times, and record
+// the per-call cost of the fastest run. the slower runs are other processes
+// and frequency changes, not the code.
+template<typename Fn>
+void run_case(const char* name, Fn fn){
+    if(!g_filter.empty() && std::string(name).find(g_filter)==std::string::npos) return;
+
+    fn(); // warm caches and grow any reused buffers
+    BenchResult r;
+    r.name=name;
+    for(int rep=0;rep<g_repeats;rep++){
+        long iters=0;
+        long allocs_before=g_allocs;
+        long bytes_before=g_alloc_bytes;
+        double start=now_seconds();
+        double elapsed=0.0;
+        do{
+            // batches keep the clock out of very short cases
+            for(int i=0;i<16;i++) fn();
+            iters+=16;
+            elapsed=now_seconds()-start;
+        }while(elapsed<g_min_time);
+
+        double ns=elapsed*1e9/static_cast<double>(iters);
+        if(rep==0 || ns<r.ns_per_op){
+            r.ns_per_op=ns;
+            r.allocs_per_op=static_cast<double>(g_allocs-allocs_before)/static_cast<double>(iters);
+            r.bytes_per_op=static_cast<double>(g_alloc_bytes-bytes_before)/static_cast<double>(iters);
+        }
+    }
+    g_results.push_back(r);
+
+    cout<<std::left<<std::setw(24)<<r.name<<std::right
+        <<std::fixed<<std::setprecision(1)<<std::setw(14)<<r.ns_per_op
+        <<std::setprecision(2)<<std::setw(14)<<r.allocs_per_op
+        <<std::setprecision(1)<<std::setw(14)<<r.bytes_per_op<<nl;
+}
+
+// ---- fixtures ----
+
+constexpr int BENCH_PLAYERS=proto::MAX_PLAYERS;
+constexpr int BENCH_COINS=256;
+constexpr int BENCH_SNAPSHOTS=120; // the client keeps this many
+
+// a full room mid-match: every slot taken and the players wandering
+void setup_world(World& w){
+    w.max_players=BENCH_PLAYERS;
+    w.num_coins=BENCH_COINS;
+    w.coin_kernel=select_coin_kernel();
+    w.seed=1;
+    reset_world(w);
+    for(int i=0;i<BENCH_PLAYERS;i++) spawn_player(w,i);
+    for(int i=0;i<60;i++) update_world(w,w.tick++);
+}
+
+// ---- checks ----
+
+// the ring's binary search must pick the same pair as a linear scan, and a
+// reader racing the writer must never see a half-written snapshot
+bool verify_snapshot_ring(){
+    static SnapshotRing<128> ring;
+    std::vector<double> times;
+    std::mt19937 rng(3);
+    double t=0.0;
+    for(int i=0;i<300;i++){
+        t+=0.02+0.03*static_cast<double>(rng()%100)/100.0; // jittery arrivals
+        TimedSnapshot ts;
+        ts.snap.tick=i;
+        ts.snap.server_time=t;
+        ring.push(ts);
+        times.push_back(t);
+
+        uint64_t first,end;
+        ring.readable(first,end);
+        double target=t-INTERP_DELAY*static_cast<double>(rng()%30)/10.0;
+        size_t want=static_cast<size_t>(end-1);
+        for(size_t k=static_cast<size_t>(first)+1;k<end;k++){
+            if(times[k]>=target){
+                want=k;
+                break;
+            }
+        }
+        TimedSnapshot a,b;
+        bool ok=ring.interpolation_pair(target,a,b);
+        bool single=end-first<2;
+        if(!ok || b.snap.tick!=static_cast<int>(want) ||
+           a.snap.tick!=(single ? b.snap.tick : static_cast<int>(want)-1)){
+            cerr<<"snapshot ring picked the wrong pair at push "<<i<<nl;
+            return false;
+        }
+    }
+
+    // every player in snapshot n sits at x=n; a torn copy would mix two
+    std::atomic<bool> done{false};
+    std::thread writer([&]{
+        for(int n=300;n<300+200000;n++){
+            TimedSnapshot ts;
+            ts.snap.tick=n;
+            ts.snap.server_time=static_cast<double>(n);
+            ts.snap.num_players=proto::MAX_PLAYERS;
+            for(auto& p : ts.snap.players) p.x=static_cast<float>(n);
+            ring.push(ts);
+        }
+        done=true;
+    });
+    long reads=0;
+    bool torn=false;
+    TimedSnapshot a,b;
+    while(!done){
+        if(!ring.interpolation_pair(ring.published.load()-10.0,a,b)) continue;
+        for(const TimedSnapshot* ts : {&a,&b}){
+            if(ts->snap.tick<300) continue;
+            for(const auto& p : ts->snap.players){
+                if(p.x!=static_cast<float>(ts->snap.tick)) torn=true;
+            }
+        }
+        reads++;
+    }
+    writer.join();
+    if(torn){
+        cerr<<"snapshot ring returned a torn snapshot"<<nl;
+        return false;
+    }
+    cout<<"snapshot ring: pairs match a linear scan, "<<reads<<" racing reads intact"<<nl;
+    return true;
+}
+
+// a random room: ids sorted and unique, any field value the server can send
+void random_snapshot(proto::worldSnapshot& s, std::mt19937& rng, int tick){
+    s.tick=tick;
+    s.server_time=static_cast<double>(tick)/proto::TICK_RATE+static_cast<double>(rng()%1000)*1e-7;
+    s.num_players=0;
+    for(int id=0;id<proto::MAX_PLAYERS;id++){
+        if(rng()%3==0) continue;
+        proto::playerState& p=s.players[s.num_players++];
+        p.id=id;
+        p.x=static_cast<float>(rng()%1000000)/97.0f-500.0f;
+        p.y=static_cast<float>(rng()%1000000)/89.0f;
+        p.score=static_cast<int>(rng()%100000);
+        p.input_seq=static_cast<int>(rng()%2000000)-1;
+        p.input_tick=static_cast<int>(rng()%2000000);
+    }
+}
+
+// the next snapshot from base: some players leave, some join, some move,
+// score or get an input applied, the rest stay exactly as they were
+void next_snapshot(const proto::worldSnapshot& base, proto::worldSnapshot& s, std::mt19937& rng, int offset){
+    proto::worldSnapshot fresh;
+    random_snapshot(fresh,rng,base.tick+offset);
+    s.tick=fresh.tick;
+    s.server_time=fresh.server_time;
+    s.num_players=0;
+    const proto::playerState* old[256]={};
+    for(int i=0;i<base.num_players;i++) old[base.players[i].id]=&base.players[i];
+    for(int i=0;i<fresh.num_players;i++){
+        proto::playerState p=fresh.players[i];
+        const proto::playerState* o=old[p.id];
+        if(o && rng()%8==0) continue; // left
+        if(o){
+            int keep=static_cast<int>(rng()%16);
+            if(keep&1) p.x=o->x;
+            if(keep&2) p.y=o->y;
+            if(keep&4) p.score=o->score;
+            if(keep&8){ p.input_seq=o->input_seq; p.input_tick=o->input_tick; }
+        }
+        s.players[s.num_players++]=p;
+    }
+}
+
+void random_coins(proto::coinUpdate& coins, std::mt19937& rng, bool full){
+    coins.full=full;
+    coins.coins.clear();
+    for(int id=0;id<proto::MAX_COINS;id++){
+        if(rng()%(full ? 2 : 16)!=0) continue;
+        proto::coinState c;
+        c.id=id;
+        c.active=full || rng()%2==0;
+        if(c.active){
+            c.x=static_cast<float>(rng()%100000)/7.0f;
+            c.y=static_cast<float>(rng()%100000)/13.0f;
+        }
+        coins.coins.push_back(c);
+    }
+}
+
+bool same_players(const proto::worldSnapshot& a, const proto::worldSnapshot& b){
+    if(a.tick!=b.tick || a.num_players!=b.num_players) return false;
+    for(int i=0;i<a.num_players;i++){
+        const proto::playerState& p=a.players[i];
+        const proto::playerState& q=b.players[i];
+        if(p.id!=q.id || p.x!=q.x || p.y!=q.y || p.score!=q.score ||
+           p.input_seq!=q.input_seq || p.input_tick!=q.input_tick) return false;
+    }
+    return true;
+}
+
+bool same_coins(const proto::coinUpdate& a, const proto::coinUpdate& b){
+    if(a.full!=b.full || a.coins.size()!=b.coins.size()) return false;
+    for(size_t i=0;i<a.coins.size();i++){
+        const proto::coinState& c=a.coins[i];
+        const proto::coinState& d=b.coins[i];
+        if(c.id!=d.id || c.active!=d.active) return false;
+        if(c.active && (c.x!=d.x || c.y!=d.y)) return false;
+    }
+    return true;
+}
+
+// what a value reads back as after going through text STATE
+float text_float(float v){
+    char buf[32];
+    auto res=std::to_chars(buf,buf+sizeof(buf),v,std::chars_format::general,6);
+    float out=0.0f;
+    std::from_chars(buf,res.ptr,out);
+    return out;
+}
+
+double text_time(double v){
+    char buf[64];
+    auto res=std::to_chars(buf,buf+sizeof(buf),v,std::chars_format::fixed,6);
+    double out=0.0;
+    std::from_chars(buf,res.ptr,out);
+    return out;
+}
+
+// every player and coin field has to survive a keyframe, a text STATE and
+// a delta against each baseline offset. binary is exact; text is exact up
+// to the 6 significant digits (6 decimals for the time) it is written with
+constexpr int ROUNDTRIP_CASES=400;
+
+bool verify_state_roundtrip(){
+    std::mt19937 rng(9);
+    std::vector<uint8_t> frame(proto::MAX_FRAME_SIZE);
+    std::vector<char> text;
+    proto::worldSnapshot base,s,out,want;
+    proto::coinUpdate coins,decoded;
+
+    for(int n=0;n<ROUNDTRIP_CASES;n++){
+        random_snapshot(base,rng,static_cast<int>(rng()%1000000));
+        random_coins(coins,rng,true);
+
+        size_t len=proto::encode_state_binary(base,coins,frame.data(),frame.size());
+        if(len==0 || !proto::decode_state_binary(frame.data(),len,out,decoded) ||
+           out.server_time!=base.server_time || !same_players(out,base) || !same_coins(decoded,coins)){
+            cerr<<"keyframe round trip lost a field in case "<<n<<nl;
+            return false;
+        }
+
+        text.resize(proto::text_state_bound(base,coins));
+        len=proto::encode_state(base,coins,text.data(),text.size());
+        want=base;
+        want.server_time=text_time(base.server_time);
+        for(int i=0;i<want.num_players;i++){
+            want.players[i].x=text_float(want.players[i].x);
+            want.players[i].y=text_float(want.players[i].y);
+        }
+        proto::coinUpdate want_coins=coins;
+        for(auto& c : want_coins.coins){
+            c.x=text_float(c.x);
+            c.y=text_float(c.y);
+        }
+        if(len==0 || !proto::decode_state(std::string_view(text.data(),len),out,decoded) ||
+           out.server_time!=want.server_time || !same_players(out,want) || !same_coins(decoded,want_coins)){
+            cerr<<"text STATE round trip lost a field in case "<<n<<nl;
+            return false;
+        }
+
+        int offset=1+n%(proto::SNAPSHOT_HISTORY-1);
+        next_snapshot(base,s,rng,offset);
+        random_coins(coins,rng,false);
+        len=proto::encode_state_delta(s,base,coins,frame.data(),frame.size());
+        if(len==0 || proto::state_frame_base_tick(frame.data(),len)!=base.tick ||
+           !proto::decode_state_binary(frame.data(),len,out,decoded,&base) ||
+           out.server_time!=s.server_time || !same_players(out,s) || !same_coins(decoded,coins)){
+            cerr<<"delta round trip lost a field in case "<<n<<" (offset "<<offset<<")"<<nl;
+            return false;
+        }
+    }
+
+    // coin ids index the client's coin arrays, so text has to bound them
+    // like the binary coin section does
+    for(const char* line : {"STATE 5 0 1 -1 10 20 1.0","STATE 5 0 1 4096 10 20 1.0"}){
+        if(proto::decode_state(line,out,decoded)){
+            cerr<<"text STATE accepted an out of range coin id: "<<line<<nl;
+            return false;
+        }
+    }
+    cout<<"STATE round trips: keyframe, text and delta match on "<<ROUNDTRIP_CASES<<" random rooms"<<nl;
+    return true;
+}
+
+// everything one fill() can read right now, split into frames
+bool read_frames(int fd, StreamFramer& in, std::vector<std::string>& frames, ssize_t& last){
+    StreamFramer::Frame f;
+    while((last=in.fill(fd))>0){
+        while(in.next(f)) frames.push_back((f.binary ? "#" : "")+std::string(f.data));
+    }
+    return last<0 && (errno==EAGAIN || errno==EWOULDBLOCK);
+}
+
+// frames split across reads have to come out whole and in order, however
+// the stream is cut up, including when the buffer compacts mid-frame; a
+// frame bigger than the buffer has to fail with EMSGSIZE instead of being
+// cut. FieldReader and decode_state have to reject malformed fields.
+bool verify_stream_framer(){
+    proto::worldSnapshot s;
+    s.tick=7;
+    s.num_players=2;
+    s.players[0].id=1;
+    s.players[1].id=2;
+    proto::coinUpdate coins;
+    coins.full=true;
+    uint8_t frame[256];
+    size_t frame_len=proto::encode_state_binary(s,coins,frame,sizeof(frame));
+
+    // the stream and the frames next() must hand back
+    std::string stream;
+    std::vector<std::string> want;
+    std::mt19937 rng(13);
+    for(int i=0;i<200;i++){
+        if(rng()%3==0){
+            stream.append(reinterpret_cast<const char*>(frame),frame_len);
+            want.push_back("#"+std::string(reinterpret_cast<const char*>(frame),frame_len));
+            continue;
+        }
+        std::string line="INPUT "+std::to_string(i)+" "+std::string(rng()%40,'x');
+        stream+=line+(rng()%2 ? "\r\n" : "\n");
+        if(rng()%5==0) stream+="\n"; // empty lines are skipped
+        want.push_back(line);
+    }
+
+    for(size_t capacity : {size_t(96),size_t(4096)}){
+        int pair[2];
+        if(socketpair(AF_UNIX,SOCK_STREAM,0,pair)!=0){
+            cerr<<"socketpair() failed"<<nl;
+            return false;
+        }
+        fcntl(pair[1],F_SETFL,fcntl(pair[1],F_GETFL,0)|O_NONBLOCK);
+        StreamFramer in(capacity);
+        std::vector<std::string> got;
+        ssize_t last=0;
+        for(size_t at=0;at<stream.size();){
+            size_t piece=std::min<size_t>(1+rng()%23,stream.size()-at);
+            if(::send(pair[0],stream.data()+at,piece,0)!=static_cast<ssize_t>(piece)) return false;
+            at+=piece;
+            if(!read_frames(pair[1],in,got,last)){
+                cerr<<"stream framer failed a read at capacity "<<capacity<<nl;
+                return false;
+            }
+        }
+        ::close(pair[0]);
+        ::close(pair[1]);
+        if(got!=want){
+            cerr<<"stream framer split frames wrong at capacity "<<capacity<<nl;
+            return false;
+        }
+    }
+
+    // a line and a binary frame that never end within the buffer
+    for(bool binary : {false,true}){
+        int pair[2];
+        if(socketpair(AF_UNIX,SOCK_STREAM,0,pair)!=0) return false;
+        fcntl(pair[1],F_SETFL,fcntl(pair[1],F_GETFL,0)|O_NONBLOCK);
+        StreamFramer in(64);
+        std::string big=binary ? std::string(reinterpret_cast<const char*>(frame),proto::BIN_HEADER_SIZE)
+                               : "STATE";
+        if(binary) big[2]=big[3]=static_cast<char>(0x7f); // payload far past capacity
+        big+=std::string(200,'1');
+        ::send(pair[0],big.data(),big.size(),0);
+        std::vector<std::string> got;
+        ssize_t last=0;
+        read_frames(pair[1],in,got,last);
+        int err=errno;
+        ::close(pair[0]);
+        ::close(pair[1]);
+        if(last!=-1 || err!=EMSGSIZE || !got.empty()){
+            cerr<<"stream framer did not reject an oversize "<<(binary ? "frame" : "line")<<nl;
+            return false;
+        }
+    }
+
+    // fields that must not parse
+    for(const char* line : {"INPUT 1 0","INPUT 1x 0 0","INPUT 1 0 0.5","INPUT 99999999999 0 0",
+                            "INPUT - 0 0","INPUT","",}){
+        proto::FieldReader f(line);
+        int seq,dx,dy;
+        if(f.skip() && f.read(seq) && f.read(dx) && f.read(dy)){
+            cerr<<"field reader accepted \""<<line<<"\""<<nl;
+            return false;
+        }
+    }
+    {
+        proto::FieldReader f("  INPUT   12  -1 1  ");
+        int seq=0,dx=0,dy=0;
+        if(!(f.skip() && f.read(seq) && f.read(dx) && f.read(dy)) || seq!=12 || dx!=-1 || dy!=1 ||
+           !f.word().empty()){
+            cerr<<"field reader misread extra spaces"<<nl;
+            return false;
+        }
+    }
+    proto::worldSnapshot out;
+    for(const char* line : {"STATE","STATE 5","STATE 5 -1 0 1.0","STATE 5 65 0 1.0",
+                            "STATE 5 1 1 2 3 4 5 0 1.0","STATE 5 1 1 2 3 4 5 6 0",
+                            "STATE 5 0 1 3 4 1.0","STATE 5 0 0 nan1","STATE 5 0 0 1.0x",
+                            "STAT 5 0 0 1.0"}){
+        if(proto::decode_state(line,out,coins)){
+            cerr<<"text STATE accepted \""<<line<<"\""<<nl;
+            return false;
+        }
+    }
+    if(!proto::decode_state("STATE 5 1 1 2 3 4 5 6 1 9 10 20 1.5",out,coins) ||
+       out.num_players!=1 || out.players[0].input_tick!=6 || coins.coins.size()!=1 || out.server_time!=1.5){
+        cerr<<"text STATE rejected a well-formed line"<<nl;
+        return false;
+    }
+
+    cout<<"stream framer: "<<want.size()<<" frames in random pieces intact, oversize frames rejected; "
+        <<"malformed fields rejected"<<nl;
+    return true;
+}
+
+constexpr int SLOW_CHECK_TICKS=1200;
+constexpr int SLOW_READ_EVERY=6;   // ticks between reads, 10 a second
+constexpr int SLOW_READ_SIZE=128;  // bytes per read
+
+// one client that reads everything at once and one that takes a trickle,
+// both sent to the way broadcast_state does: an OutboundQueue flushed once
+// per due tick, and a SendRate that backs off while the queue is behind.
+// the slow one must never hold up a tick, must only ever get whole frames
+// (the newest ones, with the rest replaced) and must end up at the slowest
+// rate; the fast one must get every frame at the fastest rate.
+bool verify_slow_reader(){
+    struct Client{
+        int fds[2];
+        OutboundQueue out;
+        SendRate rate;
+        int sent=0;
+        long replaced=0;
+        std::string received;
+    };
+    Client clients[2];
+    for(Client& c : clients){
+        if(socketpair(AF_UNIX,SOCK_STREAM,0,c.fds)!=0){
+            cerr<<"socketpair() failed"<<nl;
+            return false;
+        }
+        int small=4096;
+        setsockopt(c.fds[0],SOL_SOCKET,SO_SNDBUF,&small,sizeof(small));
+        setsockopt(c.fds[1],SOL_SOCKET,SO_RCVBUF,&small,sizeof(small));
+        for(int fd : c.fds) fcntl(fd,F_SETFL,fcntl(fd,F_GETFL,0)|O_NONBLOCK);
+        c.out.reset(0.0);
+        c.rate.reset(send_interval_for_rate(proto::SEND_RATE_DEFAULT),
+                     send_interval_for_rate(proto::SEND_RATE_DEFAULT),
+                     send_interval_for_rate(proto::SEND_RATE_MIN));
+    }
+    Client& fast=clients[0];
+    Client& slow=clients[1];
+
+    proto::worldSnapshot s;
+    s.num_players=proto::MAX_PLAYERS;
+    for(int i=0;i<s.num_players;i++) s.players[i].id=i+1;
+    proto::coinUpdate coins;
+    coins.full=true;
+    std::vector<uint8_t> frame(proto::MAX_FRAME_SIZE);
+
+    double worst=0.0;
+    char buf[65536];
+    for(int tick=0;tick<SLOW_CHECK_TICKS;tick++){
+        s.tick=tick;
+        size_t len=proto::encode_state_binary(s,coins,frame.data(),frame.size());
+
+        double start=now_seconds();
+        for(Client& c : clients){
+            if(!c.rate.due(tick)) continue;
+            bool backlog=c.out.backlogged(c.fds[0]);
+            if(c.out.push(frame.data(),len)) c.replaced++;
+            if(c.out.flush(c.fds[0],start)<0){
+                cerr<<"slow reader check: send failed"<<nl;
+                return false;
+            }
+            c.rate.on_sent(tick,backlog);
+            c.sent++;
+        }
+        worst=std::max(worst,now_seconds()-start);
+
+        // the queue is only written when a frame is due, like the server's;
+        // in between the fast reader catches up on what the socket holds
+        ssize_t n;
+        while((n=::recv(fast.fds[1],buf,sizeof(buf),0))>0) fast.received.append(buf,static_cast<size_t>(n));
+        if(tick%SLOW_READ_EVERY==0){
+            n=::recv(slow.fds[1],buf,SLOW_READ_SIZE,0);
+            if(n>0) slow.received.append(buf,static_cast<size_t>(n));
+        }
+    }
+
+    // every complete frame read, in order
+    int frames[2]={};
+    for(int k=0;k<2;k++){
+        Client& c=clients[k];
+        int last=-1;
+        size_t at=0;
+        proto::worldSnapshot out;
+        while(at<c.received.size()){
+            const uint8_t* p=reinterpret_cast<const uint8_t*>(c.received.data())+at;
+            size_t len=proto::binary_frame_size(p,c.received.size()-at);
+            if(len==0) break; // the slow reader stopped mid-frame
+            if(!proto::decode_state_binary(p,len,out,coins) || out.tick<=last){
+                cerr<<"slow reader check: "<<(k ? "slow" : "fast")<<" reader got a broken or stale frame"<<nl;
+                return false;
+            }
+            last=out.tick;
+            at+=len;
+            frames[k]++;
+        }
+        ::close(c.fds[0]);
+        ::close(c.fds[1]);
+    }
+
+    if(fast.replaced!=0 || frames[0]!=fast.sent || fast.rate.interval!=fast.rate.min_interval){
+        cerr<<"slow reader check: the fast reader got "<<frames[0]<<"/"<<fast.sent<<" frames, "
+            <<fast.replaced<<" replaced, at interval "<<fast.rate.interval<<nl;
+        return false;
+    }
+    if(slow.replaced==0 || frames[1]==0 || slow.rate.interval!=slow.rate.max_interval){
+        cerr<<"slow reader check: the slow reader got "<<frames[1]<<" frames, "<<slow.replaced
+            <<" replaced, at interval "<<slow.rate.interval<<nl;
+        return false;
+    }
+    if(worst>0.005){
+        cerr<<"slow reader check: a tick spent "<<worst*1e3<<" ms sending"<<nl;
+        return false;
+    }
+    cout<<"slow reader: "<<frames[1]<<" whole frames read, "<<slow.replaced<<" replaced, at "
+        <<slow.rate.rate()<<" Hz; fast reader "<<frames[0]<<"/"<<fast.sent<<" at "<<fast.rate.rate()
+        <<" Hz; slowest send "<<std::fixed<<std::setprecision(1)<<worst*1e6<<" us"
+        <<std::defaultfloat<<nl;
+    return true;
+}
+
+constexpr int INTEREST_CHECK_TICKS=600;
+constexpr float INTEREST_RADIUS=500.0f;
+constexpr int INTEREST_ACK_LAG=5; // ticks before the server sees an ACK
+
+// --interest from both ends: a few clients in a big, busy world are sent
+// filtered keyframes and deltas the way encode_for_client builds them, and
+// acknowledge them a few ticks late. after every frame each client must
+// hold exactly the players within the radius of its own (plus itself) and
+// exactly the active coins within it, at their current positions.
+bool verify_interest(){
+    std::unique_ptr<World> world(new World);
+    World& w=*world;
+    w.max_players=BENCH_PLAYERS;
+    w.num_coins=2048;
+    w.coin_kernel=select_coin_kernel();
+    w.seed=4;
+    w.width=3000.0f;
+    w.height=3000.0f;
+    reset_world(w);
+    for(int i=0;i<BENCH_PLAYERS;i++) spawn_player(w,i);
+    CoinInterestGrid grid;
+    grid.reset(w,INTEREST_RADIUS);
+
+    struct Client{
+        int slot=0;
+        std::unique_ptr<proto::worldSnapshot[]> sent{new proto::worldSnapshot[proto::SNAPSHOT_HISTORY]};
+        CoinInterestHistory sent_coins;
+        std::vector<int> acks; // ticks decoded, by the tick they reach the server
+        int acked=-1;
+        std::unique_ptr<SnapshotReceiver> receiver{new SnapshotReceiver};
+        std::vector<char> coin_active;
+        std::vector<float> coin_x,coin_y;
+    };
+    std::vector<Client> clients(3);
+    for(size_t k=0;k<clients.size();k++){
+        Client& c=clients[k];
+        c.slot=static_cast<int>(k)*21;
+        c.sent_coins.reset(w.num_coins);
+        c.acks.assign(INTEREST_CHECK_TICKS+INTEREST_ACK_LAG+1,-1);
+        c.coin_active.assign(static_cast<size_t>(w.num_coins),0);
+        c.coin_x.assign(static_cast<size_t>(w.num_coins),0.0f);
+        c.coin_y.assign(static_cast<size_t>(w.num_coins),0.0f);
+        for(int i=0;i<proto::SNAPSHOT_HISTORY;i++) c.sent[i].tick=-1;
+    }
+
+    std::mt19937 rng(8);
+    std::vector<uint8_t> frame(proto::MAX_FRAME_SIZE);
+    proto::worldSnapshot view,out;
+    proto::coinUpdate coins;
+    long bytes=0,deltas=0,frames=0,players_seen=0,coins_seen=0;
+
+    for(int t=0;t<INTEREST_CHECK_TICKS;t++){
+        steer_players(w,rng);
+        update_world(w,w.tick);
+        int tick=w.tick;
+        proto::worldSnapshot s=build_snapshot(w,tick);
+        grid.update(w);
+
+        for(Client& c : clients){
+            if(c.acks[static_cast<size_t>(tick)]>c.acked) c.acked=c.acks[static_cast<size_t>(tick)];
+            if(tick%2!=0) continue;
+
+            // server side, as encode_for_client does it
+            const Player& self=w.players[c.slot];
+            filter_players(s,self.id,self.x,self.y,INTEREST_RADIUS,view);
+            uint64_t* now_bits=c.sent_coins.record(tick);
+            visible_coins(grid,self.x,self.y,INTEREST_RADIUS,now_bits,c.sent_coins.words);
+            size_t len=0;
+            if(c.acked>=0 && tick-c.acked<proto::SNAPSHOT_HISTORY &&
+               c.sent[c.acked%proto::SNAPSHOT_HISTORY].tick==c.acked){
+                c.sent_coins.since(c.acked,tick);
+                interest_coin_update(w,now_bits,c.sent_coins.stable.data(),c.sent_coins.seen.data(),
+                                     c.acked,c.sent_coins.words,coins);
+                len=proto::encode_state_delta(view,c.sent[c.acked%proto::SNAPSHOT_HISTORY],coins,
+                                              frame.data(),frame.size());
+                deltas++;
+            }
+            if(len==0){
+                interest_coin_update(w,now_bits,nullptr,nullptr,-1,c.sent_coins.words,coins);
+                len=proto::encode_state_binary(view,coins,frame.data(),frame.size());
+            }
+            c.sent[tick%proto::SNAPSHOT_HISTORY]=view;
+            bytes+=static_cast<long>(len);
+            frames++;
+
+            // client side
+            bool fresh=false;
+            if(len==0 || !c.receiver->on_frame(frame.data(),len,out,fresh)){
+                cerr<<"interest check: slot "<<c.slot<<" could not decode its frame on tick "<<tick<<nl;
+                return false;
+            }
+            const proto::coinUpdate& got=c.receiver->coins;
+            if(got.full) std::fill(c.coin_active.begin(),c.coin_active.end(),0);
+            for(const auto& coin : got.coins){
+                c.coin_active[static_cast<size_t>(coin.id)]=coin.active;
+                c.coin_x[static_cast<size_t>(coin.id)]=coin.x;
+                c.coin_y[static_cast<size_t>(coin.id)]=coin.y;
+            }
+            c.acks[static_cast<size_t>(tick+INTEREST_ACK_LAG)]=out.tick;
+
+            // what it should hold, straight from the world
+            const float r_sq=INTEREST_RADIUS*INTEREST_RADIUS;
+            int want_players=0;
+            for(int i=0;i<s.num_players;i++){
+                const proto::playerState& p=s.players[i];
+                float dx=p.x-self.x;
+                float dy=p.y-self.y;
+                if(p.id!=self.id && dx*dx+dy*dy>r_sq) continue;
+                const proto::playerState* q=proto::find_player(out,p.id);
+                if(!q || q->x!=p.x || q->y!=p.y || q->score!=p.score){
+                    cerr<<"interest check: slot "<<c.slot<<" is missing player "<<p.id<<" on tick "<<tick<<nl;
+                    return false;
+                }
+                want_players++;
+            }
+            if(out.num_players!=want_players){
+                cerr<<"interest check: slot "<<c.slot<<" holds "<<out.num_players<<" players, "
+                    <<want_players<<" are in range on tick "<<tick<<nl;
+                return false;
+            }
+            for(int id=0;id<w.num_coins;id++){
+                float dx=w.coins.x[id]-self.x;
+                float dy=w.coins.y[id]-self.y;
+                bool want=w.coins.is_active(id) && dx*dx+dy*dy<=r_sq;
+                bool has=c.coin_active[static_cast<size_t>(id)]!=0;
+                if(want!=has || (want && (c.coin_x[static_cast<size_t>(id)]!=w.coins.x[id] ||
+                                          c.coin_y[static_cast<size_t>(id)]!=w.coins.y[id]))){
+                    cerr<<"interest check: slot "<<c.slot<<(want ? " is missing" : " still has")
+                        <<" coin "<<id<<" on tick "<<tick<<nl;
+                    return false;
+                }
+                if(want) coins_seen++;
+            }
+            players_seen+=want_players;
+        }
+        w.tick++;
+    }
+    cout<<"interest: "<<frames<<" frames ("<<deltas<<" deltas) hold exactly what is in range, "
+        <<players_seen/frames<<" players and "<<coins_seen/frames<<" coins on average, "
+        <<bytes/frames<<" B/frame"<<nl;
+    return true;
+}
+
+// snapshots at a slow, jittery send rate: once the clock has settled, the
+// render time must keep moving forward and stay behind the newest snapshot
+// received, or remote players would stall between snapshots
+bool verify_snapshot_clock(){
+    SnapshotClock clock;
+    std::mt19937 rng(5);
+    const double spacing=0.1;   // 10 snapshots per second
+    const double frame=1.0/60.0;
+    const double latency=0.04;  // plus 0..30 ms of jitter
+    // in order, as over TCP
+    std::vector<double> arrivals;
+    for(double sent=0.0;sent<21.0;sent+=spacing){
+        double arrive=sent+latency+0.03*static_cast<double>(rng()%100)/100.0;
+        if(!arrivals.empty()) arrive=std::max(arrive,arrivals.back());
+        arrivals.push_back(arrive);
+    }
+    size_t next=0;
+    double newest=-1.0;
+    double last_render=-1e9;
+    int starved=0;
+    int frames=0;
+    for(double now=0.0;now<20.0;now+=frame){
+        while(arrivals[next]<=now){
+            newest=static_cast<double>(next)*spacing;
+            clock.on_snapshot(newest,arrivals[next]);
+            next++;
+        }
+        double t=clock.render_time(now,frame);
+        if(now<5.0) continue; // settling
+        frames++;
+        if(t<last_render) {
+            cerr<<"snapshot clock went backwards at "<<now<<" s"<<nl;
+            return false;
+        }
+        last_render=t;
+        if(t>newest) starved++;
+    }
+    if(starved*100>frames){
+        cerr<<"snapshot clock ran past the newest snapshot on "<<starved<<"/"<<frames<<" frames"<<nl;
+        return false;
+    }
+    cout<<"snapshot clock: 10 Hz with jitter, delay "<<static_cast<int>(clock.delay*1e3)
+        <<" ms, "<<starved<<"/"<<frames<<" frames past the newest snapshot"<<nl;
+    return true;
+}
+
+// swallows the world's log lines while they are switched on for the check
+struct NullStreamBuf : std::streambuf{
+    int overflow(int c) override{ return c; }
+    std::streamsize xsputn(const char*, std::streamsize n) override{ return n; }
+};
+
+constexpr int ALLOC_WARMUP_TICKS=600;
+constexpr int ALLOC_CHECK_TICKS=600;
+constexpr float ALLOC_INTEREST=200.0f;
+
+// one client of the zero-allocation check: its end of the socketpair, read
+// the way the client's network thread reads the server
+struct AllocClient{
+    int fd=-1;
+    StreamFramer in{SERVER_STREAM_CAPACITY};
+    ClientNetState net;
+    long frames=0; // decoded since the warm-up
+};
+
+// a full room on the server's own tick_room, every slot a client on a
+// socketpair that hands each frame to ClientNetState and ACKs it the way the
+// reactor would record it; client 0 also renders a frame every tick. the
+// world's log lines are on. returns the heap allocations over the last
+// ALLOC_CHECK_TICKS ticks, or -1 if the room did not run.
+long zero_alloc_run(const char* name, proto::StateFormat format, float interest){
+    g_state_format=format;
+    g_interest=interest;
+
+    std::unique_ptr<Room> room(new Room(0));
+    Room& r=*room;
+    std::unique_ptr<AllocClient[]> clients(new AllocClient[BENCH_PLAYERS]);
+    for(int i=0;i<BENCH_PLAYERS;i++){
+        int pair[2];
+        if(socketpair(AF_UNIX,SOCK_STREAM,0,pair)!=0){
+            cerr<<"socketpair() failed"<<nl;
+            for(int k=0;k<i;k++){
+                ::close(r.client_socks[k]);
+                ::close(clients[k].fd);
+            }
+            return -1;
+        }
+        fcntl(pair[0],F_SETFL,fcntl(pair[0],F_GETFL,0)|O_NONBLOCK);
+        fcntl(pair[1],F_SETFL,fcntl(pair[1],F_GETFL,0)|O_NONBLOCK);
+        r.client_history[i].reset();
+        r.client_out[i].reset(now_seconds());
+        r.client_socks[i]=pair[0];
+        r.client_gen[i]++;
+        r.client_connected[i]=true;
+        clients[i].fd=pair[1];
+        clients[i].net.reset(BENCH_COINS);
+    }
+    reset_room(r);
+    r.world.log_spawns=true;
+    r.world.log_pickups=true;
+    r.recorder.open("/dev/null",r.world);
+    r.started=true;
+    r.deadline=now_seconds()+3600.0;
+
+    std::mt19937 rng(9);
+    long before=0;
+    bool ok=true;
+    for(int t=0;t<ALLOC_WARMUP_TICKS+ALLOC_CHECK_TICKS && ok;t++){
+        if(t==ALLOC_WARMUP_TICKS){
+            before=g_allocs.load();
+            for(int i=0;i<BENCH_PLAYERS;i++) clients[i].frames=0;
+        }
+
+        // each player turns every 15 ticks, not all on the same tick, so
+        // every bucket of the input wheel sees inputs during the warm-up
+        for(int i=0;i<BENCH_PLAYERS;i++){
+            if((r.world.tick+i)%15!=0) continue;
+            int dx=static_cast<int>(rng()%3)-1;
+            int dy=static_cast<int>(rng()%3)-1;
+            queue_input(r,i,r.world.tick,dx,dy);
+        }
+        tick_room(&r);
+
+        for(int i=0;i<BENCH_PLAYERS && ok;i++){
+            AllocClient& c=clients[i];
+            while(ok && c.in.fill(c.fd)>0){
+                StreamFramer::Frame f;
+                while(c.in.next(f)){
+                    proto::worldSnapshot snap;
+                    if(f.binary){
+                        bool fresh=false;
+                        ok=c.net.on_frame(reinterpret_cast<const uint8_t*>(f.data.data()),
+                                          f.data.size(),snap,fresh);
+                        if(!ok) break;
+                        ClientHistory& h=r.client_history[i];
+                        if(snap.tick>h.acked_tick.load()){
+                            h.acked_time=now_seconds();
+                            h.acked_tick=snap.tick;
+                        }
+                    }
+                    else{
+                        ok=c.net.on_text_state(f.data,snap);
+                        if(!ok) break;
+                    }
+                    c.frames++;
+                }
+            }
+        }
+
+        RenderState rs=clients[0].net.render_state(now_seconds(),sim::TICK_DT,1,0.0f,0.0f);
+        g_sink+=rs.num_remote;
+    }
+    long allocs=g_allocs.load()-before;
+
+    r.recorder.close();
+    long fewest=clients[0].frames;
+    for(int i=0;i<BENCH_PLAYERS;i++){
+        fewest=std::min(fewest,clients[i].frames);
+        ::close(r.client_socks[i]);
+        ::close(clients[i].fd);
+    }
+    if(!ok){
+        cerr<<"zero-allocation check ("<<name<<"): a client could not decode a frame"<<nl;
+        return -1;
+    }
+    // every client is a fast reader, so none should drop below the default rate
+    if(fewest<ALLOC_CHECK_TICKS/g_send_interval){
+        cerr<<"zero-allocation check ("<<name<<"): a client only got "<<fewest<<" frames in "
+            <<ALLOC_CHECK_TICKS<<" ticks"<<nl;
+        return -1;
+    }
+    if(allocs!=0){
+        cerr<<"steady-state ticks allocated ("<<name<<"): "<<allocs<<" heap allocations in "
+            <<ALLOC_CHECK_TICKS<<" ticks and frames"<<nl;
+    }
+    return allocs;
+}
+
+// once warmed up, a room's tick and a client's frame must not touch the
+// heap. runs the server's tick_room (inputs through the slot rings and the
+// timing wheel, recording with keyframes, update_world on a pool, keyframe
+// and delta STATE through the outbound queues) and the client's frame
+// handling and render state, with binary, --interest and text STATE, and
+// counts operator new across the threads over the last ticks of each
+bool verify_zero_alloc(){
+    WorkPool pool(2);
+    g_max_players=BENCH_PLAYERS;
+    g_num_coins=BENCH_COINS;
+    g_coin_kernel=select_coin_kernel();
+    g_sim_pool=&pool;
+    NullStreamBuf null_buf;
+    std::streambuf* saved_cout=cout.rdbuf(&null_buf);
+
+    bool ok=zero_alloc_run("binary",proto::StateFormat::Binary,0.0f)==0 &&
+            zero_alloc_run("interest",proto::StateFormat::Binary,ALLOC_INTEREST)==0 &&
+            zero_alloc_run("text",proto::StateFormat::Text,0.0f)==0;
+
+    cout.rdbuf(saved_cout);
+    g_sim_pool=nullptr;
+    g_state_format=proto::StateFormat::Binary;
+    g_interest=0.0f;
+    if(!ok) return false;
+    cout<<"zero allocation: "<<ALLOC_CHECK_TICKS<<" room ticks and client frames after a "
+        <<ALLOC_WARMUP_TICKS<<"-tick warm-up (binary, interest, text), 0 heap allocations"<<nl;
+    return true;
+}
+
+// ---- JSON ----
+
+bool write_json(const std::string& path){
+    std::ofstream f(path);
+    if(!f) return false;
+    f<<"{\n  \"benchmarks\": [\n";
+    for(size_t i=0;i<g_results.size();i++){
+        const BenchResult& r=g_results[i];
+        f<<"    {\"name\": \""<<r.name<<"\""
+         <<std::fixed<<std::setprecision(2)
+         <<", \"ns_per_op\": "<<r.ns_per_op
+         <<", \"allocs_per_op\": "<<r.allocs_per_op
+         <<", \"bytes_per_op\": "<<r.bytes_per_op<<"}"
+         <<(i+1<g_results.size() ? "," : "")<<"\n";
+    }
+    f<<"  ]\n}\n";
+    return static_cast<bool>(f);
+}
+
+// value of "key": in one line of our own output
+bool json_number(const std::string& line, const char* key, double& out){
+    std::string pat=std::string("\"")+key+"\": ";
+    size_t pos=line.find(pat);
+    if(pos==std::string::npos) return false;
+    out=std::strtod(line.c_str()+pos+pat.size(),nullptr);
+    return true;
+}
+
+// reads a file written by write_json, one case per line
+bool read_json(const std::string& path, std::vector<BenchResult>& out){
+    std::ifstream f(path);
+    if(!f) return false;
+    std::string line;
+    while(std::getline(f,line)){
+        const std::string pat="\"name\": \"";
+        size_t pos=line.find(pat);
+        if(pos==std::string::npos) continue;
+        size_t end=line.find('"',pos+pat.size());
+        if(end==std::string::npos) continue;
+        BenchResult r;
+        r.name=line.substr(pos+pat.size(),end-pos-pat.size());
+        if(!json_number(line,"ns_per_op",r.ns_per_op)) continue;
+        json_number(line,"allocs_per_op",r.allocs_per_op);
+        json_number(line,"bytes_per_op",r.bytes_per_op);
+        out.push_back(r);
+    }
+    return true;
+}
+
+// compare this run with a baseline, return how many cases regressed.
+// allocation counts are deterministic, so half an allocation per op more
+// is already a regression.
+int compare_with_baseline(const std::vector<BenchResult>& base, double threshold_pct){
+    cout<<nl<<std::left<<std::setw(24)<<"vs baseline"<<std::right
+        <<std::setw(14)<<"old ns/op"<<std::setw(14)<<"new ns/op"<<std::setw(10)<<"change"<<nl;
+    int regressions=0;
+    for(const BenchResult& r : g_results){
+        const BenchResult* b=nullptr;
+        for(const BenchResult& c : base){
+            if(c.name==r.name) b=&c;
+        }
+        if(!b) continue;
+
+        double change=b->ns_per_op>0.0 ? (r.ns_per_op/b->ns_per_op-1.0)*100.0 : 0.0;
+        bool slower=change>threshold_pct;
+        bool allocs=r.allocs_per_op>b->allocs_per_op+0.5;
+        cout<<std::left<<std::setw(24)<<r.name<<std::right
+            <<std::fixed<<std::setprecision(1)<<std::setw(14)<<b->ns_per_op
+            <<std::setw(14)<<r.ns_per_op<<std::setw(9)<<std::showpos<<change<<"%"<<std::noshowpos;
+        if(slower) cout<<"  REGRESSION";
+        if(allocs) cout<<"  ALLOCS "<<b->allocs_per_op<<" -> "<<r.allocs_per_op;
+        cout<<nl;
+        if(slower || allocs) regressions++;
+    }
+    return regressions;
+}
+
+void usage(const char* prog){
+    cerr<<"usage: "<<prog<<" [--json OUT] [--baseline IN] [--threshold PCT]"
+        <<" [--min-time SEC] [--repeat N] [--filter NAME]\n";
+}
+
+int main(int argc, char** argv){
+    std::string json_path;
+    std::string baseline_path;
+    double threshold=10.0;
+    for(int i=1;i<argc;i++){
+        std::string arg=argv[i];
+        if(arg=="--json" && i+1<argc) json_path=argv[++i];
+        else if(arg=="--baseline" && i+1<argc) baseline_path=argv[++i];
+        else if(arg=="--threshold" && i+1<argc) threshold=std::atof(argv[++i]);
+        else if(arg=="--min-time" && i+1<argc) g_min_time=std::atof(argv[++i]);
+        else if(arg=="--repeat" && i+1<argc) g_repeats=std::max(1,std::atoi(argv[++i]));
+        else if(arg=="--filter" && i+1<argc) g_filter=argv[++i];
+        else{
+            usage(argv[0]);
+            return 2;
+        }
+    }
+
+    std::vector<BenchResult> baseline;
+    if(!baseline_path.empty() && !read_json(baseline_path,baseline)){
+        cerr<<"cannot read baseline "<<baseline_path<<nl;
+        return 2;
+    }
+
+    if(!verify_snapshot_ring()) return 1;
+    if(!verify_snapshot_clock()) return 1;
+    if(!verify_state_roundtrip()) return 1;
+    if(!verify_stream_framer()) return 1;
+    if(!verify_slow_reader()) return 1;
+    if(!verify_interest()) return 1;
+    if(!verify_zero_alloc()) return 1;
+
+    World w;
+    setup_world(w);
+    std::mt19937 rng(7);
+
+    cout<<BENCH_PLAYERS<<" players, "<<BENCH_COINS<<" coins, "
+        <<BENCH_SNAPSHOTS<<" buffered snapshots"<<nl;
+    cout<<std::left<<std::setw(24)<<"case"<<std::right
+        <<std::setw(14)<<"ns/op"<<std::setw(14)<<"allocs/op"<<std::setw(14)<<"bytes/op"<<nl;
+
+    // server side
+
+    run_case("update_world",[&]{
+        steer_players(w,rng);
+        update_world(w,w.tick++);
+        g_sink+=w.players[0].score;
+    });
+
+    run_case("build_snapshot",[&]{
+        proto::worldSnapshot s=build_snapshot(w,w.tick);
+        g_sink+=s.num_players;
+    });
+
+    // a keyframe and a one-tick delta from the world as it now stands
+    proto::worldSnapshot base=build_snapshot(w,w.tick);
+    steer_players(w,rng);
+    update_world(w,w.tick);
+    proto::worldSnapshot snap=build_snapshot(w,w.tick+1);
+    proto::coinUpdate all_coins;
+    proto::coinUpdate changed_coins;
+    collect_all_coins(w,all_coins);
+    collect_coin_changes(w,base.tick,changed_coins);
+
+    // text STATE
+
+    // into a buffer sized by text_state_bound, as the server does from its
+    // tick arena
+    std::vector<char> text(proto::text_state_bound(snap,all_coins));
+    std::string_view line;
+    run_case("encode_state",[&]{
+        size_t len=proto::encode_state(snap,all_coins,text.data(),text.size());
+        line=std::string_view(text.data(),len);
+        g_sink+=static_cast<long>(len);
+    });
+
+    proto::worldSnapshot decoded;
+    proto::coinUpdate decoded_coins;
+    run_case("decode_state",[&]{
+        proto::decode_state(line,decoded,decoded_coins);
+        g_sink+=decoded.num_players;
+    });
+
+    // binary STATE
+
+    std::vector<uint8_t> frame(proto::MAX_FRAME_SIZE);
+    size_t frame_len=0;
+    run_case("encode_state_binary",[&]{
+        frame_len=proto::encode_state_binary(snap,all_coins,frame.data(),frame.size());
+        g_sink+=static_cast<long>(frame_len);
+    });
+
+    run_case("decode_state_binary",[&]{
+        proto::decode_state_binary(frame.data(),frame_len,decoded,decoded_coins);
+        g_sink+=decoded.num_players;
+    });
+
+    std::vector<uint8_t> delta(proto::MAX_FRAME_SIZE);
+    size_t delta_len=0;
+    run_case("encode_state_delta",[&]{
+        delta_len=proto::encode_state_delta(snap,base,changed_coins,delta.data(),delta.size());
+        g_sink+=static_cast<long>(delta_len);
+    });
+
+    run_case("decode_state_delta",[&]{
+        proto::decode_state_binary(delta.data(),delta_len,decoded,decoded_coins,&base);
+        g_sink+=decoded.num_players;
+    });
+
+    // server side of the TCP stream: a burst of INPUT and ACK lines through
+    // a socket pair, framed and parsed the way drain_client does it
+    int pair[2];
+    if(socketpair(AF_UNIX,SOCK_STREAM,0,pair)==0){
+        std::string burst;
+        for(int i=0;i<32;i++){
+            burst+="INPUT "+std::to_string(1000+i)+" 1 -1\n";
+            burst+="ACK "+std::to_string(5000+i)+"\r\n";
+        }
+        StreamFramer in;
+        run_case("frame_client_lines",[&]{
+            ssize_t sent=::send(pair[0],burst.data(),burst.size(),0);
+            ssize_t got=0;
+            while(got<sent){
+                ssize_t n=in.fill(pair[1]);
+                if(n<=0) break;
+                got+=n;
+                StreamFramer::Frame f;
+                while(in.next(f)){
+                    proto::FieldReader fields(f.data);
+                    int a=0;
+                    int b=0;
+                    int c=0;
+                    if(fields.skip() && fields.read(a)){
+                        fields.read(b);
+                        fields.read(c);
+                    }
+                    g_sink+=a+b+c;
+                }
+            }
+        });
+        ::close(pair[0]);
+        ::close(pair[1]);
+    }
+
+    // client side: what compute_render_state does every frame, reading the
+    // newest snapshot and the interpolation pair out of the lock-free ring
+    static SnapshotRing<128> ring;
+    for(int i=0;i<BENCH_SNAPSHOTS;i++){
+        steer_players(w,rng);
+        update_world(w,w.tick);
+        TimedSnapshot ts;
+        ts.snap=build_snapshot(w,w.tick);
+        ts.snap.server_time=static_cast<double>(w.tick)*sim::TICK_DT;
+        ts.recv_time=ts.snap.server_time+0.05;
+        ring.push(ts);
+        w.tick++;
+    }
+    TripleBuffer<std::vector<proto::coinState>> coin_list;
+    collect_all_coins(w,all_coins);
+    coin_list.write_buffer()=all_coins.coins;
+    coin_list.publish();
+
+    run_case("compute_render_state",[&]{
+        RenderState rs;
+        TimedSnapshot latest;
+        TimedSnapshot a;
+        TimedSnapshot b;
+        ring.read_newest(latest);
+        double target=latest.snap.server_time-INTERP_DELAY;
+        ring.interpolation_pair(target,a,b);
+        rs.coins=&coin_list.read();
+        interpolate_render_state(a,b,target,latest.snap,1,rs);
+        g_sink+=rs.num_remote;
+    });
+
+    if(!json_path.empty()){
+        if(!write_json(json_path)){
+            cerr<<"cannot write "<<json_path<<nl;
+            return 2;
+        }
+        cout<<nl<<"wrote "<<json_path<<nl;
+    }
+
+    if(!baseline_path.empty()){
+        int regressions=compare_with_baseline(baseline,threshold);
+        if(regressions>0){
+            cerr<<regressions<<" case(s) regressed beyond "<<threshold<<"%\n";
+            return 1;
+        }
+    }
+    return 0;
+}
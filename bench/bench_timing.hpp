@@ -0,0 +1,21 @@
+#pragma once
+
+#include "../common/utils.hpp"
+
+// timing for the standalone benchmarks (bench.cpp has its own, with
+// allocation counts and repeats)
+
+// run fn repeatedly for at least min_seconds, return seconds per call
+template<typename Fn>
+double time_per_call(Fn fn, double min_seconds=0.2){
+    fn(); // warm-up, also grows any reused buffers
+    int iters=0;
+    double start=now_seconds();
+    double elapsed=0.0;
+    do{
+        fn();
+        iters++;
+        elapsed=now_seconds()-start;
+    }while(elapsed<min_seconds);
+    return elapsed/iters;
+}
@@ -0,0 +1,18 @@
+#pragma once
+
+#include <random>
+
+#include "../server/world.hpp"
+
+// inputs for the benchmarks that step a World
+
+// new random directions for every player slot now and then, so players keep
+// crossing the world. the same rng seed gives every world the same inputs.
+inline void steer_players(World& w, std::mt19937& rng){
+    if(w.tick%15!=0) return;
+    for(int i=0;i<w.max_players;i++){
+        int dx=static_cast<int>(rng()%3)-1;
+        int dy=static_cast<int>(rng()%3)-1;
+        apply_input(w,i,w.tick,dx,dy);
+    }
+}
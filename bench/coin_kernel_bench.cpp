@@ -0,0 +1,137 @@
+// player-vs-coin pickup kernels: checks every SIMD kernel against the scalar
+// one on random fields, then times them at increasing coin counts with a
+// full set of players. exits non-zero on any mismatch.
+
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <random>
+
+#include "../common/utils.hpp"
+#include "../common/protocol.hpp"
+#include "../common/coin_field.hpp"
+#include "bench_timing.hpp"
+
+using std::cout;
+
+#define nl "\n"
+
+struct NamedKernel{
+    const char* name;
+    CoinPickupKernel fn;
+};
+
+void fill_field(CoinField& f, int n, float active_ratio, std::mt19937& rng){
+    std::uniform_real_distribution<float> dx(0.0f,proto::WORLD_WIDTH);
+    std::uniform_real_distribution<float> dy(0.0f,proto::WORLD_HEIGHT);
+    std::uniform_real_distribution<float> u(0.0f,1.0f);
+    f.resize(n);
+    for(int i=0;i<n;i++){
+        float x=dx(rng);
+        float y=dy(rng);
+        if(u(rng)<active_ratio) f.set(i,x,y);
+        else{
+            // inactive slots keep a position so the mask is what hides them
+            f.x[i]=x;
+            f.y[i]=y;
+        }
+    }
+}
+
+int run_kernel(CoinPickupKernel k, const CoinField& f, float px, float py,
+               float r_sq, int* out, int max_out){
+    return k(f.x.data(),f.y.data(),f.active.data(),static_cast<int>(f.x.size()),
+             px,py,r_sq,out,max_out);
+}
+
+// compare against scalar on random fields, including small max_out
+bool verify(const std::vector<NamedKernel>& kernels){
+    std::mt19937 rng(42);
+    std::uniform_real_distribution<float> dx(0.0f,proto::WORLD_WIDTH);
+    std::uniform_real_distribution<float> dy(0.0f,proto::WORLD_HEIGHT);
+    std::uniform_real_distribution<float> dr(5.0f,200.0f);
+    const int sizes[]={1,3,7,8,9,63,64,65,200,1000,4096};
+    const int max_outs[]={1,4,64,proto::MAX_COINS};
+
+    std::vector<int> want(proto::MAX_COINS);
+    std::vector<int> got(proto::MAX_COINS);
+    CoinField f;
+    int cases=0;
+    for(int n : sizes){
+        for(float ratio : {0.0f,0.3f,1.0f}){
+            fill_field(f,n,ratio,rng);
+            for(int q=0;q<50;q++){
+                float px=dx(rng);
+                float py=dy(rng);
+                float r=dr(rng);
+                for(int m : max_outs){
+                    int nw=run_kernel(coin_pickup_scalar,f,px,py,r*r,want.data(),m);
+                    for(const auto& k : kernels){
+                        int ng=run_kernel(k.fn,f,px,py,r*r,got.data(),m);
+                        bool same=(ng==nw);
+                        for(int i=0;same && i<nw;i++) same=(got[i]==want[i]);
+                        if(!same){
+                            std::cerr<<"MISMATCH "<<k.name<<" n="<<n<<" max_out="<<m
+                                     <<": "<<ng<<" hits vs scalar "<<nw<<nl;
+                            return false;
+                        }
+                    }
+                    cases++;
+                }
+            }
+        }
+    }
+    cout<<"verified "<<kernels.size()<<" kernel(s) against scalar over "<<cases<<" cases"<<nl;
+    return true;
+}
+
+int main(){
+    std::vector<NamedKernel> kernels;
+#ifdef COIN_KERNEL_X86
+    kernels.push_back({"sse2",coin_pickup_sse2});
+    if(__builtin_cpu_supports("avx2")) kernels.push_back({"avx2",coin_pickup_avx2});
+#endif
+    cout<<"runtime selection: "<<coin_kernel_name(select_coin_kernel())<<nl;
+
+    if(!verify(kernels)) return 1;
+
+    kernels.insert(kernels.begin(),NamedKernel{"scalar",coin_pickup_scalar});
+
+    const int counts[]={256,1024,4096};
+    const int players=proto::MAX_PLAYERS;
+    const float pickup_dist=proto::PLAYER_RADIUS+proto::COIN_RADIUS;
+    const float r_sq=pickup_dist*pickup_dist;
+
+    cout<<nl<<"one pickup pass = "<<players<<" players against every coin"<<nl;
+    cout<<std::left<<std::setw(8)<<"coins";
+    for(const auto& k : kernels) cout<<std::setw(14)<<(std::string(k.name)+" us");
+    cout<<"hits"<<nl;
+
+    for(int n : counts){
+        std::mt19937 rng(7);
+        CoinField f;
+        fill_field(f,n,0.9f,rng);
+        std::uniform_real_distribution<float> dx(0.0f,proto::WORLD_WIDTH);
+        std::uniform_real_distribution<float> dy(0.0f,proto::WORLD_HEIGHT);
+        std::vector<float> px(players),py(players);
+        for(int i=0;i<players;i++){
+            px[i]=dx(rng);
+            py[i]=dy(rng);
+        }
+
+        int out[64];
+        long hits=0;
+        cout<<std::left<<std::setw(8)<<n;
+        for(const auto& k : kernels){
+            double t=time_per_call([&]{
+                hits=0;
+                for(int i=0;i<players;i++){
+                    hits+=run_kernel(k.fn,f,px[i],py[i],r_sq,out,64);
+                }
+            });
+            cout<<std::setw(14)<<std::fixed<<std::setprecision(2)<<t*1e6;
+        }
+        cout<<hits<<nl;
+    }
+    return 0;
+}
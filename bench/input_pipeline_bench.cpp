@@ -0,0 +1,161 @@
+// input pipeline contention: many producer threads feeding one consumer,
+// through a shared mutex + std::queue (the old path) vs one SPSC ring per
+// producer (the new path). also checks that the timing wheel releases every
+// item on exactly its due tick. exits non-zero if a check fails.
+
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <queue>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <random>
+#include <memory>
+
+#include "../common/utils.hpp"
+#include "../common/spsc_ring.hpp"
+#include "../common/timing_wheel.hpp"
+
+using std::cout;
+
+#define nl "\n"
+
+struct Event{
+    int producer=0;
+    int seq=0;
+    double ready_time=0.0;
+};
+
+constexpr int EVENTS_PER_PRODUCER=200000;
+typedef SpscRing<Event,128> Ring;
+
+// wall seconds to move every event from producers to the consumer
+double run_mutex_queue(int producers){
+    std::mutex m;
+    std::queue<Event> q;
+    std::atomic<bool> go{false};
+    std::vector<std::thread> threads;
+    for(int p=0;p<producers;p++){
+        threads.emplace_back([&,p]{
+            while(!go) std::this_thread::yield();
+            for(int i=0;i<EVENTS_PER_PRODUCER;i++){
+                std::lock_guard<std::mutex> lock(m);
+                q.push(Event{p,i,0.0});
+            }
+        });
+    }
+
+    long want=static_cast<long>(producers)*EVENTS_PER_PRODUCER;
+    long got=0;
+    double start=now_seconds();
+    go=true;
+    while(got<want){
+        long before=got;
+        {
+            std::lock_guard<std::mutex> lock(m);
+            while(!q.empty()){
+                q.pop();
+                got++;
+            }
+        }
+        if(got==before) std::this_thread::yield();
+    }
+    double elapsed=now_seconds()-start;
+    for(auto& t : threads) t.join();
+    return elapsed;
+}
+
+// same with one ring per producer; false if an event arrived out of order
+bool run_spsc_rings(int producers, double& elapsed){
+    std::unique_ptr<Ring[]> rings(new Ring[producers]);
+    std::atomic<bool> go{false};
+    std::vector<std::thread> threads;
+    for(int p=0;p<producers;p++){
+        threads.emplace_back([&,p]{
+            while(!go) std::this_thread::yield();
+            for(int i=0;i<EVENTS_PER_PRODUCER;i++){
+                while(!rings[p].push(Event{p,i,0.0})) std::this_thread::yield();
+            }
+        });
+    }
+
+    std::vector<int> next_seq(producers,0);
+    bool ordered=true;
+    long want=static_cast<long>(producers)*EVENTS_PER_PRODUCER;
+    long got=0;
+    double start=now_seconds();
+    go=true;
+    Event ev;
+    while(got<want){
+        long before=got;
+        for(int p=0;p<producers;p++){
+            while(rings[p].pop(ev)){
+                if(ev.seq!=next_seq[p]++) ordered=false;
+                got++;
+            }
+        }
+        if(got==before) std::this_thread::yield(); // let producers run
+    }
+    elapsed=now_seconds()-start;
+    for(auto& t : threads) t.join();
+    return ordered;
+}
+
+// schedule items with random due ticks in random order and make sure each
+// comes out on exactly its tick, including ones due further out than a lap
+bool verify_wheel(){
+    std::mt19937 rng(99);
+    TimingWheel<Event> wheel(16);
+    std::uniform_int_distribution<int> ahead(0,40);
+    std::vector<long> due;
+    long released=0;
+    bool ok=true;
+    for(long tick=0;tick<2000;tick++){
+        int n=static_cast<int>(rng()%5);
+        for(int i=0;i<n;i++){
+            Event ev;
+            ev.seq=static_cast<int>(due.size());
+            due.push_back(tick+ahead(rng));
+            wheel.schedule(due.back(),ev);
+        }
+        wheel.advance(tick,[&](const Event& ev){
+            if(due[ev.seq]!=tick) ok=false;
+            released++;
+        });
+    }
+    long outstanding=0;
+    for(long d : due) if(d>=2000) outstanding++;
+    if(!ok || released+outstanding!=static_cast<long>(due.size())){
+        std::cerr<<"timing wheel released items on the wrong tick\n";
+        return false;
+    }
+    cout<<"timing wheel: "<<released<<" items released on their due tick"<<nl;
+    return true;
+}
+
+int main(){
+    if(!verify_wheel()) return 1;
+
+    const int counts[]={1,2,4,8,16,64};
+    cout<<nl<<EVENTS_PER_PRODUCER<<" events per producer, one consumer"<<nl;
+    cout<<std::left<<std::setw(11)<<"producers"
+        <<std::setw(18)<<"mutex Mev/s"
+        <<std::setw(18)<<"spsc Mev/s"
+        <<"speedup"<<nl;
+
+    for(int producers : counts){
+        double total=static_cast<double>(producers)*EVENTS_PER_PRODUCER;
+        double locked=run_mutex_queue(producers);
+        double rings=0.0;
+        if(!run_spsc_rings(producers,rings)){
+            std::cerr<<"SPSC ring delivered events out of order\n";
+            return 1;
+        }
+        cout<<std::left<<std::setw(11)<<producers
+            <<std::setw(18)<<std::fixed<<std::setprecision(2)<<total/locked/1e6
+            <<std::setw(18)<<total/rings/1e6
+            <<std::setprecision(1)<<locked/rings<<nl;
+    }
+    return 0;
+}
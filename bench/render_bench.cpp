@@ -0,0 +1,109 @@
+// entity drawing benchmark on SDL's software renderer, so it runs without a
+// window or GPU: one SetRenderDrawColor/RenderFillRect pair per entity (the
+// old client loop) against the client's EntityBatch, at increasing entity
+// counts. entities are spread over a world four times the viewport, so
+// about three quarters of them are culled by the batch.
+
+#include <SDL2/SDL.h>
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <random>
+
+#include "../common/utils.hpp"
+#include "../common/protocol.hpp"
+#include "../client/entity_batch.hpp"
+#include "bench_timing.hpp"
+
+using std::cout;
+using std::cerr;
+
+#define nl "\n"
+
+struct Entity{
+    float x=0.0f;
+    float y=0.0f;
+    SDL_Color color{255,255,255,255};
+};
+
+// a software-rendered frame takes milliseconds, so each side is timed a
+// little longer than the other benchmarks' cases
+constexpr double FRAME_MIN_SECONDS=0.3;
+
+int main(){
+    const int view_w=static_cast<int>(proto::VIEW_WIDTH);
+    const int view_h=static_cast<int>(proto::VIEW_HEIGHT);
+    const float r=proto::COIN_RADIUS;
+
+    if(SDL_Init(0)<0){
+        cerr<<"SDL_Init failed: "<<SDL_GetError()<<nl;
+        return 1;
+    }
+    SDL_Surface* target=SDL_CreateRGBSurfaceWithFormat(0,view_w,view_h,32,SDL_PIXELFORMAT_RGBA32);
+    SDL_Renderer* renderer=target ? SDL_CreateSoftwareRenderer(target) : nullptr;
+    if(!renderer){
+        cerr<<"software renderer failed: "<<SDL_GetError()<<nl;
+        if(target) SDL_FreeSurface(target);
+        SDL_Quit();
+        return 1;
+    }
+
+    const int counts[]={3,100,1000,10000,100000};
+    cout<<std::left<<std::setw(9)<<"n"
+        <<std::setw(14)<<"fillrect ms"
+        <<std::setw(14)<<"batched ms"
+        <<std::setw(10)<<"speedup"
+        <<"drawn"<<nl;
+
+    EntityBatch batch;
+    for(int n : counts){
+        std::mt19937 rng(1234);
+        std::uniform_real_distribution<float> dx(0.0f,view_w*2.0f);
+        std::uniform_real_distribution<float> dy(0.0f,view_h*2.0f);
+        std::uniform_int_distribution<int> channel(64,255);
+        std::vector<Entity> ents(n);
+        for(auto& e : ents){
+            e.x=dx(rng);
+            e.y=dy(rng);
+            e.color=SDL_Color{static_cast<Uint8>(channel(rng)),static_cast<Uint8>(channel(rng)),
+                              static_cast<Uint8>(channel(rng)),255};
+        }
+
+        // the present makes the software renderer execute its command queue,
+        // so both sides pay for the actual rasterization
+        double per_rect=time_per_call([&]{
+            SDL_SetRenderDrawColor(renderer,20,20,20,255);
+            SDL_RenderClear(renderer);
+            for(const auto& e : ents){
+                SDL_Rect rect;
+                rect.w=static_cast<int>(r*2.0f);
+                rect.h=static_cast<int>(r*2.0f);
+                rect.x=static_cast<int>(e.x-r);
+                rect.y=static_cast<int>(e.y-r);
+                SDL_SetRenderDrawColor(renderer,e.color.r,e.color.g,e.color.b,e.color.a);
+                SDL_RenderFillRect(renderer,&rect);
+            }
+            SDL_RenderPresent(renderer);
+        },FRAME_MIN_SECONDS);
+
+        double batched=time_per_call([&]{
+            SDL_SetRenderDrawColor(renderer,20,20,20,255);
+            SDL_RenderClear(renderer);
+            batch.begin(0.0f,0.0f,static_cast<float>(view_w),static_cast<float>(view_h));
+            for(const auto& e : ents) batch.add_square(e.x,e.y,r,e.color);
+            batch.flush(renderer);
+            SDL_RenderPresent(renderer);
+        },FRAME_MIN_SECONDS);
+
+        cout<<std::left<<std::setw(9)<<n<<std::fixed<<std::setprecision(3)
+            <<std::setw(14)<<per_rect*1000.0
+            <<std::setw(14)<<batched*1000.0
+            <<std::setprecision(1)<<std::setw(10)<<per_rect/batched
+            <<batch.drawn<<nl;
+    }
+
+    SDL_DestroyRenderer(renderer);
+    SDL_FreeSurface(target);
+    SDL_Quit();
+    return 0;
+}
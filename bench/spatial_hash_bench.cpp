@@ -0,0 +1,110 @@
+// broadphase microbenchmark: spatial hash vs brute force pair and pickup
+// checks at increasing entity counts. density is kept roughly constant by
+// growing the world with the entity count.
+
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <random>
+#include <cmath>
+
+#include "../common/utils.hpp"
+#include "../common/protocol.hpp"
+#include "../common/spatial_hash.hpp"
+#include "bench_timing.hpp"
+
+using std::cout;
+
+#define nl "\n"
+
+struct Entity{
+    float x=0.0f;
+    float y=0.0f;
+};
+
+int main(){
+    const float min_dist=proto::PLAYER_RADIUS*2.0f;
+    const float pickup_dist=proto::PLAYER_RADIUS+proto::COIN_RADIUS;
+    const int counts[]={2,64,1000,10000};
+
+    cout<<std::left<<std::setw(8)<<"n"
+        <<std::setw(14)<<"brute us"
+        <<std::setw(14)<<"hash us"
+        <<std::setw(10)<<"speedup"
+        <<std::setw(10)<<"pairs"
+        <<"pickups"<<nl;
+
+    for(int n : counts){
+        // ~60x60 px per entity, never smaller than the real world
+        float side=std::sqrt(static_cast<float>(n))*60.0f;
+        float w=std::max(proto::WORLD_WIDTH,side);
+        float h=std::max(proto::WORLD_HEIGHT,side);
+
+        std::mt19937 rng(1234);
+        std::uniform_real_distribution<float> dx(0.0f,w);
+        std::uniform_real_distribution<float> dy(0.0f,h);
+        std::vector<Entity> ents(n);
+        for(auto& e : ents){
+            e.x=dx(rng);
+            e.y=dy(rng);
+        }
+        // one pickup query per entity, same count as a coin field
+        std::vector<Entity> coins(n);
+        for(auto& c : coins){
+            c.x=dx(rng);
+            c.y=dy(rng);
+        }
+
+        long brute_pairs=0;
+        long brute_hits=0;
+        double brute=time_per_call([&]{
+            brute_pairs=0;
+            brute_hits=0;
+            const float min_sq=min_dist*min_dist;
+            for(int i=0;i<n;i++){
+                for(int j=i+1;j<n;j++){
+                    float ex=ents[i].x-ents[j].x;
+                    float ey=ents[i].y-ents[j].y;
+                    if(ex*ex+ey*ey<min_sq) brute_pairs++;
+                }
+            }
+            const float pick_sq=pickup_dist*pickup_dist;
+            for(const auto& c : coins){
+                for(const auto& e : ents){
+                    float ex=e.x-c.x;
+                    float ey=e.y-c.y;
+                    if(ex*ex+ey*ey<=pick_sq) brute_hits++;
+                }
+            }
+        });
+
+        SpatialHash grid(min_dist,w,h);
+        long hash_pairs=0;
+        long hash_hits=0;
+        double hashed=time_per_call([&]{
+            hash_pairs=0;
+            hash_hits=0;
+            grid.clear();
+            for(int i=0;i<n;i++) grid.insert(i,ents[i].x,ents[i].y);
+            grid.build();
+            grid.for_each_pair(min_dist,[&](int,int){ hash_pairs++; });
+            for(const auto& c : coins){
+                grid.query(c.x,c.y,pickup_dist,[&](int){ hash_hits++; });
+            }
+        });
+
+        if(brute_pairs!=hash_pairs || brute_hits!=hash_hits){
+            std::cerr<<"MISMATCH at n="<<n<<": pairs "<<brute_pairs<<" vs "<<hash_pairs
+                     <<", pickups "<<brute_hits<<" vs "<<hash_hits<<nl;
+            return 1;
+        }
+
+        cout<<std::left<<std::setw(8)<<n
+            <<std::setw(14)<<std::fixed<<std::setprecision(2)<<brute*1e6
+            <<std::setw(14)<<hashed*1e6
+            <<std::setw(10)<<std::setprecision(1)<<brute/hashed
+            <<std::setw(10)<<hash_pairs
+            <<hash_hits<<nl;
+    }
+    return 0;
+}
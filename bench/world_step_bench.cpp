@@ -0,0 +1,160 @@
+// update_world on a WorkPool: checks that the parallel step leaves the world
+// bit-identical to the serial one for every thread count, then times a tick
+// at 1..N threads. exits non-zero if a check fails.
+//
+//   ./bench/bench_world_step [max threads]
+
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <random>
+#include <memory>
+#include <thread>
+#include <cstring>
+#include <cstdlib>
+
+#include "../common/utils.hpp"
+#include "../common/protocol.hpp"
+#include "../common/work_pool.hpp"
+#include "../server/world.hpp"
+#include "bench_world.hpp"
+
+using std::cout;
+using std::cerr;
+
+#define nl "\n"
+
+constexpr int CHECK_TICKS=600;
+
+struct Scene{
+    const char* name;
+    float width;
+    float height;
+    int coins;
+};
+
+// a crowd packed into a small world keeps pairs on band borders colliding;
+// the big one is what a full room with the most coins looks like
+const Scene SCENES[]={
+    {"crowded 320x320, 512 coins",320.0f,320.0f,512},
+    {"800x600, 4096 coins",proto::WORLD_WIDTH,proto::WORLD_HEIGHT,proto::MAX_COINS},
+    {"4096x4096, 4096 coins",4096.0f,4096.0f,proto::MAX_COINS},
+};
+
+void setup(World& w, const Scene& s){
+    w.max_players=proto::MAX_PLAYERS;
+    w.num_coins=s.coins;
+    w.coin_kernel=select_coin_kernel();
+    w.seed=3;
+    w.width=s.width;
+    w.height=s.height;
+    reset_world(w);
+    for(int i=0;i<proto::MAX_PLAYERS;i++) spawn_player(w,i);
+}
+
+bool same_bits(float a, float b){
+    return std::memcmp(&a,&b,sizeof(float))==0;
+}
+
+// everything update_world writes, compared bit for bit
+bool same_world(const World& a, const World& b){
+    for(int i=0;i<a.max_players;i++){
+        const Player& p=a.players[i];
+        const Player& q=b.players[i];
+        if(!same_bits(p.x,q.x) || !same_bits(p.y,q.y) || p.score!=q.score) return false;
+    }
+    if(a.coins.active!=b.coins.active) return false;
+    for(int i=0;i<a.num_coins;i++){
+        if(!same_bits(a.coins.x[i],b.coins.x[i]) || !same_bits(a.coins.y[i],b.coins.y[i])) return false;
+    }
+    if(a.coin_log.size()!=b.coin_log.size()) return false;
+    for(size_t i=0;i<a.coin_log.size();i++){
+        if(a.coin_log[i].tick!=b.coin_log[i].tick || a.coin_log[i].id!=b.coin_log[i].id) return false;
+    }
+    return a.coin_changed_tick==b.coin_changed_tick;
+}
+
+// a serial world and one stepped on a pool of threads, side by side
+bool verify(const Scene& s, int threads){
+    std::unique_ptr<World> serial(new World);
+    std::unique_ptr<World> parallel(new World);
+    setup(*serial,s);
+    setup(*parallel,s);
+    WorkPool pool(threads);
+    std::mt19937 rng_a(11);
+    std::mt19937 rng_b(11);
+
+    for(int t=0;t<CHECK_TICKS;t++){
+        steer_players(*serial,rng_a);
+        steer_players(*parallel,rng_b);
+        update_world(*serial,serial->tick);
+        update_world(*parallel,parallel->tick,&pool);
+        serial->tick++;
+        parallel->tick++;
+        if(!same_world(*serial,*parallel)){
+            cerr<<"FAIL "<<s.name<<": "<<threads<<" threads diverged on tick "<<t<<nl;
+            return false;
+        }
+    }
+    return true;
+}
+
+// seconds per tick, at least min_seconds of ticks
+double time_ticks(const Scene& s, WorkPool* pool, double min_seconds=0.3){
+    std::unique_ptr<World> w(new World);
+    setup(*w,s);
+    std::mt19937 rng(5);
+    for(int i=0;i<60;i++){ // warm-up, also grows the pickup lists
+        steer_players(*w,rng);
+        update_world(*w,w->tick++,pool);
+    }
+
+    long ticks=0;
+    double start=now_seconds();
+    double elapsed=0.0;
+    do{
+        for(int i=0;i<16;i++){
+            steer_players(*w,rng);
+            update_world(*w,w->tick++,pool);
+        }
+        ticks+=16;
+        elapsed=now_seconds()-start;
+    }while(elapsed<min_seconds);
+    return elapsed/static_cast<double>(ticks);
+}
+
+int main(int argc, char** argv){
+    int max_threads=static_cast<int>(std::thread::hardware_concurrency());
+    if(argc>1) max_threads=std::atoi(argv[1]);
+    if(max_threads<1) max_threads=1;
+
+    cout<<proto::MAX_PLAYERS<<" players, up to "<<max_threads<<" threads ("
+        <<std::thread::hardware_concurrency()<<" hardware), coin kernel "
+        <<coin_kernel_name(select_coin_kernel())<<nl;
+
+    // divergence is what matters here, not the core count, so check a few
+    // thread counts even on a small machine
+    int check_threads=std::max(max_threads,4);
+    for(const Scene& s : SCENES){
+        for(int t=1;t<=check_threads;t++){
+            if(!verify(s,t)) return 1;
+        }
+    }
+    cout<<"parallel step matches serial for 1-"<<check_threads<<" threads over "
+        <<CHECK_TICKS<<" ticks"<<nl;
+
+    for(const Scene& s : SCENES){
+        cout<<nl<<s.name<<nl;
+        cout<<std::setw(10)<<"threads"<<std::setw(14)<<"us/tick"<<std::setw(12)<<"speedup"<<nl;
+        double serial=time_ticks(s,nullptr);
+        cout<<std::setw(10)<<"serial"<<std::fixed<<std::setprecision(2)
+            <<std::setw(14)<<serial*1e6<<std::setw(12)<<1.0<<nl;
+        for(int t=1;t<=max_threads;t++){
+            WorkPool pool(t);
+            double per_tick=time_ticks(s,&pool);
+            cout<<std::setw(10)<<t<<std::setw(14)<<per_tick*1e6
+                <<std::setw(12)<<serial/per_tick<<nl;
+        }
+    }
+    return 0;
+}
@@ -5,20 +5,29 @@
 #include <thread>
 #include <atomic>
 #include <mutex>
-#include <deque>
 #include <vector>
 #include <string>
 #include <sstream>
 #include <algorithm> // std::clamp
+#include <cmath>
 #include <cstring>   // memset, strerror
+#include <cstdio>    // snprintf
 #include <unistd.h>  // close
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <arpa/inet.h>
+#include <sys/time.h>
 
 #include "../common/utils.hpp"
 #include "../common/protocol.hpp"
+#include "../common/simulation.hpp"
+#include "../common/stream_framer.hpp"
+#include "render_state.hpp"
+#include "net_state.hpp"
+#include "text_renderer.hpp"
+#include "entity_batch.hpp"
 
 using std::cout;
 using std::cerr;
@@ -27,10 +36,8 @@ using std::endl;
 #define nl "\n"
 
 // Networking helpers
-bool send_all(int sock,const std::string& data){
-    const char* buf = data.c_str();
+bool send_all(int sock,const char* buf,size_t len){
     size_t total=0;
-    size_t len=data.size();
     while (total<len) {
         ssize_t n=::send(sock, buf + total, len - total, 0);
         if (n<=0) {
@@ -41,18 +48,25 @@ bool send_all(int sock,const std::string& data){
     return true;
 }
 
-bool send_line(int sock,const std::string& line){
-    std::string data=line;
-    data.push_back('\n');
-    return send_all(sock, data);
+// input and ACK lines come from different threads; keep them whole
+std::mutex g_send_mutex;
+
+bool send_line(int sock,std::string line){
+    line.push_back('\n');
+    std::lock_guard<std::mutex> lock(g_send_mutex);
+    return send_all(sock,line.data(),line.size());
 }
 
-// client state structures
+// INPUT and ACK go out for every key change and snapshot, so they are
+// formatted on the stack instead of built as strings
+bool send_fields(int sock,std::string_view verb,std::initializer_list<int> fields){
+    char buf[64];
+    size_t len=proto::format_line(buf,sizeof(buf),verb,fields);
+    std::lock_guard<std::mutex> lock(g_send_mutex);
+    return len>0 && send_all(sock,buf,len);
+}
 
-struct TimedSnapshot{
-proto::worldSnapshot snap;
-    double recv_time=0.0;
-};
+// client state structures
 
 // Local predicted state for player
 struct PredictedState {
@@ -67,8 +81,10 @@ std::atomic<bool> g_running{true};
 std::atomic<bool> g_ready_to_play{false};
 int g_sock=-1;
 
-int g_player_id=0; // player id
-int g_player_idx=0; // player index
+int g_player_id=0; // player id, as used in snapshots
+// world size and interest radius from WELCOME/ACCEPT, which always come
+// before the first snapshot (and so before the render thread reads them)
+proto::WorldInfo g_world;
 
 Mix_Music* bgm=nullptr;
 Mix_Chunk* sfx_coin=nullptr;
@@ -76,73 +92,124 @@ Mix_Chunk* sfx_bump=nullptr;
 int last_score=0;
 bool last_bump_state=false;
 
-std::mutex g_snap_mutex;
-std::deque<TimedSnapshot> g_snapshots;
-bool g_has_snapshot=false;
-proto::worldSnapshot g_latest_snapshot;
+// snapshots, coins and delta baselines from the server: written by the
+// network thread, read lock-free by the render loop
+ClientNetState g_net;
+
+// HUD and overlay text (render thread only)
+TextRenderer g_text;
+// players and coins, one draw call per frame (render thread only)
+EntityBatch g_entities;
 
 PredictedState g_predicted;
 
+// inputs the server has not acknowledged yet (plus the newest acknowledged
+// one, which is still in effect), oldest first. step is the fixed sim step
+// the input took effect on locally. only touched by the main thread.
+struct PendingInput{
+    int seq=0;
+    int dx=0;
+    int dy=0;
+    long step=0;
+};
+constexpr int INPUT_HISTORY=256;
+PendingInput g_pending_inputs[INPUT_HISTORY];
+int g_pending_head=0;
+int g_pending_count=0;
+
+// local fixed-step clock for prediction
+sim::FixedStep g_sim_clock;
+long g_sim_step=0;
+int g_reconciled_tick=-1;
+
+// visual offset left by the last correction, decayed over a few frames so
+// the local player never visibly snaps
+float g_correction_x=0.0f;
+float g_correction_y=0.0f;
+constexpr float CORRECTION_DECAY=12.0f;   // per second
+constexpr float CORRECTION_SNAP_DIST=100.0f; // teleport-sized errors are not smoothed
+
 // input
 std::atomic<int> g_input_dx{0};
 std::atomic<int> g_input_dy{0};
 std::atomic<int> g_input_seq{0};
 
+// UDP transport (--udp); guarded by g_send_mutex
+bool g_use_udp=false;
+uint16_t g_udp_next_seq=0;
+proto::AckTracker g_udp_acks;
+proto::InputCmd g_recent_inputs[proto::UDP_INPUT_REDUNDANCY]; // newest first
+int g_recent_input_count=0;
+double g_udp_last_send=0.0;
+
+// the match is on once someone else is in the world with us. with an
+// interest radius they may be out of range, but the server only sends
+// snapshots once a match has started.
+void on_snapshot(const proto::worldSnapshot& s){
+    if(!g_ready_to_play && (s.num_players>=2 || g_world.interest>0)){
+        g_ready_to_play=true;
+    }
+}
+
+// decode a binary STATE frame, rebuilding deltas on top of the acked
+// baseline. returns the snapshot tick, or -1 if it could not be decoded.
+int handle_state_frame(const uint8_t* data, size_t len){
+    proto::worldSnapshot s;
+    bool fresh=false;
+    if(!g_net.on_frame(data,len,s,fresh)){
+        cerr<<"Dropping malformed binary frame.\n";
+        return -1;
+    }
+    if(fresh){
+        on_snapshot(s);
+    }
+    return s.tick;
+}
+
 // network receive thread
 
 void network_thread_func(){
-    std::string buffer;
-    char recv_buf[1024];
+    StreamFramer in(SERVER_STREAM_CAPACITY);
 
     while(g_running){
-        ssize_t n=::recv(g_sock,recv_buf,sizeof(recv_buf),0);
+        ssize_t n=in.fill(g_sock);
         if(n<=0){
+            if(n<0 && errno==EINTR) continue;
             cerr<<"Diconnected from server or recv error.\n";
             g_running=false;
             break;
         }
 
-        buffer.append(recv_buf,recv_buf+n);
-
-        size_t pos;
-        while((pos=buffer.find('\n'))!=std::string::npos){
-            std::string line=buffer.substr(0,pos);
-            buffer.erase(0,pos+1);
-
-            if(!line.empty() && line.back()=='\r'){
-                line.pop_back();
+        StreamFramer::Frame f;
+        while(in.next(f)){
+            if(f.binary){
+                int tick=handle_state_frame(reinterpret_cast<const uint8_t*>(f.data.data()),f.data.size());
+                if(tick>=0){
+                    send_fields(g_sock,"ACK",{tick});
+                }
+                continue;
             }
-            if(line.empty()) continue;
+            std::string_view line=f.data;
 
             // handle welcome
             if(line.rfind("WELCOME",0)==0){
-                std::istringstream iss(line);
-                std::string tag;
+                proto::FieldReader fields(line);
                 int id;
-                if(iss>>tag>>id){
+                if(fields.skip() && fields.read(id)){
                     g_player_id=id;
-                    g_player_idx=id-1;
-                    cout<<"Got WELCOME, I am player "<<g_player_id<<nl;
+                    proto::WorldInfo info;
+                    if(fields.read(info.width) && fields.read(info.height) && fields.read(info.interest)){
+                        g_world=info;
+                    }
+                    cout<<"Got WELCOME, I am player "<<g_player_id<<", world "
+                        <<g_world.width<<"x"<<g_world.height<<nl;
                 }
             }
-            // handle state
+            // handle state (text format, server started with --text-state)
             else if(line.rfind("STATE",0)==0){
                 proto::worldSnapshot s;
-                if(proto::decode_state(line,s)){
-                    if(!g_ready_to_play){
-                        g_ready_to_play=true;
-                    }
-                    TimedSnapshot ts;
-                    ts.snap=s;
-                    ts.recv_time=now_seconds();
-
-                    std::lock_guard<std::mutex> lock(g_snap_mutex);
-                    g_latest_snapshot=s;
-                    g_has_snapshot=true;
-                    g_snapshots.push_back(ts);
-                    while(g_snapshots.size()>120){
-                        g_snapshots.pop_front();
-                    }
+                if(g_net.on_text_state(line,s)){
+                    on_snapshot(s);
                 }
             }
             else{
@@ -154,124 +221,249 @@ void network_thread_func(){
     cout<<"Network thread exiting.\n";
 }
 
-// utils : interpolated positions
+// ---- UDP transport ----
 
-struct RenderState {
-    float local_x=0.0f;
-    float local_y=0.0f;
-    float remote_x=0.0f;
-    float remote_y=0.0f;
-    float coin_x=0.0f;
-    float coin_y=0.0f;
-    bool coin_active=false;
-    int local_score=0;
-    int remote_score=0;
-    bool ready=false;
-};
+proto::UdpHeader next_udp_header(uint8_t type){
+    proto::UdpHeader h;
+    h.type=type;
+    h.seq=g_udp_next_seq++;
+    h.ack=g_udp_acks.ack;
+    h.ack_bits=g_udp_acks.ack_bits;
+    return h;
+}
+
+// send the recent input commands; doubles as the ack/keepalive packet.
+// caller holds g_send_mutex.
+bool send_udp_input_locked(){
+    uint8_t buf[proto::UDP_MAX_PACKET];
+    size_t n=proto::encode_udp_input(next_udp_header(proto::PKT_INPUT),
+                                     g_recent_inputs,g_recent_input_count,buf,sizeof(buf));
+    g_udp_last_send=now_seconds();
+    return n>0 && ::send(g_sock,buf,n,0)==static_cast<ssize_t>(n);
+}
 
-RenderState compute_render_state(){
-    RenderState rs;
+bool send_udp_input(){
+    std::lock_guard<std::mutex> lock(g_send_mutex);
+    return send_udp_input_locked();
+}
+
+// record a new input command and send it along with the previous few
+bool send_input(int seq, int dx, int dy){
+    if(!g_use_udp){
+        return send_fields(g_sock,"INPUT",{seq,dx,dy});
+    }
 
-    if(!g_has_snapshot || g_player_id==0){
-        return rs;
+    std::lock_guard<std::mutex> lock(g_send_mutex);
+    for(int i=proto::UDP_INPUT_REDUNDANCY-1;i>0;i--){
+        g_recent_inputs[i]=g_recent_inputs[i-1];
     }
+    g_recent_inputs[0]=proto::InputCmd{seq,dx,dy};
+    if(g_recent_input_count<proto::UDP_INPUT_REDUNDANCY) g_recent_input_count++;
+    return send_udp_input_locked();
+}
 
-    std::deque<TimedSnapshot> snaps_copy;
-    proto::worldSnapshot latest;
-    {
-        std::lock_guard<std::mutex> lock(g_snap_mutex);
-        if(g_snapshots.empty()){
-            return rs;
+// CONNECT/ACCEPT handshake; replaces JOIN/WELCOME on the UDP path
+bool udp_handshake(){
+    uint32_t salt=static_cast<uint32_t>(now_seconds()*1000003.0)^static_cast<uint32_t>(getpid());
+    uint8_t buf[proto::UDP_MAX_PACKET];
+
+    double deadline=now_seconds()+proto::UDP_TIMEOUT;
+    while(now_seconds()<deadline){
+        size_t n;
+        {
+            std::lock_guard<std::mutex> lock(g_send_mutex);
+            n=proto::encode_udp_handshake(next_udp_header(proto::PKT_CONNECT),salt,0,buf,sizeof(buf));
         }
-        snaps_copy=g_snapshots;
-        latest=g_latest_snapshot;
-    }
-
-    rs.local_x=g_predicted.x;
-    rs.local_y=g_predicted.y;
-
-    // const double interp_delay=proto::SIMULATED_LATENCY; // 0.2
-    const double interp_delay=0.1;
-    double target_server_time=snaps_copy.back().snap.server_time-interp_delay;
-    
-    TimedSnapshot A=snaps_copy.front();
-    TimedSnapshot B=snaps_copy.back();
-
-    if(snaps_copy.size()>=2){
-        for(size_t i=1;i<snaps_copy.size();i++){
-            double prev_t=snaps_copy[i-1].snap.server_time;
-            double curr_t=snaps_copy[i].snap.server_time;
-            if(curr_t>=target_server_time){
-                A=snaps_copy[i-1];
-                B=snaps_copy[i];
-                break;
+        ::send(g_sock,buf,n,0);
+
+        double resend_at=now_seconds()+proto::UDP_RESEND_INTERVAL;
+        while(now_seconds()<resend_at){
+            ssize_t r=::recv(g_sock,buf,sizeof(buf),0);
+            if(r<=0) continue; // timeout, or ICMP refused before the server is up
+
+            proto::UdpHeader h;
+            if(!proto::read_udp_header(buf,static_cast<size_t>(r),h)) continue;
+            uint32_t reply_salt=0;
+            int id=0;
+            proto::WorldInfo info;
+            if(!proto::decode_udp_handshake(buf,static_cast<size_t>(r),h.type,reply_salt,id,&info)) continue;
+            if(reply_salt!=salt) continue;
+
+            if(h.type==proto::PKT_DENY){
+                cerr<<"Server is full.\n";
+                return false;
+            }
+            if(h.type==proto::PKT_ACCEPT){
+                g_player_id=id;
+                g_world=info;
+                cout<<"Got ACCEPT, I am player "<<g_player_id<<", world "
+                    <<g_world.width<<"x"<<g_world.height<<nl;
+                return true;
             }
         }
     }
-    else{
-        A=B=snaps_copy.front();
-    }
+    cerr<<"No answer from server.\n";
+    return false;
+}
 
-    double t;
-    double At=A.snap.server_time;
-    double Bt=B.snap.server_time;
-    if(At==Bt){
-        t=0.0;
-    }
-    else{
-        t=(target_server_time-At)/(Bt-At);
-        t=std::clamp(t,0.0,1.0);
-    }
+void udp_network_thread_func(){
+    uint8_t buf[proto::UDP_MAX_PACKET];
+    double last_recv=now_seconds();
+
+    while(g_running){
+        ssize_t n=::recv(g_sock,buf,sizeof(buf),0);
+        double now=now_seconds();
 
-    auto lerp=[](float a, float b, double tt){
-        return a+(b-a)*static_cast<float>(tt);
-    };
+        if(n>0){
+            proto::UdpHeader h;
+            if(proto::read_udp_header(buf,static_cast<size_t>(n),h)){
+                bool fresh;
+                {
+                    std::lock_guard<std::mutex> lock(g_send_mutex);
+                    fresh=g_udp_acks.on_receive(h.seq);
+                }
+                if(fresh){
+                    last_recv=now;
+                    if(h.type==proto::PKT_STATE){
+                        handle_state_frame(buf+proto::UDP_HEADER_SIZE,
+                                           static_cast<size_t>(n)-proto::UDP_HEADER_SIZE);
+                        // ack straight away so the server's baseline keeps up
+                        send_udp_input();
+                    }
+                    else if(h.type==proto::PKT_DISCONNECT){
+                        cerr<<"Server closed the connection.\n";
+                        g_running=false;
+                        break;
+                    }
+                }
+            }
+        }
+
+        // keepalive while the server has nothing to send (e.g. waiting room)
+        bool idle;
+        {
+            std::lock_guard<std::mutex> lock(g_send_mutex);
+            idle=now-g_udp_last_send>proto::UDP_RESEND_INTERVAL;
+        }
+        if(idle) send_udp_input();
+
+        if(g_ready_to_play && now-last_recv>proto::UDP_TIMEOUT){
+            cerr<<"Server timed out.\n";
+            g_running=false;
+            break;
+        }
+    }
 
-    int local_idx=g_player_idx;
-    int remote_idx=1-g_player_idx;
+    cout<<"Network thread exiting.\n";
+}
 
-    // using linear interpolation
-    rs.remote_x=lerp(A.snap.players[remote_idx].x,B.snap.players[remote_idx].x,t);
-    rs.remote_y=lerp(A.snap.players[remote_idx].y,B.snap.players[remote_idx].y,t);
+// utils : interpolated positions
 
-    // coin position
-    rs.coin_x=latest.coin_x;
-    rs.coin_y=latest.coin_y;
-    rs.coin_active=latest.coin_active;
+// ---- prediction and reconciliation ----
 
-    rs.local_score=latest.players[local_idx].score;
-    rs.remote_score=latest.players[remote_idx].score;
+PendingInput& pending_at(int i){
+    return g_pending_inputs[(g_pending_head+i)%INPUT_HISTORY];
+}
 
-    rs.ready=true;
-    return rs;
+void record_input(int seq, int dx, int dy){
+    if(g_pending_count==INPUT_HISTORY){
+        g_pending_head=(g_pending_head+1)%INPUT_HISTORY;
+        g_pending_count--;
+    }
+    PendingInput& in=pending_at(g_pending_count++);
+    in.seq=seq;
+    in.dx=dx;
+    in.dy=dy;
+    in.step=g_sim_step;
 }
 
+// take the authoritative state in the newest snapshot and replay every
+// input after the one it acknowledges on top of it. with the shared fixed
+// step this reproduces the server's result, so corrections only show up
+// when the server did something we cannot predict (collisions, jitter in
+// when an input was applied) and are smoothed out rather than snapped.
+void reconcile(){
+    TimedSnapshot latest;
+    if(!g_net.ring.read_newest(latest)) return;
+    if(latest.snap.tick==g_reconciled_tick) return;
+    const proto::playerState* p=proto::find_player(latest.snap,g_player_id);
+    if(!p) return;
+    proto::playerState me=*p;
+    int tick=latest.snap.tick;
+    g_reconciled_tick=tick;
+
+    // the acked input stays at the head, it is still the one in effect
+    while(g_pending_count>1 && pending_at(1).seq<=me.input_seq){
+        g_pending_head=(g_pending_head+1)%INPUT_HISTORY;
+        g_pending_count--;
+    }
 
-void render_text(SDL_Renderer* renderer, TTF_Font* font, const std::string& text, int x, int y) {
-    SDL_Color color={255, 255, 255, 255}; // white
-    SDL_Surface* surface=TTF_RenderText_Solid(font, text.c_str(), color);
-    if(!surface) return;
+    float x=me.x;
+    float y=me.y;
+    float vx=0.0f;
+    float vy=0.0f;
+    long from=g_sim_step;
+    int next=0;
+    if(me.input_seq<0){
+        // nothing applied yet: the server has held us still since spawning
+        if(g_pending_count>0) from=pending_at(0).step;
+    }
+    else if(g_pending_count>0 && pending_at(0).seq==me.input_seq){
+        const PendingInput& acked=pending_at(0);
+        sim::velocity_from_input(acked.dx,acked.dy,vx,vy);
+        // the server has stepped tick-input_tick+1 times under it
+        from=acked.step+(tick-me.input_tick+1);
+        next=1;
+    }
+    if(from>g_sim_step) from=g_sim_step; // server is ahead of us; take it as is
 
-    SDL_Texture* texture=SDL_CreateTextureFromSurface(renderer, surface);
-    SDL_Rect rect={x, y, surface->w, surface->h};
+    for(long step=from;step<g_sim_step;step++){
+        while(next<g_pending_count && pending_at(next).step<=step){
+            sim::velocity_from_input(pending_at(next).dx,pending_at(next).dy,vx,vy);
+            next++;
+        }
+        sim::step_player(x,y,vx,vy,static_cast<float>(g_world.width),static_cast<float>(g_world.height));
+    }
 
-    SDL_RenderCopy(renderer, texture, nullptr, &rect);
+    g_correction_x+=g_predicted.x-x;
+    g_correction_y+=g_predicted.y-y;
+    if(g_correction_x*g_correction_x+g_correction_y*g_correction_y>
+       CORRECTION_SNAP_DIST*CORRECTION_SNAP_DIST){
+        g_correction_x=0.0f;
+        g_correction_y=0.0f;
+    }
+    g_predicted.x=x;
+    g_predicted.y=y;
+}
 
-    SDL_FreeSurface(surface);
-    SDL_DestroyTexture(texture);
+// the local player is drawn where prediction has it
+RenderState compute_render_state(double now, double dt){
+    return g_net.render_state(now,dt,g_player_id,g_predicted.x,g_predicted.y);
 }
 
+
 // main
 
 int main(int argc, char** argv){
+    g_net.reset(proto::MAX_COINS);
 
     // connect to server
     std::string server_ip="127.0.0.1";
-    if(argc>=2){
-        server_ip=argv[1];
+    int port=proto::SERVER_PORT;
+    for(int i=1;i<argc;i++){
+        std::string arg=argv[i];
+        if(arg=="--udp"){
+            g_use_udp=true;
+        }
+        else if(arg=="--port" && i+1<argc){
+            port=std::atoi(argv[++i]);
+        }
+        else{
+            server_ip=arg;
+        }
     }
 
-    g_sock=::socket(AF_INET,SOCK_STREAM,0);
+    g_sock=::socket(AF_INET,g_use_udp ? SOCK_DGRAM : SOCK_STREAM,0);
     if(g_sock<0){
         cerr<<"socket() failed: "<<std::strerror(errno)<<endl;
         return 1;
@@ -280,23 +472,40 @@ int main(int argc, char** argv){
     sockaddr_in addr;
     std::memset(&addr, 0, sizeof(addr));
     addr.sin_family=AF_INET;
-    addr.sin_port=htons(proto::SERVER_PORT);
+    addr.sin_port=htons(static_cast<uint16_t>(port));
     if(::inet_pton(AF_INET,server_ip.c_str(),&addr.sin_addr)<=0){
         cerr<<"inet_pton failed for IP "<<server_ip<<endl;
         ::close(g_sock);
         return 1;
     }
 
-    cout<<"Connecting to "<<server_ip<<":"<<proto::SERVER_PORT<<"...\n";
+    cout<<"Connecting to "<<server_ip<<":"<<port<<"...\n";
     if(::connect(g_sock,(sockaddr*)&addr,sizeof(addr))<0){
         cerr<<"connect() failed: "<<std::strerror(errno)<<endl;
         ::close(g_sock);
         return 1;
     }
-    cout<<"Connected to server. \n";
 
-    send_line(g_sock,"JOIN client");
-    std::thread net_thread(network_thread_func);
+    std::thread net_thread;
+    if(g_use_udp){
+        // connect() on a datagram socket only fixes the peer address
+        timeval tv{0,static_cast<suseconds_t>(proto::UDP_RESEND_INTERVAL*1e6)};
+        setsockopt(g_sock,SOL_SOCKET,SO_RCVTIMEO,&tv,sizeof(tv));
+        if(!udp_handshake()){
+            ::close(g_sock);
+            return 1;
+        }
+        net_thread=std::thread(udp_network_thread_func);
+    }
+    else{
+        // ACKs time the server's RTT estimate for our snapshot rate, and
+        // inputs should not wait either; Nagle would hold both back
+        int nodelay=1;
+        setsockopt(g_sock,IPPROTO_TCP,TCP_NODELAY,&nodelay,sizeof(nodelay));
+        cout<<"Connected to server. \n";
+        send_line(g_sock,"JOIN client");
+        net_thread=std::thread(network_thread_func);
+    }
 
     // Init SDL
     if (SDL_Init(SDL_INIT_VIDEO | SDL_INIT_AUDIO) != 0) {
@@ -328,7 +537,7 @@ int main(int argc, char** argv){
     SDL_Window* window = SDL_CreateWindow(
         "Multiplayer Client",
         SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED,
-        (int)proto::WORLD_WIDTH, (int)proto::WORLD_HEIGHT,
+        (int)proto::VIEW_WIDTH, (int)proto::VIEW_HEIGHT,
         SDL_WINDOW_SHOWN
     );
     if (!window) {
@@ -355,6 +564,9 @@ int main(int argc, char** argv){
     if(!font){
         cerr<<"Failed to load font: "<<TTF_GetError()<<endl;
     }
+    else if(!g_text.init(renderer,font)){
+        cerr<<"Failed to build the glyph atlas: "<<SDL_GetError()<<endl;
+    }
 
     // load music
     bgm=Mix_LoadMUS("../assets/music.mp3");
@@ -400,15 +612,13 @@ int main(int argc, char** argv){
                     g_input_dy = dy;
 
                     int seq = g_input_seq.fetch_add(1);
-                    std::ostringstream oss;
-                    oss << "INPUT " << seq << " " << dx << " " << dy;
-                    if (!send_line(g_sock, oss.str())) {
+                    if (!send_input(seq, dx, dy)) {
                         cerr << "Failed to send INPUT.\n";
                     }
 
-                    // Update local predicted velocity
-                    g_predicted.vx = (float)dx * proto::PLAYER_SPEED;
-                    g_predicted.vy = (float)dy * proto::PLAYER_SPEED;
+                    // Update local predicted velocity, from the next sim step on
+                    record_input(seq, dx, dy);
+                    sim::velocity_from_input(dx, dy, g_predicted.vx, g_predicted.vy);
                 }
             }
         }
@@ -420,55 +630,37 @@ int main(int argc, char** argv){
         if (dt > 0.1) dt = 0.1; // clamp huge dt
 
         // Initialize prediction when we get the first snapshot
-        if (g_has_snapshot && !g_predicted.initialized) {
-            std::lock_guard<std::mutex> lock(g_snap_mutex);
-            proto::worldSnapshot s = g_latest_snapshot;
-            g_predicted.x = s.players[g_player_idx].x;
-            g_predicted.y = s.players[g_player_idx].y;
-            g_predicted.vx = 0.0f;
-            g_predicted.vy = 0.0f;
-            g_predicted.initialized = true;
+        TimedSnapshot first_snap;
+        if (!g_predicted.initialized && g_net.ring.read_newest(first_snap)) {
+            const proto::playerState* me = proto::find_player(first_snap.snap, g_player_id);
+            if (me) {
+                g_predicted.x = me->x;
+                g_predicted.y = me->y;
+                g_predicted.vx = 0.0f;
+                g_predicted.vy = 0.0f;
+                g_predicted.initialized = true;
+            }
         }
 
-        // Update predicted position
+        // Update predicted position in fixed steps, same as the server
         if (g_predicted.initialized) {
-            g_predicted.x += g_predicted.vx * (float)dt;
-            g_predicted.y += g_predicted.vy * (float)dt;
-
-            // Clamp to world bounds
-            if (g_predicted.x < proto::PLAYER_RADIUS) 
-                g_predicted.x = proto::PLAYER_RADIUS;
-            if (g_predicted.x > proto::WORLD_WIDTH - proto::PLAYER_RADIUS)
-                g_predicted.x = proto::WORLD_WIDTH - proto::PLAYER_RADIUS;
-
-            if (g_predicted.y < proto::PLAYER_RADIUS) 
-                g_predicted.y = proto::PLAYER_RADIUS;
-            if (g_predicted.y > proto::WORLD_HEIGHT - proto::PLAYER_RADIUS)
-                g_predicted.y = proto::WORLD_HEIGHT - proto::PLAYER_RADIUS;
+            int steps = g_sim_clock.advance(dt);
+            for (int i = 0; i < steps; i++) {
+                sim::step_player(g_predicted.x, g_predicted.y, g_predicted.vx, g_predicted.vy,
+                                 static_cast<float>(g_world.width), static_cast<float>(g_world.height));
+                g_sim_step++;
+            }
 
-            // Reconciliation: gently nudge towards authoritative position
+            // Reconciliation: replay unacknowledged inputs on the newest snapshot
+            reconcile();
 
-            if (g_has_snapshot) {
-                proto::worldSnapshot s;
-                {
-                    std::lock_guard<std::mutex> lock(g_snap_mutex);
-                    s = g_latest_snapshot;
-                }
-                float auth_x = s.players[g_player_idx].x;
-                float auth_y = s.players[g_player_idx].y;
-                float dx = auth_x - g_predicted.x;
-                float dy = auth_y - g_predicted.y;
-
-                const float snap_threshold = 5.0f;
-                if (dx*dx + dy*dy > snap_threshold * snap_threshold) {
-                    g_predicted.x = auth_x;
-                    g_predicted.y = auth_y;
-                }
-            }
+            float decay = std::exp(-CORRECTION_DECAY * (float)dt);
+            g_correction_x *= decay;
+            g_correction_y *= decay;
         }
 
-        // Compute render state (interpolation for remote player)
-        RenderState rs = compute_render_state();
+        // Compute render state (interpolation for remote players)
+        RenderState rs = compute_render_state(now, dt);
 
         // Render
         SDL_SetRenderDrawColor(renderer, 20, 20, 20, 255);
@@ -481,25 +673,14 @@ int main(int argc, char** argv){
                 (Uint8)((2.0-blink)*255) :
                 (Uint8)(blink*255);
 
-            SDL_Color color={255,255,255,alpha};
-            std::string waiting_text="Waiting for the other player to join...";
-
-            // render in middle
-            SDL_Surface* surf=TTF_RenderText_Solid(font,waiting_text.c_str(),{255,255,255,255});
-            if(surf){
-                SDL_Texture* tex=SDL_CreateTextureFromSurface(renderer, surf);
-
-                SDL_Rect rect;
-                rect.w=surf->w;
-                rect.h=surf->h;
-                rect.x=proto::WORLD_WIDTH/2-rect.w/2;
-                rect.y=proto::WORLD_HEIGHT/2-rect.h/2;
-
-                SDL_SetTextureAlphaMod(tex, alpha);
-                SDL_RenderCopy(renderer,tex,NULL,&rect);
-
-                SDL_FreeSurface(surf);
-                SDL_DestroyTexture(tex);
+            // rendered once, then only re-drawn with a new alpha
+            static const std::string waiting_key="waiting";
+            static const std::string waiting_text="Waiting for the other player to join...";
+            const TextRenderer::CachedText* banner=g_text.cached(waiting_key,waiting_text);
+            if(banner){
+                g_text.draw_cached(waiting_key,waiting_text,
+                                   proto::VIEW_WIDTH/2-banner->w/2,
+                                   proto::VIEW_HEIGHT/2-banner->h/2,alpha);
             }
 
             SDL_RenderPresent(renderer);
@@ -509,39 +690,44 @@ int main(int argc, char** argv){
         // gameplay draw
         if (rs.ready && g_predicted.initialized) {
 
-            // Draw local player (blue)
-            SDL_Rect local_rect;
-            local_rect.w = (int)(proto::PLAYER_RADIUS * 2.0f);
-            local_rect.h = (int)(proto::PLAYER_RADIUS * 2.0f);
-            local_rect.x = (int)(g_predicted.x - proto::PLAYER_RADIUS);
-            local_rect.y = (int)(g_predicted.y - proto::PLAYER_RADIUS);
-            SDL_SetRenderDrawColor(renderer, 50, 150, 255, 255);
-            SDL_RenderFillRect(renderer, &local_rect);
-
-            // Draw remote player (red)
-            SDL_Rect remote_rect;
-            remote_rect.w = local_rect.w;
-            remote_rect.h = local_rect.h;
-            remote_rect.x = (int)(rs.remote_x - proto::PLAYER_RADIUS);
-            remote_rect.y = (int)(rs.remote_y - proto::PLAYER_RADIUS);
-            SDL_SetRenderDrawColor(renderer, 255, 80, 80, 255);
-            SDL_RenderFillRect(renderer, &remote_rect);
-
-            // Draw coin (yellow)
-            if (rs.coin_active) {
-                SDL_Rect coin_rect;
-                coin_rect.w = (int)(proto::COIN_RADIUS * 2.0f);
-                coin_rect.h = (int)(proto::COIN_RADIUS * 2.0f);
-                coin_rect.x = (int)(rs.coin_x - proto::COIN_RADIUS);
-                coin_rect.y = (int)(rs.coin_y - proto::COIN_RADIUS);
-                SDL_SetRenderDrawColor(renderer, 240, 220, 50, 255);
-                SDL_RenderFillRect(renderer, &coin_rect);
+            // the view follows the local player around the world
+            float local_x=g_predicted.x+g_correction_x;
+            float local_y=g_predicted.y+g_correction_y;
+            float world_w=static_cast<float>(g_world.width);
+            float world_h=static_cast<float>(g_world.height);
+            float cam_x=camera_origin(local_x,proto::VIEW_WIDTH,world_w);
+            float cam_y=camera_origin(local_y,proto::VIEW_HEIGHT,world_h);
+
+            // world edge, when it is in view
+            SDL_Rect border={(int)-cam_x,(int)-cam_y,(int)world_w,(int)world_h};
+            SDL_SetRenderDrawColor(renderer,70,70,70,255);
+            SDL_RenderDrawRect(renderer,&border);
+
+            g_entities.begin(cam_x,cam_y,proto::VIEW_WIDTH,proto::VIEW_HEIGHT);
+
+            // local player (blue)
+            g_entities.add_square(local_x,local_y,proto::PLAYER_RADIUS,SDL_Color{50,150,255,255});
+
+            // remote players (red)
+            for(int i=0;i<rs.num_remote;i++){
+                g_entities.add_square(rs.remote[i].x,rs.remote[i].y,proto::PLAYER_RADIUS,
+                                      SDL_Color{255,80,80,255});
             }
-            
+
+            // coins (yellow)
+            for(const auto& c : *rs.coins){
+                g_entities.add_square(c.x,c.y,proto::COIN_RADIUS,SDL_Color{240,220,50,255});
+            }
+
+            g_entities.flush(renderer);
+
             // score
-            if(font && rs.ready){
-                std::string s="You: "+std::to_string(rs.local_score)+" Opp: "+std::to_string(rs.remote_score);
-                render_text(renderer,font,s,10,10);
+            if(rs.ready){
+                char score[64];
+                int n=std::snprintf(score,sizeof(score),"You: %d Best opp: %d",
+                                    rs.local_score,rs.best_remote_score);
+                g_text.draw_text(std::string_view(score,static_cast<size_t>(std::max(n,0))),
+                                 10,10,SDL_Color{255,255,255,255});
             }
             // play coin pickup sound when score increases
             if(rs.local_score > last_score){
@@ -552,12 +738,16 @@ int main(int argc, char** argv){
 
 
         // Detect collision distance (client-side approximation)
-        float dx = rs.remote_x - g_predicted.x;
-        float dy = rs.remote_y - g_predicted.y;
-        float dist_sq = dx*dx + dy*dy;
         float minDist = proto::PLAYER_RADIUS * 2.0f;
-
-        bool bump_now = (dist_sq < (minDist * minDist));
+        bool bump_now = false;
+        for (int i = 0; i < rs.num_remote; i++) {
+            float dx = rs.remote[i].x - g_predicted.x;
+            float dy = rs.remote[i].y - g_predicted.y;
+            if (dx*dx + dy*dy < minDist * minDist) {
+                bump_now = true;
+                break;
+            }
+        }
 
         // Play bump sound only when collision begins (not every frame)
         if(bump_now && !last_bump_state){
@@ -565,6 +755,7 @@ int main(int argc, char** argv){
         }
         last_bump_state = bump_now;
 
+        g_text.flush(); // all atlas text in one draw call
         SDL_RenderPresent(renderer);
 
         // Cap to ~60 FPS
@@ -578,6 +769,15 @@ int main(int argc, char** argv){
 
     // Cleanup
     cout << "Shutting down client.\n";
+    if (g_use_udp) {
+        uint8_t bye[proto::UDP_HEADER_SIZE];
+        {
+            std::lock_guard<std::mutex> lock(g_send_mutex);
+            proto::write_udp_header(next_udp_header(proto::PKT_DISCONNECT), bye, sizeof(bye));
+        }
+        ::send(g_sock, bye, sizeof(bye), 0);
+    }
+    g_running = false;
     ::close(g_sock);
     net_thread.join();
     if(bgm){
@@ -587,6 +787,7 @@ int main(int argc, char** argv){
     if(sfx_coin) Mix_FreeChunk(sfx_coin);
     if(sfx_bump) Mix_FreeChunk(sfx_bump);
     Mix_CloseAudio();
+    g_text.shutdown();
     if(font) TTF_CloseFont(font);
     TTF_Quit();
     SDL_DestroyRenderer(renderer);
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <SDL2/SDL.h>
+#include <vector>
+
+// one frame's worth of solid-colored entity quads, submitted with a single
+// SDL_RenderGeometry call instead of a SetRenderDrawColor/RenderFillRect
+// pair per entity. the color rides in the vertices, so every untextured
+// entity shares one batch; quads are drawn in the order they were added.
+//
+// positions are in world space. begin() sets the visible rectangle; anything
+// entirely outside it is dropped before it costs any vertices, and the rest
+// is shifted so the rectangle's corner lands at the top-left of the screen.
+struct EntityBatch{
+    float view_x=0.0f;
+    float view_y=0.0f;
+    float view_w=0.0f;
+    float view_h=0.0f;
+
+    // reused every frame; they only grow
+    std::vector<SDL_Vertex> verts;
+    std::vector<int> indices;
+
+    int drawn=0;  // quads in the current frame
+    int culled=0; // quads dropped by the viewport test
+
+    void begin(float x, float y, float w, float h){
+        view_x=x;
+        view_y=y;
+        view_w=w;
+        view_h=h;
+        verts.clear();
+        indices.clear();
+        drawn=0;
+        culled=0;
+    }
+
+    // axis-aligned square of half-size r centred on (cx,cy)
+    void add_square(float cx, float cy, float r, SDL_Color color){
+        float x0=cx-r-view_x;
+        float y0=cy-r-view_y;
+        float x1=cx+r-view_x;
+        float y1=cy+r-view_y;
+        if(x1<0.0f || y1<0.0f || x0>view_w || y0>view_h){
+            culled++;
+            return;
+        }
+
+        int base=static_cast<int>(verts.size());
+        verts.push_back(SDL_Vertex{{x0,y0},color,{0.0f,0.0f}});
+        verts.push_back(SDL_Vertex{{x1,y0},color,{0.0f,0.0f}});
+        verts.push_back(SDL_Vertex{{x1,y1},color,{0.0f,0.0f}});
+        verts.push_back(SDL_Vertex{{x0,y1},color,{0.0f,0.0f}});
+        const int quad[6]={base,base+1,base+2,base,base+2,base+3};
+        indices.insert(indices.end(),quad,quad+6);
+        drawn++;
+    }
+
+    void flush(SDL_Renderer* renderer){
+        if(!indices.empty()){
+            SDL_RenderGeometry(renderer,nullptr,verts.data(),static_cast<int>(verts.size()),
+                               indices.data(),static_cast<int>(indices.size()));
+        }
+        verts.clear();
+        indices.clear();
+    }
+};
@@ -0,0 +1,133 @@
+#pragma once
+
+#include <vector>
+#include <string_view>
+
+#include "../common/utils.hpp"
+#include "../common/protocol.hpp"
+#include "../common/snapshot_receiver.hpp"
+#include "../common/coin_field.hpp"
+#include "../common/triple_buffer.hpp"
+#include "render_state.hpp"
+#include "snapshot_ring.hpp"
+
+// what the client keeps from the server's STATE, and the RenderState it
+// draws from it. SDL-free and kept apart from client.cpp, like
+// render_state.hpp, so the benchmarks can run the client's real frame
+// handling.
+//
+// the network thread calls on_frame and on_text_state; the render loop
+// only calls render_state.
+struct ClientNetState{
+    // delta baselines for binary STATE frames, and the coin section of the
+    // last text STATE. network thread only.
+    SnapshotReceiver receiver;
+    proto::coinUpdate text_coins;
+
+    // snapshots for interpolation and reconciliation: written by the network
+    // thread, read lock-free by the render loop
+    SnapshotRing<128> ring;
+    // server clock and interpolation delay, fed from the same snapshots
+    SnapshotClock clock;
+
+    // current coin slots, patched by the coin section of each STATE. coins do
+    // not move, so they are kept outside the interpolation buffer. coin_tick
+    // is the tick each slot was last written by, so a late UDP frame never
+    // overwrites a newer one. only touched by the network thread, which
+    // publishes the active coins to the render loop through coin_list.
+    CoinField coin_field;
+    std::vector<int> coin_tick;
+    TripleBuffer<std::vector<proto::coinState>> coin_list;
+
+    // before the network thread starts; sized for every coin so no frame
+    // has to grow anything
+    void reset(int max_coins){
+        coin_field.resize(max_coins);
+        coin_tick.assign(static_cast<size_t>(max_coins),-1);
+        text_coins.coins.reserve(static_cast<size_t>(max_coins));
+        receiver.coins.coins.reserve(static_cast<size_t>(max_coins));
+        for(auto& list : coin_list.buffers) list.reserve(static_cast<size_t>(max_coins));
+    }
+
+    // store a decoded snapshot for prediction and interpolation
+    void on_snapshot(const proto::worldSnapshot& s){
+        TimedSnapshot ts;
+        ts.snap=s;
+        ts.recv_time=now_seconds();
+        clock.on_snapshot(s.server_time,ts.recv_time);
+        ring.push(ts);
+    }
+
+    // apply the coin section of the STATE for tick
+    void on_coins(int tick, const proto::coinUpdate& coins){
+        if(coins.full){
+            // anything a keyframe leaves out is not in play
+            for(int i=0;i<coin_field.count;i++){
+                if(coin_tick[i]<tick){
+                    coin_field.clear(i);
+                    coin_tick[i]=tick;
+                }
+            }
+        }
+        for(const auto& c : coins.coins){
+            if(coin_tick[c.id]>tick || (!coins.full && coin_tick[c.id]==tick)) continue;
+            coin_tick[c.id]=tick;
+            if(c.active) coin_field.set(c.id,c.x,c.y);
+            else coin_field.clear(c.id);
+        }
+
+        std::vector<proto::coinState>& list=coin_list.write_buffer();
+        list.clear();
+        for(int i=0;i<coin_field.count;i++){
+            if(!coin_field.is_active(i)) continue;
+            list.push_back(proto::coinState{i,coin_field.x[i],coin_field.y[i],true});
+        }
+        coin_list.publish();
+    }
+
+    // decode a binary STATE frame into s, rebuilding deltas on top of the
+    // acked baseline. false if it could not be decoded. fresh tells whether
+    // s is newer than every snapshot before it; late snapshots must not go
+    // into the interpolation buffer out of order.
+    bool on_frame(const uint8_t* data, size_t len, proto::worldSnapshot& s, bool& fresh){
+        if(!receiver.on_frame(data,len,s,fresh)) return false;
+        on_coins(s.tick,receiver.coins);
+        if(fresh) on_snapshot(s);
+        return true;
+    }
+
+    // the same for a text STATE line (server started with --text-state)
+    bool on_text_state(std::string_view line, proto::worldSnapshot& s){
+        if(!proto::decode_state(line,s,text_coins)) return false;
+        on_coins(s.tick,text_coins);
+        on_snapshot(s);
+        return true;
+    }
+
+    // remote players are drawn at a point on the server's clock that moves
+    // with local time, not at the newest snapshot minus a delay: snapshots can
+    // be a tick or several apart, and stepping with them would make remote
+    // movement as jerky as the send rate. the local player is drawn at
+    // (local_x, local_y), where prediction has it.
+    RenderState render_state(double now, double dt, int player_id, float local_x, float local_y){
+        RenderState rs;
+        if(player_id==0) return rs;
+
+        // only the newest snapshot and the interpolation pair are copied out
+        TimedSnapshot latest;
+        if(!ring.read_newest(latest)) return rs;
+        double target_server_time=clock.render_time(now,dt);
+        TimedSnapshot a;
+        TimedSnapshot b;
+        if(!ring.interpolation_pair(target_server_time,a,b)) return rs;
+        rs.coins=&coin_list.read();
+
+        rs.local_x=local_x;
+        rs.local_y=local_y;
+
+        interpolate_render_state(a,b,target_server_time,latest.snap,player_id,rs);
+
+        rs.ready=true;
+        return rs;
+    }
+};
@@ -0,0 +1,160 @@
+#pragma once
+
+#include <vector>
+#include <atomic>
+#include <algorithm> // std::clamp
+
+#include "../common/protocol.hpp"
+
+// what the client draws each frame, and the SDL-free interpolation that
+// produces it from the buffered snapshots. kept apart from client.cpp so the
+// benchmarks can run it without a window.
+
+struct TimedSnapshot{
+proto::worldSnapshot snap;
+    double recv_time=0.0;
+};
+
+struct RemotePlayer {
+    int id=0;
+    float x=0.0f;
+    float y=0.0f;
+    int score=0;
+};
+
+struct RenderState {
+    float local_x=0.0f;
+    float local_y=0.0f;
+    int num_remote=0;
+    RemotePlayer remote[proto::MAX_PLAYERS];
+    const std::vector<proto::coinState>* coins=nullptr; // active coins only
+    int local_score=0;
+    int best_remote_score=0;
+    bool ready=false;
+};
+
+// remote players are drawn this far behind the server's clock until
+// SnapshotClock has measured the snapshot spacing, and then somewhere
+// between INTERP_DELAY_MIN and INTERP_DELAY_MAX
+constexpr double INTERP_DELAY=0.1;
+constexpr double INTERP_DELAY_MIN=0.05;
+constexpr double INTERP_DELAY_MAX=0.5;
+
+// how fast the delay in use may follow its target, in seconds per second:
+// remote players play back at most this much slower or faster meanwhile
+constexpr double INTERP_DELAY_SLEW=0.1;
+
+// maps local time onto the server's clock and picks how far behind it to
+// draw. the server sends each client snapshots at its own, changing rate,
+// so the delay follows the spacing and the arrival jitter actually seen:
+// it has to cover one gap between snapshots plus a late arrival, or the
+// render time runs past the newest snapshot and remote players stall.
+//
+// on_snapshot runs on the network thread; the render loop only reads the
+// two atomics and owns delay.
+struct SnapshotClock{
+    std::atomic<double> offset{0.0}; // local time minus server time
+    std::atomic<double> target_delay{INTERP_DELAY};
+
+    // network thread
+    bool started=false;
+    double offset_est=0.0;
+    double last_server_time=0.0;
+    double spacing=0.0; // smoothed server time between snapshots
+    double jitter=0.0;  // smoothed lateness against offset_est
+
+    // render loop
+    double delay=INTERP_DELAY;
+
+    void on_snapshot(double server_time, double recv_time){
+        double sample=recv_time-server_time;
+        if(!started){
+            started=true;
+            offset_est=sample;
+            last_server_time=server_time;
+            offset.store(offset_est,std::memory_order_relaxed);
+            return;
+        }
+
+        // the least delayed arrival is the best guess at the offset; it
+        // creeps up slowly so a longer path or clock drift is followed
+        if(sample<offset_est) offset_est=sample;
+        else offset_est+=(sample-offset_est)*0.002;
+        jitter+=((sample-offset_est)-jitter)*0.1;
+
+        double gap=server_time-last_server_time;
+        last_server_time=server_time;
+        if(gap>0.0) spacing=(spacing==0.0) ? gap : spacing+(gap-spacing)*0.1;
+
+        offset.store(offset_est,std::memory_order_relaxed);
+        target_delay.store(std::clamp(spacing*1.5+jitter*2.0,INTERP_DELAY_MIN,INTERP_DELAY_MAX),
+                           std::memory_order_relaxed);
+    }
+
+    // server time to draw remote players at, local time now, dt seconds
+    // after the previous frame
+    double render_time(double now, double dt){
+        double target=target_delay.load(std::memory_order_relaxed);
+        double step=INTERP_DELAY_SLEW*dt;
+        delay+=std::clamp(target-delay,-step,step);
+        return now-offset.load(std::memory_order_relaxed)-delay;
+    }
+};
+
+// left (or top) edge of a view of size view that keeps focus centred,
+// clamped to a world of size world; a world smaller than the view is
+// centred in it instead
+inline float camera_origin(float focus, float view, float world){
+    if(world<=view) return (world-view)*0.5f;
+    return std::clamp(focus-view*0.5f,0.0f,world-view);
+}
+
+// fill rs with every other player interpolated between A and B (the pair
+// around target_server_time), and the scores from latest. A and B can be
+// any distance apart; t is taken from their server times.
+inline void interpolate_render_state(const TimedSnapshot& A, const TimedSnapshot& B,
+                                     double target_server_time,
+                                     const proto::worldSnapshot& latest,
+                                     int player_id, RenderState& rs){
+    double t;
+    double At=A.snap.server_time;
+    double Bt=B.snap.server_time;
+    if(At==Bt){
+        t=0.0;
+    }
+    else{
+        t=(target_server_time-At)/(Bt-At);
+        t=std::clamp(t,0.0,1.0);
+    }
+
+    auto lerp=[](float a, float b, double tt){
+        return a+(b-a)*static_cast<float>(tt);
+    };
+
+    // using linear interpolation, matching players by id. someone who
+    // only appears in B has just joined and is drawn where B has them.
+    for(int i=0;i<B.snap.num_players;i++){
+        const proto::playerState& pb=B.snap.players[i];
+        if(pb.id==player_id) continue;
+        const proto::playerState* pa=proto::find_player(A.snap,pb.id);
+
+        RemotePlayer& r=rs.remote[rs.num_remote++];
+        r.id=pb.id;
+        r.x=pa ? lerp(pa->x,pb.x,t) : pb.x;
+        r.y=pa ? lerp(pa->y,pb.y,t) : pb.y;
+    }
+
+    for(int i=0;i<latest.num_players;i++){
+        const proto::playerState& p=latest.players[i];
+        if(p.id==player_id){
+            rs.local_score=p.score;
+        }
+        else if(p.score>rs.best_remote_score){
+            rs.best_remote_score=p.score;
+        }
+    }
+    for(int i=0;i<rs.num_remote;i++){
+        const proto::playerState* p=proto::find_player(latest,rs.remote[i].id);
+        if(p) rs.remote[i].score=p->score;
+    }
+}
@@ -0,0 +1,121 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+
+#include "render_state.hpp"
+
+// the client's interpolation buffer: a fixed ring of snapshots written by
+// the network thread and read by the render thread without a lock. each
+// slot is a seqlock; the writer makes its counter odd while it copies a
+// snapshot in, and a reader retries (or gives up on that slot) if the
+// counter was odd or moved while it read. readers copy single slots, never
+// the whole buffer.
+//
+// the newest Capacity-GUARD_SLOTS snapshots are readable. the guard keeps
+// readers away from the slot the writer is about to reuse, so a search
+// only loses a race if the writer laps several snapshots during one frame.
+template<size_t Capacity>
+struct SnapshotRing{
+    static_assert((Capacity&(Capacity-1))==0,"Capacity must be a power of two");
+    static constexpr uint64_t GUARD_SLOTS=8;
+    static constexpr uint64_t READABLE=Capacity-GUARD_SLOTS;
+
+    struct Slot{
+        std::atomic<uint32_t> seq{0};
+        // copies of the payload, readable on their own for the search
+        std::atomic<uint64_t> index{0};
+        std::atomic<double> server_time{0.0};
+        TimedSnapshot ts;
+    };
+
+    Slot slots[Capacity];
+    std::atomic<uint64_t> published{0}; // snapshots pushed so far
+
+    // ---- writer (network thread) ----
+
+    void push(const TimedSnapshot& ts){
+        uint64_t n=published.load(std::memory_order_relaxed);
+        Slot& s=slots[n&(Capacity-1)];
+        uint32_t seq=s.seq.load(std::memory_order_relaxed);
+        s.seq.store(seq+1,std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        s.ts=ts;
+        s.index.store(n,std::memory_order_relaxed);
+        s.server_time.store(ts.snap.server_time,std::memory_order_relaxed);
+        s.seq.store(seq+2,std::memory_order_release);
+        published.store(n+1,std::memory_order_release);
+    }
+
+    // ---- readers ----
+
+    // [first,end) of the indices worth reading right now
+    void readable(uint64_t& first, uint64_t& end) const{
+        end=published.load(std::memory_order_acquire);
+        first=end>READABLE ? end-READABLE : 0;
+    }
+
+    // copy snapshot number index into out; false if it has been overwritten
+    bool read(uint64_t index, TimedSnapshot& out) const{
+        const Slot& s=slots[index&(Capacity-1)];
+        for(int attempt=0;attempt<64;attempt++){
+            uint32_t before=s.seq.load(std::memory_order_acquire);
+            if(before&1u) continue; // being written
+            out=s.ts;
+            uint64_t got=s.index.load(std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if(s.seq.load(std::memory_order_relaxed)!=before) continue;
+            return got==index;
+        }
+        return false;
+    }
+
+    // server_time of snapshot number index, same rules as read
+    bool read_time(uint64_t index, double& t) const{
+        const Slot& s=slots[index&(Capacity-1)];
+        for(int attempt=0;attempt<64;attempt++){
+            uint32_t before=s.seq.load(std::memory_order_acquire);
+            if(before&1u) continue;
+            t=s.server_time.load(std::memory_order_relaxed);
+            uint64_t got=s.index.load(std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if(s.seq.load(std::memory_order_relaxed)!=before) continue;
+            return got==index;
+        }
+        return false;
+    }
+
+    bool read_newest(TimedSnapshot& out) const{
+        uint64_t first,end;
+        readable(first,end);
+        return end>0 && read(end-1,out);
+    }
+
+    // the pair to interpolate at target server time: the first snapshot at
+    // or after target (b) and the one before it (a), found by binary search
+    // over server_time. with a single snapshot both are that snapshot.
+    bool interpolation_pair(double target, TimedSnapshot& a, TimedSnapshot& b) const{
+        uint64_t first,end;
+        readable(first,end);
+        if(end==0) return false;
+        if(end-first<2){
+            if(!read(end-1,a)) return false;
+            b=a;
+            return true;
+        }
+
+        // the newest snapshot is never before target, so the answer is in
+        // [first+1,end-1]
+        uint64_t lo=first+1;
+        uint64_t hi=end-1;
+        while(lo<hi){
+            uint64_t mid=lo+(hi-lo)/2;
+            double t;
+            if(!read_time(mid,t)) return false;
+            if(t>=target) hi=mid;
+            else lo=mid+1;
+        }
+        return read(lo-1,a) && read(lo,b);
+    }
+};
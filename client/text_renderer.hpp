@@ -0,0 +1,201 @@
+#pragma once
+
+#include <SDL2/SDL.h>
+#include <SDL2/SDL_ttf.h>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <unordered_map>
+
+// HUD and overlay text without per-frame texture uploads. two paths:
+//
+//   draw_text    text that changes often (scores, counters): glyphs are
+//                rasterized once into an atlas texture and a string becomes
+//                one quad per glyph. everything queued in a frame goes out
+//                in a single SDL_RenderGeometry call from flush().
+//   draw_cached  text that rarely changes (banners): the whole string is
+//                rendered to its own texture, kept under a key and only
+//                re-rendered when the string for that key changes.
+//
+// printable ASCII only; anything else is drawn as '?'.
+struct TextRenderer{
+    static constexpr int FIRST_GLYPH=32;
+    static constexpr int LAST_GLYPH=126;
+    static constexpr int ATLAS_WIDTH=512;
+    static constexpr int GLYPH_PADDING=1; // keeps filtering from bleeding
+
+    struct Glyph{
+        SDL_Rect src{0,0,0,0}; // in the atlas
+        int advance=0;
+    };
+
+    struct CachedText{
+        std::string text;
+        SDL_Texture* texture=nullptr;
+        int w=0;
+        int h=0;
+    };
+
+    SDL_Renderer* renderer=nullptr;
+    TTF_Font* font=nullptr;
+    SDL_Texture* atlas=nullptr;
+    int atlas_w=0;
+    int atlas_h=0;
+    int line_height=0;
+    Glyph glyphs[LAST_GLYPH-FIRST_GLYPH+1];
+
+    // quads queued since the last flush, reused every frame
+    std::vector<SDL_Vertex> verts;
+    std::vector<int> indices;
+
+    std::unordered_map<std::string,CachedText> cache;
+
+    // rasterize every glyph into the atlas. false leaves the renderer
+    // unusable and every draw a no-op.
+    bool init(SDL_Renderer* r, TTF_Font* f){
+        renderer=r;
+        font=f;
+        line_height=TTF_FontHeight(f);
+        const SDL_Color white={255,255,255,255};
+
+        // shelf packing: glyphs left to right, a new row when one is full
+        SDL_Surface* glyph_surfs[LAST_GLYPH-FIRST_GLYPH+1]={};
+        int x=0;
+        int y=0;
+        int row_h=0;
+        for(int c=FIRST_GLYPH;c<=LAST_GLYPH;c++){
+            Glyph& g=glyphs[c-FIRST_GLYPH];
+            int minx,maxx,miny,maxy;
+            if(TTF_GlyphMetrics(f,static_cast<Uint16>(c),&minx,&maxx,&miny,&maxy,&g.advance)<0){
+                g.advance=0;
+            }
+            SDL_Surface* s=TTF_RenderGlyph_Blended(f,static_cast<Uint16>(c),white);
+            glyph_surfs[c-FIRST_GLYPH]=s;
+            if(!s) continue;
+            if(x+s->w+GLYPH_PADDING>ATLAS_WIDTH){
+                x=0;
+                y+=row_h+GLYPH_PADDING;
+                row_h=0;
+            }
+            g.src={x,y,s->w,s->h};
+            x+=s->w+GLYPH_PADDING;
+            if(s->h>row_h) row_h=s->h;
+        }
+        atlas_w=ATLAS_WIDTH;
+        atlas_h=y+row_h;
+
+        bool ok=false;
+        SDL_Surface* sheet=SDL_CreateRGBSurfaceWithFormat(0,atlas_w,atlas_h,32,SDL_PIXELFORMAT_RGBA32);
+        if(sheet){
+            SDL_FillRect(sheet,nullptr,0); // transparent
+            for(int c=FIRST_GLYPH;c<=LAST_GLYPH;c++){
+                SDL_Surface* s=glyph_surfs[c-FIRST_GLYPH];
+                if(!s) continue;
+                SDL_Rect dst=glyphs[c-FIRST_GLYPH].src;
+                SDL_SetSurfaceBlendMode(s,SDL_BLENDMODE_NONE); // copy alpha as is
+                SDL_BlitSurface(s,nullptr,sheet,&dst);
+            }
+            atlas=SDL_CreateTextureFromSurface(renderer,sheet);
+            if(atlas){
+                SDL_SetTextureBlendMode(atlas,SDL_BLENDMODE_BLEND);
+                ok=true;
+            }
+            SDL_FreeSurface(sheet);
+        }
+        for(SDL_Surface* s : glyph_surfs){
+            if(s) SDL_FreeSurface(s);
+        }
+        return ok;
+    }
+
+    const Glyph& glyph(char c) const{
+        int i=static_cast<unsigned char>(c);
+        if(i<FIRST_GLYPH || i>LAST_GLYPH) i='?';
+        return glyphs[i-FIRST_GLYPH];
+    }
+
+    // width in pixels of text drawn with draw_text
+    int measure(std::string_view text) const{
+        int w=0;
+        for(char c : text) w+=glyph(c).advance;
+        return w;
+    }
+
+    // queue text with its top-left corner at (x,y); nothing is drawn until flush
+    void draw_text(std::string_view text, int x, int y, SDL_Color color){
+        if(!atlas) return;
+        float pen=static_cast<float>(x);
+        const float top=static_cast<float>(y);
+        const float inv_w=1.0f/static_cast<float>(atlas_w);
+        const float inv_h=1.0f/static_cast<float>(atlas_h);
+        for(char c : text){
+            const Glyph& g=glyph(c);
+            if(c!=' ' && g.src.w>0){
+                float u0=static_cast<float>(g.src.x)*inv_w;
+                float v0=static_cast<float>(g.src.y)*inv_h;
+                float u1=static_cast<float>(g.src.x+g.src.w)*inv_w;
+                float v1=static_cast<float>(g.src.y+g.src.h)*inv_h;
+                float x1=pen+static_cast<float>(g.src.w);
+                float y1=top+static_cast<float>(g.src.h);
+
+                int base=static_cast<int>(verts.size());
+                verts.push_back(SDL_Vertex{{pen,top},color,{u0,v0}});
+                verts.push_back(SDL_Vertex{{x1,top},color,{u1,v0}});
+                verts.push_back(SDL_Vertex{{x1,y1},color,{u1,v1}});
+                verts.push_back(SDL_Vertex{{pen,y1},color,{u0,v1}});
+                const int quad[6]={base,base+1,base+2,base,base+2,base+3};
+                indices.insert(indices.end(),quad,quad+6);
+            }
+            pen+=static_cast<float>(g.advance);
+        }
+    }
+
+    // draw everything queued by draw_text this frame in one call
+    void flush(){
+        if(atlas && !indices.empty()){
+            SDL_RenderGeometry(renderer,atlas,verts.data(),static_cast<int>(verts.size()),
+                               indices.data(),static_cast<int>(indices.size()));
+        }
+        verts.clear();
+        indices.clear();
+    }
+
+    // the texture for key, re-rendered only if its text changed. nullptr if
+    // it cannot be rendered.
+    const CachedText* cached(const std::string& key, const std::string& text){
+        if(!font) return nullptr;
+        CachedText& entry=cache[key];
+        if(entry.texture && entry.text==text) return &entry;
+
+        if(entry.texture) SDL_DestroyTexture(entry.texture);
+        entry.texture=nullptr;
+        entry.text=text;
+        SDL_Surface* surf=TTF_RenderText_Blended(font,text.c_str(),SDL_Color{255,255,255,255});
+        if(!surf) return nullptr;
+        entry.texture=SDL_CreateTextureFromSurface(renderer,surf);
+        entry.w=surf->w;
+        entry.h=surf->h;
+        SDL_FreeSurface(surf);
+        if(!entry.texture) return nullptr;
+        SDL_SetTextureBlendMode(entry.texture,SDL_BLENDMODE_BLEND);
+        return &entry;
+    }
+
+    // draw the cached texture for key at (x,y)
+    void draw_cached(const std::string& key, const std::string& text, int x, int y, Uint8 alpha=255){
+        const CachedText* entry=cached(key,text);
+        if(!entry) return;
+        SDL_Rect rect={x,y,entry->w,entry->h};
+        SDL_SetTextureAlphaMod(entry->texture,alpha);
+        SDL_RenderCopy(renderer,entry->texture,nullptr,&rect);
+    }
+
+    void shutdown(){
+        for(auto& kv : cache){
+            if(kv.second.texture) SDL_DestroyTexture(kv.second.texture);
+        }
+        cache.clear();
+        if(atlas) SDL_DestroyTexture(atlas);
+        atlas=nullptr;
+    }
+};
@@ -0,0 +1,153 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define COIN_KERNEL_X86 1
+#include <immintrin.h>
+#endif
+
+// structure-of-arrays coin storage, shared by the server simulation and
+// the client's copy of the coin field.
+//
+// x/y are padded to a multiple of COIN_LANES with far-away positions so the
+// SIMD kernels never need a scalar tail; the active set is a bitmask with
+// one bit per slot.
+constexpr int COIN_LANES=8;
+constexpr float COIN_FAR_AWAY=-1.0e9f;
+
+struct CoinField{
+    int count=0;
+    std::vector<float> x;
+    std::vector<float> y;
+    std::vector<uint64_t> active;
+
+    void resize(int n){
+        count=n;
+        size_t padded=static_cast<size_t>((n+COIN_LANES-1)/COIN_LANES*COIN_LANES);
+        x.assign(padded,COIN_FAR_AWAY);
+        y.assign(padded,COIN_FAR_AWAY);
+        active.assign((padded+63)/64,0);
+    }
+
+    bool is_active(int i) const{
+        return (active[i>>6]>>(i&63))&1u;
+    }
+
+    void set(int i, float cx, float cy){
+        x[i]=cx;
+        y[i]=cy;
+        active[i>>6]|=uint64_t(1)<<(i&63);
+    }
+
+    void clear(int i){
+        active[i>>6]&=~(uint64_t(1)<<(i&63));
+    }
+
+    void clear_all(){
+        for(auto& w : active) w=0;
+    }
+
+    int active_count() const{
+        int n=0;
+        for(auto w : active) n+=__builtin_popcountll(w);
+        return n;
+    }
+};
+
+// ---- player-vs-coin pickup kernels ----
+
+// write the indices of active coins within sqrt(r_sq) of (px,py) to out,
+// in ascending order, stopping at max_out. returns how many were written.
+// n must be padded to a multiple of COIN_LANES (CoinField does this).
+typedef int (*CoinPickupKernel)(const float* xs, const float* ys, const uint64_t* active,
+                                int n, float px, float py, float r_sq,
+                                int* out, int max_out);
+
+inline int coin_pickup_scalar(const float* xs, const float* ys, const uint64_t* active,
+                              int n, float px, float py, float r_sq,
+                              int* out, int max_out){
+    int found=0;
+    for(int i=0;i<n && found<max_out;i++){
+        if(!((active[i>>6]>>(i&63))&1u)) continue;
+        float dx=xs[i]-px;
+        float dy=ys[i]-py;
+        if(dx*dx+dy*dy<=r_sq) out[found++]=i;
+    }
+    return found;
+}
+
+#ifdef COIN_KERNEL_X86
+
+// append lanes set in hits (already masked by active) as indices base+lane
+inline int emit_hits(unsigned hits, int base, int* out, int found, int max_out){
+    while(hits && found<max_out){
+        out[found++]=base+__builtin_ctz(hits);
+        hits&=hits-1;
+    }
+    return found;
+}
+
+// 4 coins per step; SSE2 is part of the x86-64 baseline
+inline int coin_pickup_sse2(const float* xs, const float* ys, const uint64_t* active,
+                            int n, float px, float py, float r_sq,
+                            int* out, int max_out){
+    const __m128 vpx=_mm_set1_ps(px);
+    const __m128 vpy=_mm_set1_ps(py);
+    const __m128 vr=_mm_set1_ps(r_sq);
+    int found=0;
+    for(int i=0;i<n && found<max_out;i+=4){
+        unsigned live=static_cast<unsigned>((active[i>>6]>>(i&63))&0xFu);
+        if(!live) continue;
+        __m128 dx=_mm_sub_ps(_mm_loadu_ps(xs+i),vpx);
+        __m128 dy=_mm_sub_ps(_mm_loadu_ps(ys+i),vpy);
+        __m128 d2=_mm_add_ps(_mm_mul_ps(dx,dx),_mm_mul_ps(dy,dy));
+        unsigned hits=static_cast<unsigned>(_mm_movemask_ps(_mm_cmple_ps(d2,vr)))&live;
+        found=emit_hits(hits,i,out,found,max_out);
+    }
+    return found;
+}
+
+// 8 coins per step; only called after a runtime AVX2 check
+__attribute__((target("avx2")))
+inline int coin_pickup_avx2(const float* xs, const float* ys, const uint64_t* active,
+                            int n, float px, float py, float r_sq,
+                            int* out, int max_out){
+    const __m256 vpx=_mm256_set1_ps(px);
+    const __m256 vpy=_mm256_set1_ps(py);
+    const __m256 vr=_mm256_set1_ps(r_sq);
+    int found=0;
+    for(int i=0;i<n && found<max_out;i+=8){
+        unsigned live=static_cast<unsigned>((active[i>>6]>>(i&63))&0xFFu);
+        if(!live) continue;
+        __m256 dx=_mm256_sub_ps(_mm256_loadu_ps(xs+i),vpx);
+        __m256 dy=_mm256_sub_ps(_mm256_loadu_ps(ys+i),vpy);
+        __m256 d2=_mm256_add_ps(_mm256_mul_ps(dx,dx),_mm256_mul_ps(dy,dy));
+        unsigned hits=static_cast<unsigned>(_mm256_movemask_ps(_mm256_cmp_ps(d2,vr,_CMP_LE_OQ)))&live;
+        found=emit_hits(hits,i,out,found,max_out);
+    }
+    return found;
+}
+
+#endif
+
+// best kernel for the CPU we are running on
+inline CoinPickupKernel select_coin_kernel(){
+#ifdef COIN_KERNEL_X86
+    if(__builtin_cpu_supports("avx2")) return coin_pickup_avx2;
+    return coin_pickup_sse2;
+#else
+    return coin_pickup_scalar;
+#endif
+}
+
+inline const char* coin_kernel_name(CoinPickupKernel k){
+#ifdef COIN_KERNEL_X86
+    if(k==coin_pickup_avx2) return "avx2";
+    if(k==coin_pickup_sse2) return "sse2";
+#endif
+    (void)k;
+    return "scalar";
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+
+// HDR-style latency histogram: log-linear buckets with 64 linear steps per
+// power of two, so any recorded value is kept to within 1/64 (~1.6%) of
+// itself from 1 ns up to about a minute. recording is one relaxed atomic
+// add, so tick workers can record into a shared histogram while another
+// thread reads it.
+struct LatencyHistogram{
+    static constexpr int SUB_BITS=6;
+    static constexpr int SUB_COUNT=1<<SUB_BITS;           // 64 steps per octave
+    static constexpr int MAX_SHIFT=30;                    // values up to ~2^36 ns
+    static constexpr int BUCKETS=2*SUB_COUNT+MAX_SHIFT*SUB_COUNT;
+
+    std::atomic<uint64_t> counts[BUCKETS]={};
+    std::atomic<uint64_t> total{0};
+    std::atomic<uint64_t> sum_ns{0};
+    std::atomic<uint64_t> max_ns{0};
+
+    static int bucket_of(uint64_t v){
+        if(v<2*SUB_COUNT) return static_cast<int>(v);
+        int msb=63-__builtin_clzll(v);
+        int shift=msb-SUB_BITS;
+        if(shift>MAX_SHIFT) return BUCKETS-1;
+        return 2*SUB_COUNT+(shift-1)*SUB_COUNT+static_cast<int>((v>>shift)-SUB_COUNT);
+    }
+
+    // largest value that lands in bucket b
+    static uint64_t bucket_top(int b){
+        if(b<2*SUB_COUNT) return static_cast<uint64_t>(b);
+        int shift=(b-2*SUB_COUNT)/SUB_COUNT+1;
+        uint64_t sub=static_cast<uint64_t>((b-2*SUB_COUNT)%SUB_COUNT+SUB_COUNT);
+        return ((sub+1)<<shift)-1;
+    }
+
+    void record(uint64_t ns){
+        counts[bucket_of(ns)].fetch_add(1,std::memory_order_relaxed);
+        total.fetch_add(1,std::memory_order_relaxed);
+        sum_ns.fetch_add(ns,std::memory_order_relaxed);
+        uint64_t seen=max_ns.load(std::memory_order_relaxed);
+        while(ns>seen && !max_ns.compare_exchange_weak(seen,ns,std::memory_order_relaxed)){}
+    }
+
+    // value at quantile q (0..1), from the bucket tops. concurrent records
+    // may be half counted, which only moves the answer by a bucket.
+    uint64_t percentile(double q) const{
+        uint64_t n=total.load(std::memory_order_relaxed);
+        if(n==0) return 0;
+        uint64_t want=static_cast<uint64_t>(q*static_cast<double>(n)+0.5);
+        if(want<1) want=1;
+        uint64_t seen=0;
+        for(int b=0;b<BUCKETS;b++){
+            seen+=counts[b].load(std::memory_order_relaxed);
+            if(seen>=want){
+                uint64_t top=bucket_top(b);
+                uint64_t mx=max_ns.load(std::memory_order_relaxed);
+                return top<mx ? top : mx;
+            }
+        }
+        return max_ns.load(std::memory_order_relaxed);
+    }
+
+    double mean() const{
+        uint64_t n=total.load(std::memory_order_relaxed);
+        return n ? static_cast<double>(sum_ns.load(std::memory_order_relaxed))/static_cast<double>(n) : 0.0;
+    }
+
+    void reset(){
+        for(auto& c : counts) c.store(0,std::memory_order_relaxed);
+        total=0;
+        sum_ns=0;
+        max_ns=0;
+    }
+};
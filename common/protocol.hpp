@@ -3,29 +3,52 @@
 #include <string>
 #include <sstream>
 #include <iomanip>
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <vector>
+#include <charconv>
+#include <string_view>
+#include <initializer_list>
 
 namespace proto{
 
 // ---- general game network settings ---- 
 
-// port server listens on and clients connect to
+// port server listens on and clients connect to, unless given --port
 constexpr int SERVER_PORT=40000;
 
-// num of simulation steps per second the server runs
-constexpr int TICK_RATE=30;
+// num of simulation steps per second the server runs (and the client
+// predicts at). snapshots go out at a lower rate, see SEND_RATE_*
+constexpr int TICK_RATE=60;
 
-// simulated one way network latency
-constexpr double SIMULATED_LATENCY=0.2;
+// snapshots per second a client is sent: the server starts every client at
+// SEND_RATE_DEFAULT and moves it between its --min-send-rate and
+// --send-rate (at most TICK_RATE) as the client's RTT and send queue allow
+constexpr int SEND_RATE_DEFAULT=30;
+constexpr int SEND_RATE_MIN=10;
 
-// world size
+// default world size (the server's --world changes it per run); the
+// client's window shows VIEW_WIDTH x VIEW_HEIGHT of it, so by default the
+// whole world is in view
 constexpr float WORLD_WIDTH=800.0f;
 constexpr float WORLD_HEIGHT=600.0f;
+constexpr float VIEW_WIDTH=800.0f;
+constexpr float VIEW_HEIGHT=600.0f;
+constexpr int MAX_WORLD_SIZE=16384; // either side, in pixels
 
 constexpr float PLAYER_SPEED=300.0f;
 
 constexpr float PLAYER_RADIUS=15.0f;
 constexpr float COIN_RADIUS=10.0f;
 
+// player slots a server can be configured for (--players); ids are 1..MAX_PLAYERS
+constexpr int MAX_PLAYERS=64;
+constexpr int DEFAULT_PLAYERS=2;
+
+// coin slots a server can be configured for (--coins); ids are 0..MAX_COINS-1
+constexpr int MAX_COINS=4096;
+
 // structs
 
 struct playerState{
@@ -33,64 +56,867 @@ struct playerState{
     float x=0.0f;
     float y=0.0f;
     int score=0;
+    // newest INPUT seq the server has applied for this player (-1: none yet)
+    // and the tick it was applied on; the owning client replays from there
+    int input_seq=-1;
+    int input_tick=0;
 };
 
 struct worldSnapshot{
     int tick=0;
     double server_time=0.0;
 
-    playerState players[2]; // supporting 2 players only for now
+    // connected players, sorted by id
+    int num_players=0;
+    playerState players[MAX_PLAYERS];
+};
 
-    float coin_x=0.0f;
-    float coin_y=0.0f;
-    bool coin_active=false;
+// one coin slot, sent when it spawns or is collected
+struct coinState{
+    int id=0;
+    float x=0.0f;
+    float y=0.0f;
+    bool active=false;
 };
 
+// coin slots carried alongside one snapshot. coins do not move, so they are
+// not part of worldSnapshot (which is interpolated and kept in history):
+// keyframes and text STATE carry every active coin with full=true, deltas
+// only the slots that spawned or were collected since the baseline.
+// the vector is reused between messages, so steady state does not allocate.
+struct coinUpdate{
+    bool full=false;
+    std::vector<coinState> coins;
+};
+
+// what a client learns about its room when it joins: the world size, and
+// the interest radius if the server only sends what is near the player
+// (0: everything). sent in WELCOME and ACCEPT.
+struct WorldInfo{
+    int width=static_cast<int>(WORLD_WIDTH);
+    int height=static_cast<int>(WORLD_HEIGHT);
+    int interest=0;
+};
+
+// player with the given id in s, or nullptr if they are not in it
+inline const playerState* find_player(const worldSnapshot& s, int id){
+    for(int i=0;i<s.num_players;i++){
+        if(s.players[i].id==id) return &s.players[i];
+    }
+    return nullptr;
+}
+
 // encoder and decoder for state space
 
 // Text format (single line, space-separated):
-// STATE <tick>
-//       <p1x> <p1y> <p1score>
-//       <p2x> <p2y> <p2score>
-//       <coinx> <coiny> <coin_active>
+// STATE <tick> <num_players>
+//       <id> <x> <y> <score> <input_seq> <input_tick>   (num_players times)
+//       <num_coins>
+//       <id> <x> <y>              (num_coins times, active coins only)
 //       <server_time>
 //
 // Example:
-// STATE 42 100 200 1 300 200 0 150 150 1 12345.678900
+// STATE 42 2 1 100 200 1 7 40 2 300 200 0 -1 0 1 0 150 150 12345.678900
+
+namespace detail{
+
+// bounded text writer over a caller-supplied buffer, the text counterpart
+// of ByteWriter. numbers go through to_chars: floats as %g with 6
+// significant digits, which is what an ostream writes by default
+struct TextWriter{
+    char* p;
+    char* end;
+    bool ok=true;
+
+    TextWriter(char* buf, size_t cap):p(buf),end(buf+cap){}
+
+    void ch(char c){
+        if(end-p<1){ ok=false; return; }
+        *p++=c;
+    }
+    void str(std::string_view v){
+        if(static_cast<size_t>(end-p)<v.size()){ ok=false; return; }
+        std::memcpy(p,v.data(),v.size());
+        p+=v.size();
+    }
+    template<typename T>
+    void num(T v){
+        auto res=std::to_chars(p,end,v);
+        if(res.ec!=std::errc()){ ok=false; return; }
+        p=res.ptr;
+    }
+    void num(float v){
+        auto res=std::to_chars(p,end,v,std::chars_format::general,6);
+        if(res.ec!=std::errc()){ ok=false; return; }
+        p=res.ptr;
+    }
+    void fixed(double v, int precision){
+        auto res=std::to_chars(p,end,v,std::chars_format::fixed,precision);
+        if(res.ec!=std::errc()){ ok=false; return; }
+        p=res.ptr;
+    }
+};
+
+} // namespace detail
+
+// longest text STATE for s and coins, for sizing a buffer: an int takes at
+// most 11 characters, a %g float 13 and the server time 24
+inline size_t text_state_bound(const worldSnapshot& s, const coinUpdate& coins){
+    return 6+2*12+static_cast<size_t>(s.num_players)*(4*12+2*14)+
+           12+coins.coins.size()*(12+2*14)+24;
+}
+
+// text STATE into buf, without the trailing newline; returns the length,
+// or 0 if it does not fit in cap (text_state_bound always does)
+inline size_t encode_state(const worldSnapshot& s, const coinUpdate& coins, char* buf, size_t cap){
+    detail::TextWriter w(buf,cap);
+    w.str("STATE ");
+    w.num(s.tick);
+    w.ch(' ');
+    w.num(s.num_players);
+    w.ch(' ');
+    for(int i=0;i<s.num_players;i++){
+        const playerState& p=s.players[i];
+        w.num(p.id); w.ch(' ');
+        w.num(p.x); w.ch(' ');
+        w.num(p.y); w.ch(' ');
+        w.num(p.score); w.ch(' ');
+        w.num(p.input_seq); w.ch(' ');
+        w.num(p.input_tick); w.ch(' ');
+    }
+    int active=0;
+    for(const auto& c : coins.coins){
+        if(c.active) active++;
+    }
+    w.num(active);
+    w.ch(' ');
+    for(const auto& c : coins.coins){
+        if(!c.active) continue;
+        w.num(c.id); w.ch(' ');
+        w.num(c.x); w.ch(' ');
+        w.num(c.y); w.ch(' ');
+    }
+    w.fixed(s.server_time,6);
+    return w.ok ? static_cast<size_t>(w.p-buf) : 0;
+}
+
+inline std::string encode_state(const worldSnapshot& s, const coinUpdate& coins){
+    std::string line(text_state_bound(s,coins),'\0');
+    line.resize(encode_state(s,coins,&line[0],line.size()));
+    return line;
+}
+
+// "<verb> <field> <field>...\n" into buf, for the short lines a client
+// sends (INPUT, ACK) without building a string per line. returns the
+// length, or 0 if it does not fit in cap.
+inline size_t format_line(char* buf, size_t cap, std::string_view verb,
+                          std::initializer_list<int> fields){
+    detail::TextWriter w(buf,cap);
+    w.str(verb);
+    for(int f : fields){
+        w.ch(' ');
+        w.num(f);
+    }
+    w.ch('\n');
+    return w.ok ? static_cast<size_t>(w.p-buf) : 0;
+}
+
+// space-separated fields of a text line, parsed in place with from_chars:
+//
+//   proto::FieldReader f(line);
+//   int seq,dx,dy;
+//   if(f.skip() && f.read(seq) && f.read(dx) && f.read(dy)) ...
+struct FieldReader{
+    std::string_view rest;
+
+    explicit FieldReader(std::string_view line) : rest(line){}
+
+    // next field as raw text; empty once the line is used up
+    std::string_view word(){
+        size_t start=rest.find_first_not_of(' ');
+        if(start==std::string_view::npos){
+            rest=std::string_view();
+            return rest;
+        }
+        rest.remove_prefix(start);
+        size_t end=rest.find(' ');
+        if(end==std::string_view::npos) end=rest.size();
+        std::string_view w=rest.substr(0,end);
+        rest.remove_prefix(end);
+        return w;
+    }
+
+    bool skip(){ return !word().empty(); }
+
+    // the whole field has to parse, like operator>> on a lone token would
+    template<typename T>
+    bool read(T& value){
+        std::string_view w=word();
+        if(w.empty()) return false;
+        const char* end=w.data()+w.size();
+        auto res=std::from_chars(w.data(),end,value);
+        return res.ec==std::errc() && res.ptr==end;
+    }
+};
+
+// parser for state; text STATE always carries the full coin set
+inline bool decode_state(std::string_view line, worldSnapshot& out, coinUpdate& coins){
+    FieldReader f(line);
+    if(f.word()!="STATE") return false;
+
+    if(!(f.read(out.tick) && f.read(out.num_players))) return false;
+    if(out.num_players<0 || out.num_players>MAX_PLAYERS) return false;
+
+    for(int i=0;i<out.num_players;i++){
+        playerState& p=out.players[i];
+        if(!(f.read(p.id) && f.read(p.x) && f.read(p.y) && f.read(p.score) &&
+             f.read(p.input_seq) && f.read(p.input_tick))) return false;
+    }
+
+    int num_coins=0;
+    if(!f.read(num_coins) || num_coins<0 || num_coins>MAX_COINS) return false;
+    coins.full=true;
+    coins.coins.clear();
+    for(int i=0;i<num_coins;i++){
+        coinState c;
+        if(!(f.read(c.id) && f.read(c.x) && f.read(c.y))) return false;
+        if(c.id<0 || c.id>=MAX_COINS) return false;
+        c.active=true;
+        coins.coins.push_back(c);
+    }
+
+    return f.read(out.server_time);
+}
+
+// ---- binary snapshot format ----
+
+// Every binary frame starts with a fixed header, all fields little-endian:
+//   u8  BIN_MAGIC   (never the first byte of a text line, so both formats
+//                    can share one stream)
+//   u8  BIN_VERSION
+//   u16 payload length in bytes
+//
+// STATE payload (keyframe):
+//   u8  FRAME_STATE
+//   i32 tick
+//   f64 server_time
+//   u8  num_players, num_players x player record
+//   coin section (every active coin)
+//
+// STATE_DELTA payload, relative to a snapshot the client acknowledged.
+// players are matched by id; players that did not change are omitted:
+//   u8  FRAME_STATE_DELTA
+//   i32 tick
+//   u8  tick - base_tick (always < SNAPSHOT_HISTORY)
+//   f64 server_time
+//   u8  left count,    left count x { u8 id }
+//   u8  joined count,  joined count x player record
+//   u8  changed count, changed count x { u8 id, u8 mask (DELTA_PLAYER_*),
+//                                        changed fields }
+//   coin section (slots that spawned or were collected since base_tick)
+//
+// player record:
+//   u8 id, f32 x, f32 y, i32 score, i32 input_seq, i32 input_tick
+//
+// coin section:
+//   u16 count, count x { u16 id, u8 active, f32 x, f32 y (only if active) }
+//
+// with an interest radius (see WorldInfo) each client's snapshots hold only
+// the players and coins near it. the delta sections then double as enter
+// and leave events: a player coming into range is in "joined", one going
+// out of range in "left", and a coin going out of range is sent inactive
+// just like a collected one.
+
+constexpr uint8_t BIN_MAGIC=0xB5;
+constexpr uint8_t BIN_VERSION=4;
+constexpr size_t BIN_HEADER_SIZE=4;
+
+constexpr uint8_t FRAME_STATE=1;
+constexpr uint8_t FRAME_STATE_DELTA=2;
+
+constexpr uint8_t DELTA_PLAYER_X=1<<0;
+constexpr uint8_t DELTA_PLAYER_Y=1<<1;
+constexpr uint8_t DELTA_PLAYER_SCORE=1<<2;
+constexpr uint8_t DELTA_PLAYER_INPUT=1<<3; // input_seq and input_tick
+
+// how many sent snapshots either side remembers for delta baselines: one
+// second of ticks, so an ack delayed by up to a second of RTT still gets
+// a delta. anything older gets a full keyframe instead. a delta carries
+// its baseline as a u8 offset below this, hence the cap
+constexpr int SNAPSHOT_HISTORY=TICK_RATE;
+static_assert(SNAPSHOT_HISTORY>=2 && SNAPSHOT_HISTORY<=256,"delta baseline offset is a u8");
+
+constexpr size_t PLAYER_RECORD_SIZE=1+4+4+4+4+4;
+constexpr size_t COIN_RECORD_SIZE=2+1+4+4;
+constexpr size_t COIN_SECTION_MAX_SIZE=2+MAX_COINS*COIN_RECORD_SIZE;
+
+constexpr size_t STATE_MAX_PAYLOAD_SIZE=1+4+8+1+MAX_PLAYERS*PLAYER_RECORD_SIZE+COIN_SECTION_MAX_SIZE;
+// worst case: every baseline player left and a full set joined
+constexpr size_t STATE_DELTA_MAX_PAYLOAD_SIZE=1+4+1+8
+    +(1+MAX_PLAYERS)+(1+MAX_PLAYERS*PLAYER_RECORD_SIZE)+1+COIN_SECTION_MAX_SIZE;
+constexpr size_t MAX_FRAME_SIZE=BIN_HEADER_SIZE+
+    (STATE_MAX_PAYLOAD_SIZE>STATE_DELTA_MAX_PAYLOAD_SIZE ? STATE_MAX_PAYLOAD_SIZE : STATE_DELTA_MAX_PAYLOAD_SIZE);
+
+// which encoding the server uses for STATE; text is kept for debugging
+enum class StateFormat{
+    Text,
+    Binary
+};
+
+namespace detail{
+
+// bounded little-endian writer over a caller-supplied buffer
+struct ByteWriter{
+    uint8_t* p;
+    uint8_t* end;
+    bool ok=true;
+
+    ByteWriter(uint8_t* buf, size_t cap):p(buf),end(buf+cap){}
+
+    void u8(uint8_t v){
+        if(end-p<1){ ok=false; return; }
+        *p++=v;
+    }
+    void u16(uint16_t v){
+        if(end-p<2){ ok=false; return; }
+        p[0]=static_cast<uint8_t>(v);
+        p[1]=static_cast<uint8_t>(v>>8);
+        p+=2;
+    }
+    void u32(uint32_t v){
+        if(end-p<4){ ok=false; return; }
+        for(int i=0;i<4;i++) p[i]=static_cast<uint8_t>(v>>(8*i));
+        p+=4;
+    }
+    void u64(uint64_t v){
+        if(end-p<8){ ok=false; return; }
+        for(int i=0;i<8;i++) p[i]=static_cast<uint8_t>(v>>(8*i));
+        p+=8;
+    }
+    void i32(int32_t v){ u32(static_cast<uint32_t>(v)); }
+    void f32(float v){
+        uint32_t bits;
+        std::memcpy(&bits,&v,sizeof(bits));
+        u32(bits);
+    }
+    void f64(double v){
+        uint64_t bits;
+        std::memcpy(&bits,&v,sizeof(bits));
+        u64(bits);
+    }
+};
+
+// bounded little-endian reader; any overrun clears ok
+struct ByteReader{
+    const uint8_t* p;
+    const uint8_t* end;
+    bool ok=true;
+
+    ByteReader(const uint8_t* data, size_t len):p(data),end(data+len){}
+
+    uint8_t u8(){
+        if(end-p<1){ ok=false; return 0; }
+        return *p++;
+    }
+    uint16_t u16(){
+        if(end-p<2){ ok=false; return 0; }
+        uint16_t v=static_cast<uint16_t>(p[0]|(p[1]<<8));
+        p+=2;
+        return v;
+    }
+    uint32_t u32(){
+        if(end-p<4){ ok=false; return 0; }
+        uint32_t v=0;
+        for(int i=0;i<4;i++) v|=static_cast<uint32_t>(p[i])<<(8*i);
+        p+=4;
+        return v;
+    }
+    uint64_t u64(){
+        if(end-p<8){ ok=false; return 0; }
+        uint64_t v=0;
+        for(int i=0;i<8;i++) v|=static_cast<uint64_t>(p[i])<<(8*i);
+        p+=8;
+        return v;
+    }
+    int32_t i32(){ return static_cast<int32_t>(u32()); }
+    float f32(){
+        uint32_t bits=u32();
+        float v;
+        std::memcpy(&v,&bits,sizeof(v));
+        return v;
+    }
+    double f64(){
+        uint64_t bits=u64();
+        double v;
+        std::memcpy(&v,&bits,sizeof(v));
+        return v;
+    }
+};
+
+inline void begin_frame(ByteWriter& w){
+    w.u8(BIN_MAGIC);
+    w.u8(BIN_VERSION);
+    w.u16(0); // payload length, patched by finish_frame
+}
+
+inline size_t finish_frame(ByteWriter& w, uint8_t* buf){
+    if(!w.ok) return 0;
+    size_t total=static_cast<size_t>(w.p-buf);
+    size_t payload=total-BIN_HEADER_SIZE;
+    buf[2]=static_cast<uint8_t>(payload);
+    buf[3]=static_cast<uint8_t>(payload>>8);
+    return total;
+}
+
+} // namespace detail
+
+namespace detail{
+
+inline void write_player(ByteWriter& w, const playerState& p){
+    w.u8(static_cast<uint8_t>(p.id));
+    w.f32(p.x);
+    w.f32(p.y);
+    w.i32(p.score);
+    w.i32(p.input_seq);
+    w.i32(p.input_tick);
+}
+
+inline void read_player(ByteReader& r, playerState& p){
+    p.id=r.u8();
+    p.x=r.f32();
+    p.y=r.f32();
+    p.score=r.i32();
+    p.input_seq=r.i32();
+    p.input_tick=r.i32();
+}
+
+inline void write_coins(ByteWriter& w, const coinUpdate& coins){
+    w.u16(static_cast<uint16_t>(coins.coins.size()));
+    for(const auto& c : coins.coins){
+        w.u16(static_cast<uint16_t>(c.id));
+        w.u8(c.active ? 1 : 0);
+        if(c.active){
+            w.f32(c.x);
+            w.f32(c.y);
+        }
+    }
+}
+
+inline bool read_coins(ByteReader& r, coinUpdate& coins){
+    int count=r.u16();
+    if(count>MAX_COINS) return false;
+    coins.coins.clear();
+    for(int i=0;i<count && r.ok;i++){
+        coinState c;
+        c.id=r.u16();
+        c.active=(r.u8()!=0);
+        if(c.active){
+            c.x=r.f32();
+            c.y=r.f32();
+        }
+        if(c.id>=MAX_COINS) return false;
+        coins.coins.push_back(c);
+    }
+    return r.ok;
+}
+
+// index of each player id in s (255 = absent)
+inline void index_players(const worldSnapshot& s, uint8_t (&index)[256]){
+    std::memset(index,0xFF,sizeof(index));
+    for(int i=0;i<s.num_players;i++){
+        index[static_cast<uint8_t>(s.players[i].id)]=static_cast<uint8_t>(i);
+    }
+}
+
+} // namespace detail
+
+// encode a snapshot as one binary keyframe into buf. coins must hold every
+// active coin. returns the frame size, or 0 if cap is too small.
+// never allocates.
+inline size_t encode_state_binary(const worldSnapshot& s, const coinUpdate& coins,
+                                  uint8_t* buf, size_t cap){
+    detail::ByteWriter w(buf,cap);
+    detail::begin_frame(w);
+
+    w.u8(FRAME_STATE);
+    w.i32(s.tick);
+    w.f64(s.server_time);
+    w.u8(static_cast<uint8_t>(s.num_players));
+    for(int i=0;i<s.num_players;i++){
+        detail::write_player(w,s.players[i]);
+    }
+    detail::write_coins(w,coins);
+
+    return detail::finish_frame(w,buf);
+}
+
+// encode only what changed between base and s. base must be a snapshot the
+// client has acknowledged and s.tick-base.tick must be in [1, SNAPSHOT_HISTORY).
+// coins holds the slots that changed after base.tick.
+// returns the frame size, or 0 if cap is too small. never allocates.
+inline size_t encode_state_delta(const worldSnapshot& s, const worldSnapshot& base,
+                                 const coinUpdate& coins, uint8_t* buf, size_t cap){
+    int offset=s.tick-base.tick;
+    if(offset<=0 || offset>=SNAPSHOT_HISTORY) return 0;
+
+    detail::ByteWriter w(buf,cap);
+    detail::begin_frame(w);
+
+    w.u8(FRAME_STATE_DELTA);
+    w.i32(s.tick);
+    w.u8(static_cast<uint8_t>(offset));
+    w.f64(s.server_time);
+
+    uint8_t in_now[256];
+    uint8_t in_base[256];
+    detail::index_players(s,in_now);
+    detail::index_players(base,in_base);
+
+    // counts are patched once each section is written
+    uint8_t* count_at=w.p;
+    uint8_t count=0;
+    w.u8(0);
+    for(int i=0;i<base.num_players;i++){
+        uint8_t id=static_cast<uint8_t>(base.players[i].id);
+        if(in_now[id]!=0xFF) continue;
+        w.u8(id);
+        count++;
+    }
+    if(w.ok) *count_at=count;
+
+    count_at=w.p;
+    count=0;
+    w.u8(0);
+    for(int i=0;i<s.num_players;i++){
+        if(in_base[static_cast<uint8_t>(s.players[i].id)]!=0xFF) continue;
+        detail::write_player(w,s.players[i]);
+        count++;
+    }
+    if(w.ok) *count_at=count;
+
+    count_at=w.p;
+    count=0;
+    w.u8(0);
+    for(int i=0;i<s.num_players;i++){
+        const playerState& p=s.players[i];
+        uint8_t b_idx=in_base[static_cast<uint8_t>(p.id)];
+        if(b_idx==0xFF) continue;
+        const playerState& b=base.players[b_idx];
+
+        uint8_t mask=0;
+        if(p.x!=b.x) mask|=DELTA_PLAYER_X;
+        if(p.y!=b.y) mask|=DELTA_PLAYER_Y;
+        if(p.score!=b.score) mask|=DELTA_PLAYER_SCORE;
+        if(p.input_seq!=b.input_seq || p.input_tick!=b.input_tick) mask|=DELTA_PLAYER_INPUT;
+        if(mask==0) continue;
+
+        w.u8(static_cast<uint8_t>(p.id));
+        w.u8(mask);
+        if(mask&DELTA_PLAYER_X) w.f32(p.x);
+        if(mask&DELTA_PLAYER_Y) w.f32(p.y);
+        if(mask&DELTA_PLAYER_SCORE) w.i32(p.score);
+        if(mask&DELTA_PLAYER_INPUT){
+            w.i32(p.input_seq);
+            w.i32(p.input_tick);
+        }
+        count++;
+    }
+    if(w.ok) *count_at=count;
+
+    detail::write_coins(w,coins);
+
+    return detail::finish_frame(w,buf);
+}
+
+// size of the complete binary frame at the front of data, or 0 if more
+// bytes are needed. callers must check data[0]==BIN_MAGIC first.
+inline size_t binary_frame_size(const uint8_t* data, size_t len){
+    if(len<BIN_HEADER_SIZE) return 0;
+    size_t payload=static_cast<size_t>(data[2]|(data[3]<<8));
+    if(len<BIN_HEADER_SIZE+payload) return 0;
+    return BIN_HEADER_SIZE+payload;
+}
+
+// baseline tick a STATE_DELTA frame was encoded against, or -1 for a
+// keyframe (or anything that is not a well-formed delta header)
+inline int state_frame_base_tick(const uint8_t* frame, size_t len){
+    if(len<BIN_HEADER_SIZE+6) return -1;
+    if(frame[0]!=BIN_MAGIC || frame[1]!=BIN_VERSION) return -1;
+    if(frame[BIN_HEADER_SIZE]!=FRAME_STATE_DELTA) return -1;
+    detail::ByteReader r(frame+BIN_HEADER_SIZE+1,5);
+    int tick=r.i32();
+    int offset=r.u8();
+    return tick-offset;
+}
+
+// parse one complete binary STATE frame. delta frames need the snapshot
+// they were encoded against in base (see state_frame_base_tick). the coin
+// section goes to coins; coins.full tells a keyframe's full set apart from
+// a delta's changes. does not allocate once coins has grown.
+inline bool decode_state_binary(const uint8_t* frame, size_t len, worldSnapshot& out,
+                                coinUpdate& coins, const worldSnapshot* base=nullptr){
+    detail::ByteReader r(frame,len);
+    if(r.u8()!=BIN_MAGIC) return false;
+    if(r.u8()!=BIN_VERSION) return false;
+    size_t payload=r.u16();
+    if(!r.ok || len<BIN_HEADER_SIZE+payload) return false;
+    r.end=frame+BIN_HEADER_SIZE+payload;
+
+    uint8_t kind=r.u8();
+    if(kind==FRAME_STATE){
+        out.tick=r.i32();
+        out.server_time=r.f64();
+        out.num_players=r.u8();
+        if(out.num_players>MAX_PLAYERS) return false;
+        for(int i=0;i<out.num_players;i++){
+            detail::read_player(r,out.players[i]);
+        }
+        coins.full=true;
+        return detail::read_coins(r,coins);
+    }
+
+    if(kind!=FRAME_STATE_DELTA) return false;
+
+    int tick=r.i32();
+    int offset=r.u8();
+    if(!r.ok || !base || base->tick!=tick-offset) return false;
+
+    out=*base;
+    out.tick=tick;
+    out.server_time=r.f64();
+
+    // players that left: compact them out of the list
+    int left=r.u8();
+    for(int k=0;k<left && r.ok;k++){
+        int id=r.u8();
+        for(int i=0;i<out.num_players;i++){
+            if(out.players[i].id!=id) continue;
+            for(int j=i+1;j<out.num_players;j++) out.players[j-1]=out.players[j];
+            out.num_players--;
+            break;
+        }
+    }
+
+    // players that joined: insert keeping the list sorted by id
+    int joined=r.u8();
+    for(int k=0;k<joined && r.ok;k++){
+        playerState p;
+        detail::read_player(r,p);
+        if(out.num_players>=MAX_PLAYERS) return false;
+        int at=out.num_players;
+        while(at>0 && out.players[at-1].id>p.id){
+            out.players[at]=out.players[at-1];
+            at--;
+        }
+        out.players[at]=p;
+        out.num_players++;
+    }
+
+    uint8_t index[256];
+    detail::index_players(out,index);
+
+    int changed=r.u8();
+    for(int k=0;k<changed && r.ok;k++){
+        uint8_t id=r.u8();
+        uint8_t mask=r.u8();
+        if(index[id]==0xFF) return false;
+        playerState& p=out.players[index[id]];
+        if(mask&DELTA_PLAYER_X) p.x=r.f32();
+        if(mask&DELTA_PLAYER_Y) p.y=r.f32();
+        if(mask&DELTA_PLAYER_SCORE) p.score=r.i32();
+        if(mask&DELTA_PLAYER_INPUT){
+            p.input_seq=r.i32();
+            p.input_tick=r.i32();
+        }
+    }
+
+    coins.full=false;
+    return detail::read_coins(r,coins);
+}
+
+// ---- UDP transport ----
+
+// Every datagram starts with a fixed header, little-endian:
+//   u8  UDP_MAGIC
+//   u8  packet type (PKT_*)
+//   u16 sequence number of this packet (per direction, wraps)
+//   u16 ack: newest sequence number received from the peer
+//   u32 ack_bits: bit i set means ack-1-i was received as well
+//
+// followed by a type-specific body:
+//   PKT_CONNECT     u32 client salt
+//   PKT_ACCEPT      u32 client salt, u8 player id, u16 world width,
+//                   u16 world height, u16 interest radius
+//   PKT_DENY        u32 client salt
+//   PKT_INPUT       u8 count, count x { i32 seq, i8 dx, i8 dy }, newest first
+//   PKT_STATE       one binary STATE frame (keyframe or delta)
+//   PKT_DISCONNECT  (empty)
+//
+// CONNECT/ACCEPT replaces the JOIN/WELCOME exchange of the TCP path. STATE
+// packets are never resent; the server learns which ones arrived from the
+// client's acks and uses the newest as the delta baseline. Each INPUT packet
+// repeats the last few input commands so a lost datagram costs nothing.
+
+constexpr uint8_t UDP_MAGIC=0xC7;
+constexpr size_t UDP_HEADER_SIZE=1+1+2+2+4;
+constexpr size_t UDP_MAX_PACKET=UDP_HEADER_SIZE+MAX_FRAME_SIZE;
+
+constexpr uint8_t PKT_CONNECT=1;
+constexpr uint8_t PKT_ACCEPT=2;
+constexpr uint8_t PKT_DENY=3;
+constexpr uint8_t PKT_INPUT=4;
+constexpr uint8_t PKT_STATE=5;
+constexpr uint8_t PKT_DISCONNECT=6;
 
-inline std::string encode_state(const worldSnapshot& s){
-    std::ostringstream oss;
-    oss<<"STATE "
-        <<s.tick<<' '
-        <<s.players[0].x<<' '<<s.players[0].y<<' '<<s.players[0].score<<' '
-        <<s.players[1].x<<' '<<s.players[1].y<<' '<<s.players[1].score<<' '
-        <<s.coin_x<<' '<<s.coin_y<<' '<<(s.coin_active ? 1 : 0)<<' '
-        <<std::fixed<<std::setprecision(6)<<s.server_time;
-    return oss.str();
+// input commands repeated in every PKT_INPUT
+constexpr int UDP_INPUT_REDUNDANCY=4;
+
+// seconds of silence before a peer is considered gone
+constexpr double UDP_TIMEOUT=5.0;
+
+// how often the client resends CONNECT and sends keepalive INPUT packets
+constexpr double UDP_RESEND_INTERVAL=0.1;
+
+struct UdpHeader{
+    uint8_t type=0;
+    uint16_t seq=0;
+    uint16_t ack=0;
+    uint32_t ack_bits=0;
+};
+
+struct InputCmd{
+    int seq=0;
+    int dx=0;
+    int dy=0;
+};
+
+// true if sequence number a is more recent than b, allowing for wraparound
+inline bool seq_newer(uint16_t a, uint16_t b){
+    return static_cast<int16_t>(static_cast<uint16_t>(a-b))>0;
 }
 
-// parser for state
-inline bool decode_state(const std::string& line, worldSnapshot& out){
-    std::istringstream iss(line);
-    std::string tag;
-    int coin_active=0;
+// tracks which of the peer's packets arrived, in the ack/ack_bits form
+// that goes into our outgoing headers
+struct AckTracker{
+    uint16_t ack=0;
+    uint32_t ack_bits=0;
+    bool received_any=false;
 
-    if(!(iss>>tag)) return false;
-    if(tag!="STATE") return false;
+    // record an incoming sequence number; false if it was already seen
+    // or is too old to track
+    bool on_receive(uint16_t seq){
+        if(!received_any){
+            received_any=true;
+            ack=seq;
+            ack_bits=0;
+            return true;
+        }
+        if(seq==ack) return false;
+        if(seq_newer(seq,ack)){
+            uint16_t shift=static_cast<uint16_t>(seq-ack);
+            ack_bits=(shift>=32) ? 0 : (ack_bits<<shift);
+            if(shift<=32) ack_bits|=1u<<(shift-1);
+            ack=seq;
+            return true;
+        }
+        uint16_t back=static_cast<uint16_t>(ack-seq);
+        if(back>32) return false;
+        uint32_t bit=1u<<(back-1);
+        if(ack_bits&bit) return false;
+        ack_bits|=bit;
+        return true;
+    }
+};
 
-    if(!(iss>>out.tick
-            >>out.players[0].x>>out.players[0].y>>out.players[0].score
-            >>out.players[1].x>>out.players[1].y>>out.players[1].score
-            >>out.coin_x>>out.coin_y>>coin_active
-            >>out.server_time)){
-        return false;
+// call fn(seq) for every sequence number acknowledged by a header
+template<typename Fn>
+inline void for_each_acked(uint16_t ack, uint32_t ack_bits, Fn fn){
+    fn(ack);
+    for(int i=0;i<32;i++){
+        if(ack_bits&(1u<<i)) fn(static_cast<uint16_t>(ack-1-i));
     }
+}
+
+inline size_t write_udp_header(const UdpHeader& h, uint8_t* buf, size_t cap){
+    detail::ByteWriter w(buf,cap);
+    w.u8(UDP_MAGIC);
+    w.u8(h.type);
+    w.u16(h.seq);
+    w.u16(h.ack);
+    w.u32(h.ack_bits);
+    return w.ok ? UDP_HEADER_SIZE : 0;
+}
 
-    out.coin_active=(coin_active!=0);
-    out.players[0].id=1;
-    out.players[1].id=2;
+inline bool read_udp_header(const uint8_t* data, size_t len, UdpHeader& out){
+    detail::ByteReader r(data,len);
+    if(r.u8()!=UDP_MAGIC) return false;
+    out.type=r.u8();
+    out.seq=r.u16();
+    out.ack=r.u16();
+    out.ack_bits=r.u32();
+    return r.ok;
+}
 
-    return true;
+// handshake packets: header followed by the salt (and player id and world
+// info for ACCEPT)
+inline size_t encode_udp_handshake(const UdpHeader& h, uint32_t salt, int player_id,
+                                   uint8_t* buf, size_t cap, const WorldInfo& info=WorldInfo{}){
+    size_t n=write_udp_header(h,buf,cap);
+    if(n==0) return 0;
+    detail::ByteWriter w(buf+n,cap-n);
+    w.u32(salt);
+    if(h.type==PKT_ACCEPT){
+        w.u8(static_cast<uint8_t>(player_id));
+        w.u16(static_cast<uint16_t>(info.width));
+        w.u16(static_cast<uint16_t>(info.height));
+        w.u16(static_cast<uint16_t>(info.interest));
+    }
+    if(!w.ok) return 0;
+    return static_cast<size_t>(w.p-buf);
 }
+
+inline bool decode_udp_handshake(const uint8_t* data, size_t len, uint8_t type,
+                                 uint32_t& salt, int& player_id, WorldInfo* info=nullptr){
+    detail::ByteReader r(data+UDP_HEADER_SIZE,len-UDP_HEADER_SIZE);
+    salt=r.u32();
+    if(type==PKT_ACCEPT){
+        player_id=r.u8();
+        WorldInfo got;
+        got.width=r.u16();
+        got.height=r.u16();
+        got.interest=r.u16();
+        if(info) *info=got;
+    }
+    return r.ok;
 }
 
+// INPUT body: cmds[0] is the newest command
+inline size_t encode_udp_input(const UdpHeader& h, const InputCmd* cmds, int count,
+                               uint8_t* buf, size_t cap){
+    size_t n=write_udp_header(h,buf,cap);
+    if(n==0) return 0;
+    detail::ByteWriter w(buf+n,cap-n);
+    w.u8(static_cast<uint8_t>(count));
+    for(int i=0;i<count;i++){
+        w.i32(cmds[i].seq);
+        w.u8(static_cast<uint8_t>(static_cast<int8_t>(cmds[i].dx)));
+        w.u8(static_cast<uint8_t>(static_cast<int8_t>(cmds[i].dy)));
+    }
+    if(!w.ok) return 0;
+    return static_cast<size_t>(w.p-buf);
+}
+
+// returns the number of commands written to out (at most max_out), or -1
+inline int decode_udp_input(const uint8_t* data, size_t len, InputCmd* out, int max_out){
+    if(len<UDP_HEADER_SIZE) return -1;
+    detail::ByteReader r(data+UDP_HEADER_SIZE,len-UDP_HEADER_SIZE);
+    int count=r.u8();
+    if(count>max_out) count=max_out;
+    for(int i=0;i<count;i++){
+        out[i].seq=r.i32();
+        out[i].dx=static_cast<int8_t>(r.u8());
+        out[i].dy=static_cast<int8_t>(r.u8());
+    }
+    return r.ok ? count : -1;
+}
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include "protocol.hpp"
+
+// movement rules shared by the server's update_world and the client's
+// prediction. both sides step a player at the same fixed timestep with the
+// same float arithmetic, so replaying an input on the client lands exactly
+// where the server put the player (short of collisions, which only the
+// server resolves).
+namespace sim{
+
+constexpr double TICK_DT=1.0/static_cast<double>(proto::TICK_RATE);
+constexpr float STEP_DT=static_cast<float>(TICK_DT);
+
+// velocity for an INPUT direction (-1, 0, 1 on each axis)
+inline void velocity_from_input(int dx, int dy, float& vx, float& vy){
+    vx=static_cast<float>(dx)*proto::PLAYER_SPEED;
+    vy=static_cast<float>(dy)*proto::PLAYER_SPEED;
+}
+
+// advance one player by one fixed step and keep them inside a world of
+// world_w x world_h
+inline void step_player(float& x, float& y, float vx, float vy,
+                        float world_w=proto::WORLD_WIDTH, float world_h=proto::WORLD_HEIGHT){
+    x+=vx*STEP_DT;
+    y+=vy*STEP_DT;
+
+    if(x<proto::PLAYER_RADIUS) x=proto::PLAYER_RADIUS;
+    if(x>world_w-proto::PLAYER_RADIUS)
+        x=world_w-proto::PLAYER_RADIUS;
+    if(y<proto::PLAYER_RADIUS) y=proto::PLAYER_RADIUS;
+    if(y>world_h-proto::PLAYER_RADIUS)
+        y=world_h-proto::PLAYER_RADIUS;
+}
+
+// turns variable frame times into whole fixed steps
+struct FixedStep{
+    double accum=0.0;
+
+    // add frame_dt seconds, return how many steps are now due
+    int advance(double frame_dt){
+        accum+=frame_dt;
+        int steps=0;
+        while(accum>=TICK_DT){
+            accum-=TICK_DT;
+            steps++;
+        }
+        return steps;
+    }
+};
+
+} // namespace sim
@@ -0,0 +1,39 @@
+#pragma once
+
+#include "protocol.hpp"
+
+// receiving side of binary STATE frames, shared by the game client and the
+// load generator's bots: keeps recently received snapshots as delta
+// baselines and rebuilds full snapshots from deltas.
+struct SnapshotReceiver{
+    // indexed by tick % SNAPSHOT_HISTORY
+    proto::worldSnapshot baselines[proto::SNAPSHOT_HISTORY];
+    // coin section of the last decoded frame
+    proto::coinUpdate coins;
+    int newest_tick=-1;
+
+    SnapshotReceiver(){
+        for(auto& b : baselines) b.tick=-1;
+    }
+
+    // decode one complete frame into out (and coins). returns false if it is
+    // malformed or its baseline is gone. fresh tells whether out is newer
+    // than every snapshot before it; over UDP a late snapshot is still a
+    // valid baseline but must not be shown out of order.
+    bool on_frame(const uint8_t* data, size_t len, proto::worldSnapshot& out, bool& fresh){
+        const proto::worldSnapshot* base=nullptr;
+        int base_tick=proto::state_frame_base_tick(data,len);
+        if(base_tick>=0){
+            const proto::worldSnapshot& b=baselines[base_tick%proto::SNAPSHOT_HISTORY];
+            if(b.tick!=base_tick) return false;
+            base=&b;
+        }
+
+        if(!proto::decode_state_binary(data,len,out,coins,base)) return false;
+        baselines[out.tick%proto::SNAPSHOT_HISTORY]=out;
+
+        fresh=out.tick>newest_tick;
+        if(fresh) newest_tick=out.tick;
+        return true;
+    }
+};
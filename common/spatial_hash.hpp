@@ -0,0 +1,161 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <algorithm>
+
+// uniform-grid spatial hash used as the broadphase for player-player
+// collision and pickup queries.
+//
+// entries are bucketed by cell with a counting sort, so a rebuild is two
+// linear passes over flat arrays and the storage is reused between ticks
+// (no allocation once the vectors have grown to the working-set size).
+//
+// usage per tick:
+//   hash.clear();
+//   for each entity: hash.insert(id,x,y);
+//   hash.build();
+//   hash.for_each_pair(...) / hash.query(...)
+//
+// cell_size must be at least the largest interaction distance, so that any
+// interacting pair sits in the same or a neighbouring cell.
+struct SpatialHash{
+    float cell_size=1.0f;
+    float inv_cell=1.0f;
+    int cols=1;
+    int rows=1;
+
+    // pending inserts
+    std::vector<int> ids;
+    std::vector<float> xs;
+    std::vector<float> ys;
+    std::vector<int> cells;
+
+    // built grid: entries of cell c are sorted_*[cell_start[c] .. cell_start[c+1])
+    std::vector<int> cell_start;
+    std::vector<int> sorted_ids;
+    std::vector<float> sorted_x;
+    std::vector<float> sorted_y;
+    std::vector<int> cursor;
+
+    SpatialHash()=default;
+
+    SpatialHash(float cell, float world_w, float world_h){
+        reset(cell,world_w,world_h);
+    }
+
+    void reset(float cell, float world_w, float world_h){
+        cell_size=cell;
+        inv_cell=1.0f/cell;
+        cols=std::max(1,static_cast<int>(world_w*inv_cell)+1);
+        rows=std::max(1,static_cast<int>(world_h*inv_cell)+1);
+        cell_start.assign(static_cast<size_t>(cols*rows+1),0);
+        clear();
+    }
+
+    void clear(){
+        ids.clear();
+        xs.clear();
+        ys.clear();
+        cells.clear();
+    }
+
+    int cell_x(float x) const{
+        int c=static_cast<int>(x*inv_cell);
+        return std::clamp(c,0,cols-1);
+    }
+    int cell_y(float y) const{
+        int r=static_cast<int>(y*inv_cell);
+        return std::clamp(r,0,rows-1);
+    }
+
+    void insert(int id, float x, float y){
+        ids.push_back(id);
+        xs.push_back(x);
+        ys.push_back(y);
+        cells.push_back(cell_y(y)*cols+cell_x(x));
+    }
+
+    // bucket the inserted entries by cell (stable, so insert order is kept
+    // within a cell)
+    void build(){
+        size_t n=ids.size();
+        std::fill(cell_start.begin(),cell_start.end(),0);
+        for(size_t i=0;i<n;i++) cell_start[cells[i]+1]++;
+        for(size_t c=1;c<cell_start.size();c++) cell_start[c]+=cell_start[c-1];
+
+        cursor.assign(cell_start.begin(),cell_start.end()-1);
+        sorted_ids.resize(n);
+        sorted_x.resize(n);
+        sorted_y.resize(n);
+        for(size_t i=0;i<n;i++){
+            int at=cursor[cells[i]]++;
+            sorted_ids[at]=ids[i];
+            sorted_x[at]=xs[i];
+            sorted_y[at]=ys[i];
+        }
+    }
+
+    // call fn(id_a,id_b) once for every pair of entries closer than max_dist
+    // (max_dist <= cell_size). pairs come out grouped by cell, each pair once.
+    template<typename Fn>
+    void for_each_pair(float max_dist, Fn fn) const{
+        const float max_sq=max_dist*max_dist;
+        // half neighbourhood: same cell, then right, down-left, down, down-right
+        static const int nbr_dx[4]={1,-1,0,1};
+        static const int nbr_dy[4]={0,1,1,1};
+
+        for(int cy=0;cy<rows;cy++){
+            for(int cx=0;cx<cols;cx++){
+                int c=cy*cols+cx;
+                int a_begin=cell_start[c];
+                int a_end=cell_start[c+1];
+                if(a_begin==a_end) continue;
+
+                for(int a=a_begin;a<a_end;a++){
+                    for(int b=a+1;b<a_end;b++){
+                        float dx=sorted_x[a]-sorted_x[b];
+                        float dy=sorted_y[a]-sorted_y[b];
+                        if(dx*dx+dy*dy<max_sq) fn(sorted_ids[a],sorted_ids[b]);
+                    }
+                }
+
+                for(int k=0;k<4;k++){
+                    int nx=cx+nbr_dx[k];
+                    int ny=cy+nbr_dy[k];
+                    if(nx<0 || nx>=cols || ny>=rows) continue;
+                    int n=ny*cols+nx;
+                    int b_begin=cell_start[n];
+                    int b_end=cell_start[n+1];
+                    for(int a=a_begin;a<a_end;a++){
+                        for(int b=b_begin;b<b_end;b++){
+                            float dx=sorted_x[a]-sorted_x[b];
+                            float dy=sorted_y[a]-sorted_y[b];
+                            if(dx*dx+dy*dy<max_sq) fn(sorted_ids[a],sorted_ids[b]);
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    // call fn(id) for every entry within radius of (x,y), radius inclusive
+    template<typename Fn>
+    void query(float x, float y, float radius, Fn fn) const{
+        const float r_sq=radius*radius;
+        int x0=cell_x(x-radius);
+        int x1=cell_x(x+radius);
+        int y0=cell_y(y-radius);
+        int y1=cell_y(y+radius);
+        for(int cy=y0;cy<=y1;cy++){
+            for(int cx=x0;cx<=x1;cx++){
+                int c=cy*cols+cx;
+                for(int i=cell_start[c];i<cell_start[c+1];i++){
+                    float dx=sorted_x[i]-x;
+                    float dy=sorted_y[i]-y;
+                    if(dx*dx+dy*dy<=r_sq) fn(sorted_ids[i]);
+                }
+            }
+        }
+    }
+};
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+
+// bounded single-producer/single-consumer queue. one thread may push and
+// one thread may pop at the same time without locks; Capacity must be a
+// power of two. head and tail only ever grow, and each lives on its own
+// cache line so producer and consumer do not false-share.
+template<typename T, size_t Capacity>
+struct SpscRing{
+    static_assert((Capacity&(Capacity-1))==0,"capacity must be a power of two");
+
+    alignas(64) std::atomic<size_t> head{0}; // next slot to pop, consumer-owned
+    alignas(64) std::atomic<size_t> tail{0}; // next slot to push, producer-owned
+    alignas(64) T items[Capacity];
+
+    // producer side. false when the ring is full.
+    bool push(const T& item){
+        size_t t=tail.load(std::memory_order_relaxed);
+        if(t-head.load(std::memory_order_acquire)==Capacity) return false;
+        items[t&(Capacity-1)]=item;
+        tail.store(t+1,std::memory_order_release);
+        return true;
+    }
+
+    // consumer side. false when the ring is empty.
+    bool pop(T& out){
+        size_t h=head.load(std::memory_order_relaxed);
+        if(h==tail.load(std::memory_order_acquire)) return false;
+        out=items[h&(Capacity-1)];
+        head.store(h+1,std::memory_order_release);
+        return true;
+    }
+
+    bool empty() const{
+        return head.load(std::memory_order_acquire)==tail.load(std::memory_order_acquire);
+    }
+};
@@ -0,0 +1,105 @@
+#pragma once
+
+#include <memory>
+#include <cstring>
+#include <cstdint>
+#include <cerrno>
+#include <string_view>
+#include <sys/types.h>
+#include <sys/socket.h>
+
+#include "protocol.hpp"
+
+// receive side of a TCP stream carrying text lines and binary frames (see
+// BIN_MAGIC), shared by the server, the client and loadgen:
+//
+//   StreamFramer in(capacity);
+//   while(in.fill(fd)>0){
+//       StreamFramer::Frame f;
+//       while(in.next(f)){ ... f.data is valid until the next fill() ... }
+//   }
+//
+// recv() writes straight into the free space of one fixed buffer and frames
+// are handed out as views into it, so nothing is copied or allocated per
+// message. consumed bytes are only skipped over; when the free space at the
+// end runs out, the one incomplete frame left is moved to the front, which
+// keeps every frame contiguous for decode_state_binary. capacity bounds the
+// largest frame: a stream that fills it without completing one is an error.
+// receive capacity for the server's stream: the largest binary frame (a
+// 64 KiB payload) or a text STATE line with every coin in it both fit
+constexpr size_t SERVER_STREAM_CAPACITY=256*1024;
+
+struct StreamFramer{
+    struct Frame{
+        bool binary=false;
+        std::string_view data; // a line without its "\n" or "\r\n", or a whole binary frame
+    };
+
+    std::unique_ptr<char[]> buf;
+    size_t cap=0;
+    size_t head=0;    // first byte not handed out yet
+    size_t tail=0;    // end of the received bytes
+    size_t scanned=0; // bytes from head already known to hold no '\n'
+
+    explicit StreamFramer(size_t capacity=4096) : buf(new char[capacity]), cap(capacity){}
+
+    size_t buffered() const{ return tail-head; }
+
+    // one recv() into the free space. returns what recv returned; -1 with
+    // errno EMSGSIZE if the buffer is full of a single incomplete frame.
+    ssize_t fill(int fd){
+        if(tail==cap){
+            if(head==0){
+                errno=EMSGSIZE;
+                return -1;
+            }
+            std::memmove(buf.get(),buf.get()+head,tail-head);
+            tail-=head;
+            head=0;
+        }
+        ssize_t n=::recv(fd,buf.get()+tail,cap-tail,0);
+        if(n>0) tail+=static_cast<size_t>(n);
+        return n;
+    }
+
+    // next complete frame, skipping empty lines. false until more arrives.
+    bool next(Frame& out){
+        while(head<tail){
+            const char* p=buf.get()+head;
+            size_t avail=tail-head;
+
+            // binary frames are tagged by a magic byte no text line starts with
+            if(static_cast<uint8_t>(p[0])==proto::BIN_MAGIC){
+                size_t len=proto::binary_frame_size(reinterpret_cast<const uint8_t*>(p),avail);
+                if(len==0) return false; // wait for the rest of the frame
+                consume(len);
+                out.binary=true;
+                out.data=std::string_view(p,len);
+                return true;
+            }
+
+            const void* nl_pos=std::memchr(p+scanned,'\n',avail-scanned);
+            if(!nl_pos){
+                scanned=avail;
+                return false;
+            }
+            size_t len=static_cast<size_t>(static_cast<const char*>(nl_pos)-p);
+            consume(len+1);
+            if(len>0 && p[len-1]=='\r') len--;
+            if(len==0) continue;
+            out.binary=false;
+            out.data=std::string_view(p,len);
+            return true;
+        }
+        return false;
+    }
+
+    void consume(size_t len){
+        head+=len;
+        scanned=0;
+        if(head==tail){
+            head=0;
+            tail=0;
+        }
+    }
+};
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <vector>
+#include <memory>
+#include <algorithm>
+#include <cstdint>
+#include <cstddef>
+
+// bump allocator for scratch that only lives until the end of the current
+// tick: alloc() carves pieces off one block, and reset() at the tick
+// boundary hands the whole block back at once.
+//
+// a tick that needs more than the block holds gets the rest from overflow
+// blocks, and the next reset replaces them all with one block big enough
+// for that tick, so once the largest tick has been seen nothing is
+// allocated. nothing is destructed either: only for plain data (text,
+// frame bytes, index lists) aligned to at most max_align_t.
+//
+// owned by one thread at a time, like the room it belongs to.
+struct TickArena{
+    std::unique_ptr<uint8_t[]> block;
+    size_t capacity=0;
+    size_t used=0;
+
+    std::vector<std::unique_ptr<uint8_t[]>> overflow;
+    size_t overflow_bytes=0;
+
+    explicit TickArena(size_t initial=0){
+        if(initial>0) regrow(initial);
+    }
+
+    TickArena(const TickArena&)=delete;
+    TickArena& operator=(const TickArena&)=delete;
+
+    void* alloc(size_t n, size_t align=alignof(std::max_align_t)){
+        size_t at=(used+align-1)&~(align-1);
+        if(at+n<=capacity){
+            used=at+n;
+            return block.get()+at;
+        }
+        overflow.emplace_back(new uint8_t[n ? n : 1]);
+        overflow_bytes+=n+align;
+        return overflow.back().get();
+    }
+
+    template<typename T>
+    T* alloc_array(size_t n){
+        return static_cast<T*>(alloc(n*sizeof(T),alignof(T)));
+    }
+
+    // bytes handed out since the last reset
+    size_t bytes_used() const{ return used+overflow_bytes; }
+
+    // start the next tick; everything alloc returned is invalid after this
+    void reset(){
+        if(!overflow.empty()){
+            size_t needed=used+overflow_bytes;
+            overflow.clear();
+            overflow_bytes=0;
+            regrow(std::max(needed+needed/2,capacity*2));
+        }
+        used=0;
+    }
+
+    void regrow(size_t n){
+        block.reset(new uint8_t[n]);
+        capacity=n;
+    }
+};
@@ -0,0 +1,119 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cerrno>
+#include <ctime>
+#include <unistd.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/timerfd.h>
+
+#include "utils.hpp"
+#include "histogram.hpp"
+
+// fixed-rate tick clock for the game loop. deadlines are absolute on
+// CLOCK_MONOTONIC (the clock behind now_nanos), so a late wake-up never
+// shifts the ticks after it:
+//
+//   TickScheduler sched;
+//   sched.init(period_ns,TickWait::Sleep,spin_ns,CatchUp::Burst);
+//   while(running){
+//       uint64_t due=sched.wait();   // blocks until the next tick is due
+//       run_tick(due);
+//   }
+//
+// the wait blocks in clock_nanosleep(TIMER_ABSTIME) or on a timerfd until
+// spin_ns before the deadline, then spins for the rest, trading a little CPU
+// for wake-ups that do not depend on the kernel's timer slack. how late each
+// tick starts is recorded in start_jitter.
+
+enum class TickWait{ Sleep, Timerfd };
+
+// what happens when ticks are due faster than they can be started (a stall,
+// or ticks that take longer than the period)
+enum class CatchUp{
+    Burst, // run every missed tick back to back until on schedule again
+    Skip   // drop the missed ticks and carry on from the next deadline
+};
+
+struct TickScheduler{
+    uint64_t period_ns=0;
+    uint64_t spin_ns=0;
+    TickWait mode=TickWait::Sleep;
+    CatchUp catch_up=CatchUp::Burst;
+    int timer_fd=-1;
+
+    uint64_t next_ns=0;   // deadline of the next tick
+    std::atomic<uint64_t> skipped{0}; // ticks dropped by CatchUp::Skip
+    LatencyHistogram start_jitter; // tick start minus its deadline
+
+    // false (with errno set) if the timerfd could not be created
+    bool init(uint64_t period, TickWait wait_mode, uint64_t spin, CatchUp policy){
+        period_ns=period;
+        spin_ns=spin<period ? spin : period;
+        mode=wait_mode;
+        catch_up=policy;
+        if(mode==TickWait::Timerfd){
+            timer_fd=timerfd_create(CLOCK_MONOTONIC,TFD_CLOEXEC);
+            if(timer_fd<0) return false;
+        }
+        next_ns=now_nanos();
+        return true;
+    }
+
+    ~TickScheduler(){
+        if(timer_fd>=0) ::close(timer_fd);
+    }
+
+    static timespec to_timespec(uint64_t ns){
+        timespec ts;
+        ts.tv_sec=static_cast<time_t>(ns/1000000000ull);
+        ts.tv_nsec=static_cast<long>(ns%1000000000ull);
+        return ts;
+    }
+
+    // block until wake_ns (absolute), or return early on a signal
+    void block_until(uint64_t wake_ns){
+        if(mode==TickWait::Timerfd){
+            itimerspec its={};
+            its.it_value=to_timespec(wake_ns);
+            if(timerfd_settime(timer_fd,TFD_TIMER_ABSTIME,&its,nullptr)==0){
+                uint64_t expirations;
+                ssize_t n=::read(timer_fd,&expirations,sizeof(expirations));
+                (void)n; // EINTR just means an early wake-up, the spin covers it
+                return;
+            }
+        }
+        timespec ts=to_timespec(wake_ns);
+        while(clock_nanosleep(CLOCK_MONOTONIC,TIMER_ABSTIME,&ts,nullptr)==EINTR){}
+    }
+
+    // wait for the next tick and return its deadline
+    uint64_t wait(){
+        uint64_t now=now_nanos();
+        if(now<next_ns){
+            if(next_ns-now>spin_ns) block_until(next_ns-spin_ns);
+            while((now=now_nanos())<next_ns){}
+        }
+
+        uint64_t due=next_ns;
+        start_jitter.record(now-due);
+        next_ns+=period_ns;
+        if(catch_up==CatchUp::Skip && now>=next_ns){
+            uint64_t missed=(now-next_ns)/period_ns+1;
+            skipped.fetch_add(missed,std::memory_order_relaxed);
+            next_ns+=missed*period_ns;
+        }
+        return due;
+    }
+};
+
+// pin the calling thread to one CPU; false if the CPU does not exist or
+// is not in this process's allowed set
+inline bool pin_current_thread(int cpu){
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu,&set);
+    return pthread_setaffinity_np(pthread_self(),sizeof(set),&set)==0;
+}
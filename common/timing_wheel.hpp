@@ -0,0 +1,54 @@
+#pragma once
+
+#include <vector>
+#include <cstddef>
+
+// tick-bucketed scheduler: items are filed under the tick they become due
+// and released exactly on that tick, regardless of the order they were
+// scheduled in. buckets are reused round-robin, so an item due further out
+// than the wheel spans waits in its bucket for the right lap.
+//
+// usage per tick:
+//   wheel.schedule(due_tick,item);    (any number of times)
+//   wheel.advance(tick,fn);           fn(item) for everything due by tick
+//
+// bucket storage is kept between ticks, so steady state does not allocate.
+template<typename T>
+struct TimingWheel{
+    struct Entry{
+        long tick=0;
+        T item;
+    };
+
+    std::vector<std::vector<Entry>> buckets;
+    long next_tick=0; // oldest tick not released yet
+
+    explicit TimingWheel(size_t slots=64) : buckets(slots){}
+
+    // file item under due_tick; anything already due goes out on the next advance
+    void schedule(long due_tick, const T& item){
+        if(due_tick<next_tick) due_tick=next_tick;
+        buckets[static_cast<size_t>(due_tick)%buckets.size()].push_back(Entry{due_tick,item});
+    }
+
+    // release every item due at or before tick, oldest tick first and in
+    // scheduling order within a tick
+    template<typename Fn>
+    void advance(long tick, Fn fn){
+        for(;next_tick<=tick;next_tick++){
+            auto& b=buckets[static_cast<size_t>(next_tick)%buckets.size()];
+            size_t kept=0;
+            for(size_t i=0;i<b.size();i++){
+                if(b[i].tick<=next_tick) fn(b[i].item);
+                else b[kept++]=b[i]; // a later lap
+            }
+            b.resize(kept);
+        }
+    }
+
+    // drop everything and restart the wheel at tick
+    void reset(long tick=0){
+        for(auto& b : buckets) b.clear();
+        next_tick=tick;
+    }
+};
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <atomic>
+
+// latest-value handoff between one writer and one reader without locks.
+// the writer fills write_buffer() and publishes it; the reader's read()
+// returns the newest published value and keeps it stable until its next
+// read(), however often the writer publishes in between. a value the
+// reader never picked up is simply replaced.
+template<typename T>
+struct TripleBuffer{
+    static constexpr int FRESH=4; // set on middle when it holds an unread value
+
+    T buffers[3];
+    std::atomic<int> middle{1}; // buffer index, plus FRESH
+    int back=0;  // writer-owned
+    int front=2; // reader-owned
+
+    // ---- writer ----
+
+    // holds whatever was written two publishes ago; overwrite all of it
+    T& write_buffer(){ return buffers[back]; }
+
+    void publish(){
+        back=middle.exchange(back|FRESH,std::memory_order_acq_rel)&3;
+    }
+
+    // ---- reader ----
+
+    const T& read(){
+        if(middle.load(std::memory_order_relaxed)&FRESH){
+            front=middle.exchange(front,std::memory_order_acq_rel)&3;
+        }
+        return buffers[front];
+    }
+};
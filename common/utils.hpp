@@ -1,6 +1,7 @@
 #pragma once
 #include <chrono>
 #include <thread>
+#include <cstdint>
 
 // return a monotonically increasing time in seconds (double)
 // using this for tick timing, latency and interpolation
@@ -11,6 +12,14 @@ inline double now_seconds() {
     ).count();
 }
 
+// the same clock in whole nanoseconds, for phase timers that run every tick
+inline uint64_t now_nanos(){
+    using namespace std::chrono;
+    return static_cast<uint64_t>(duration_cast<nanoseconds>(
+        steady_clock::now().time_since_epoch()
+    ).count());
+}
+
 // sleep for a fractional number of seconds (delay)
 inline void sleep_for_seconds(double seconds){
     if(seconds<=0.0) return;
@@ -0,0 +1,142 @@
+#pragma once
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <memory>
+
+// fork-join thread pool with per-worker task queues and work stealing.
+//
+// run_batch() deals a batch of tasks round-robin onto the worker queues and
+// blocks until all of them have run. each worker pops from the back of its
+// own queue and, once that is empty, steals from the front of the others',
+// so a few slow tasks do not leave the rest of the pool idle. the calling
+// thread works on the batch too and counts as worker 0.
+//
+// tasks are a plain function pointer plus argument, and the queues keep
+// their storage between batches, so steady-state batches do not allocate.
+struct PoolTask{
+    void (*fn)(void*)=nullptr;
+    void* arg=nullptr;
+};
+
+struct WorkPool{
+    struct Queue{
+        std::mutex m;
+        std::vector<PoolTask> items;
+        size_t head=0; // items before head were stolen
+    };
+
+    int num_workers=1;
+    std::vector<std::unique_ptr<Queue>> queues;
+    std::vector<std::thread> threads;
+
+    std::mutex wake_mutex;
+    std::condition_variable wake_cv;
+    std::condition_variable done_cv;
+    unsigned generation=0;
+    bool stopping=false;
+    std::atomic<int> pending{0};
+
+    // threads<=0 means one worker per hardware thread
+    explicit WorkPool(int threads=0){
+        if(threads<=0) threads=static_cast<int>(std::thread::hardware_concurrency());
+        if(threads<=0) threads=1;
+        num_workers=threads;
+        for(int i=0;i<num_workers;i++) queues.emplace_back(new Queue);
+        for(int i=1;i<num_workers;i++) this->threads.emplace_back(&WorkPool::worker_loop,this,i);
+    }
+
+    ~WorkPool(){
+        {
+            std::lock_guard<std::mutex> lock(wake_mutex);
+            stopping=true;
+        }
+        wake_cv.notify_all();
+        for(auto& t : threads) t.join();
+    }
+
+    WorkPool(const WorkPool&)=delete;
+    WorkPool& operator=(const WorkPool&)=delete;
+
+    // run every task once, in any order and on any worker. returns when all
+    // have finished. only one thread may call this at a time.
+    void run_batch(const PoolTask* tasks, int n){
+        if(n<=0) return;
+        pending=n;
+        for(int i=0;i<n;i++){
+            Queue& q=*queues[i%num_workers];
+            std::lock_guard<std::mutex> lock(q.m);
+            q.items.push_back(tasks[i]);
+        }
+        {
+            std::lock_guard<std::mutex> lock(wake_mutex);
+            generation++;
+        }
+        wake_cv.notify_all();
+
+        PoolTask t;
+        while(find_task(0,t)) run_task(t);
+
+        std::unique_lock<std::mutex> lock(wake_mutex);
+        done_cv.wait(lock,[&]{ return pending.load()==0; });
+    }
+
+    bool pop_own(int w, PoolTask& t){
+        Queue& q=*queues[w];
+        std::lock_guard<std::mutex> lock(q.m);
+        if(q.items.size()==q.head) return false;
+        t=q.items.back();
+        q.items.pop_back();
+        if(q.items.size()==q.head){
+            q.items.clear();
+            q.head=0;
+        }
+        return true;
+    }
+
+    bool steal(int victim, PoolTask& t){
+        Queue& q=*queues[victim];
+        std::lock_guard<std::mutex> lock(q.m);
+        if(q.items.size()==q.head) return false;
+        t=q.items[q.head++];
+        if(q.items.size()==q.head){
+            q.items.clear();
+            q.head=0;
+        }
+        return true;
+    }
+
+    bool find_task(int w, PoolTask& t){
+        if(pop_own(w,t)) return true;
+        for(int k=1;k<num_workers;k++){
+            if(steal((w+k)%num_workers,t)) return true;
+        }
+        return false;
+    }
+
+    void run_task(const PoolTask& t){
+        t.fn(t.arg);
+        if(pending.fetch_sub(1)==1){
+            std::lock_guard<std::mutex> lock(wake_mutex);
+            done_cv.notify_all();
+        }
+    }
+
+    void worker_loop(int w){
+        unsigned seen=0;
+        while(true){
+            PoolTask t;
+            if(find_task(w,t)){
+                run_task(t);
+                continue;
+            }
+            std::unique_lock<std::mutex> lock(wake_mutex);
+            wake_cv.wait(lock,[&]{ return stopping || generation!=seen; });
+            if(stopping) return;
+            seen=generation;
+        }
+    }
+};
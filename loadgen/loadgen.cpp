@@ -0,0 +1,570 @@
+// headless load generator: opens many bot connections from one process,
+// drives them with scripted or random-walk input and decodes snapshots with
+// the same SnapshotReceiver as the real client.
+//
+// bots are added in steps (--ramp) and each step is measured separately:
+//   - server tick interval, from server_time of consecutive ticks
+//   - snapshots per second per bot; the server picks each bot's rate, so
+//     ticks it skips are not counted as missed
+//   - snapshot inter-arrival jitter, from local receive times
+//   - bytes/s received per bot
+//
+// the server only gives out --players x --rooms slots; bots beyond that sit
+// in its waiting queue and receive nothing, so size the server to match.
+//
+// --slow-readers N first opens N connections with a tiny receive buffer
+// that read only SLOW_READ_BYTES every SLOW_READ_INTERVAL, far slower than
+// the server sends. they take player slots like any bot but are left out of
+// the measurements; with them in place the server's tick interval and the
+// other bots' snapshot rate should look the same as without.
+//
+// --idle N skips the ramp: it opens N connections that never send or read
+// anything and reports how much the server's resident memory grew per
+// connection. the numbers come from the server's stats endpoint, so the
+// server has to run on this machine with --stats-port (given here too).
+// only --players x --rooms of them get a slot, the rest wait in its queue.
+
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <string>
+#include <sstream>
+#include <random>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <cstdlib>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+#include "../common/utils.hpp"
+#include "../common/protocol.hpp"
+#include "../common/snapshot_receiver.hpp"
+#include "../common/stream_framer.hpp"
+
+using std::cout;
+using std::cerr;
+using std::endl;
+
+#define nl "\n"
+
+enum class Pattern{Random,Circle};
+
+struct Bot{
+    int fd=-1;
+    int player_id=0;
+    StreamFramer in{SERVER_STREAM_CAPACITY};
+    SnapshotReceiver receiver;
+
+    int input_seq=0;
+    int dx=0;
+    int dy=0;
+    double next_input_time=0.0;
+    int script_step=0;
+
+    // measurement
+    long bytes=0;
+    long frames=0;
+    double last_recv_time=0.0;
+    int last_tick=-1;
+    double last_server_time=0.0;
+};
+
+// samples collected during one ramp step
+struct StepStats{
+    std::vector<double> tick_intervals;   // server_time per tick, seconds
+    std::vector<double> arrival_intervals; // local time between snapshots
+    std::vector<double> send_intervals;    // server_time between the same two
+    long bytes=0;
+    long frames=0;
+};
+
+std::string g_host="127.0.0.1";
+int g_port=proto::SERVER_PORT;
+Pattern g_pattern=Pattern::Random;
+double g_step_seconds=5.0;
+std::vector<int> g_ramp={10,100,1000};
+
+std::mt19937 g_rng{12345};
+int g_epoll=-1;
+
+constexpr int SLOW_READ_BYTES=128;
+constexpr double SLOW_READ_INTERVAL=0.1;
+constexpr int SLOW_RCVBUF=2048;
+int g_num_slow_readers=0;
+std::vector<int> g_slow_fds;
+double g_next_slow_read=0.0;
+long g_slow_bytes=0;
+
+int g_num_idle=0;
+int g_stats_port=0;
+constexpr double IDLE_ACCEPT_TIMEOUT=30.0;
+
+// bot lines are tiny; a full send buffer means the server stopped reading
+bool send_raw(int fd, const char* data, size_t len){
+    ssize_t n=::send(fd,data,len,MSG_NOSIGNAL);
+    return n==static_cast<ssize_t>(len);
+}
+
+bool send_line(int fd, std::string line){
+    line.push_back('\n');
+    return send_raw(fd,line.data(),line.size());
+}
+
+// INPUT and ACK, formatted on the stack: every bot sends one per snapshot
+bool send_fields(int fd, std::string_view verb, std::initializer_list<int> fields){
+    char buf[64];
+    size_t len=proto::format_line(buf,sizeof(buf),verb,fields);
+    return len>0 && send_raw(fd,buf,len);
+}
+
+// rcvbuf>0 shrinks the receive buffer; it has to be set before connect
+int connect_bot(int rcvbuf=0){
+    int fd=::socket(AF_INET,SOCK_STREAM,0);
+    if(fd<0){
+        cerr<<"socket() failed: "<<std::strerror(errno)<<nl;
+        return -1;
+    }
+    if(rcvbuf>0){
+        setsockopt(fd,SOL_SOCKET,SO_RCVBUF,&rcvbuf,sizeof(rcvbuf));
+    }
+    sockaddr_in addr;
+    std::memset(&addr,0,sizeof(addr));
+    addr.sin_family=AF_INET;
+    addr.sin_port=htons(static_cast<uint16_t>(g_port));
+    if(inet_pton(AF_INET,g_host.c_str(),&addr.sin_addr)<=0){
+        cerr<<"Invalid address: "<<g_host<<nl;
+        ::close(fd);
+        return -1;
+    }
+    if(::connect(fd,(sockaddr*)&addr,sizeof(addr))<0){
+        cerr<<"connect() failed: "<<std::strerror(errno)<<nl;
+        ::close(fd);
+        return -1;
+    }
+    // ACKs time the server's RTT estimate; Nagle would hold them back
+    int nodelay=1;
+    setsockopt(fd,IPPROTO_TCP,TCP_NODELAY,&nodelay,sizeof(nodelay));
+    int flags=fcntl(fd,F_GETFL,0);
+    fcntl(fd,F_SETFL,flags|O_NONBLOCK);
+    return fd;
+}
+
+// pick the next direction: random walk, or round the 8 directions in order
+void next_input(Bot& b, double now){
+    static const int circle_dx[8]={1,1,0,-1,-1,-1,0,1};
+    static const int circle_dy[8]={0,1,1,1,0,-1,-1,-1};
+
+    if(g_pattern==Pattern::Circle){
+        b.dx=circle_dx[b.script_step%8];
+        b.dy=circle_dy[b.script_step%8];
+        b.script_step++;
+        b.next_input_time=now+0.5;
+    }
+    else{
+        std::uniform_int_distribution<int> dir(-1,1);
+        std::uniform_real_distribution<double> hold(0.3,1.5);
+        b.dx=dir(g_rng);
+        b.dy=dir(g_rng);
+        b.next_input_time=now+hold(g_rng);
+    }
+    send_fields(b.fd,"INPUT",{b.input_seq++,b.dx,b.dy});
+}
+
+void on_snapshot(Bot& b, const proto::worldSnapshot& s, double now, StepStats* st){
+    b.frames++;
+    if(st){
+        st->frames++;
+        if(b.last_tick>=0 && s.tick>b.last_tick){
+            int gap=s.tick-b.last_tick;
+            st->tick_intervals.push_back((s.server_time-b.last_server_time)/gap);
+            st->arrival_intervals.push_back(now-b.last_recv_time);
+            st->send_intervals.push_back(s.server_time-b.last_server_time);
+        }
+    }
+    b.last_tick=s.tick;
+    b.last_server_time=s.server_time;
+    b.last_recv_time=now;
+}
+
+// parse everything buffered for b
+void process_input(Bot& b, double now, StepStats* st){
+    StreamFramer::Frame f;
+    while(b.in.next(f)){
+        if(f.binary){
+            proto::worldSnapshot s;
+            bool fresh=false;
+            if(b.receiver.on_frame(reinterpret_cast<const uint8_t*>(f.data.data()),f.data.size(),s,fresh)){
+                send_fields(b.fd,"ACK",{s.tick});
+                if(fresh) on_snapshot(b,s,now,st);
+            }
+            continue;
+        }
+
+        if(f.data.rfind("WELCOME",0)==0){
+            proto::FieldReader fields(f.data);
+            if(!(fields.skip() && fields.read(b.player_id))) b.player_id=0;
+        }
+        else if(f.data.rfind("STATE",0)==0){
+            proto::worldSnapshot s;
+            if(proto::decode_state(f.data,s,b.receiver.coins)){
+                on_snapshot(b,s,now,st);
+            }
+        }
+    }
+}
+
+// take a trickle from each slow reader; whatever it is gets thrown away
+void read_slow(double now){
+    if(now<g_next_slow_read) return;
+    g_next_slow_read=now+SLOW_READ_INTERVAL;
+    char buf[SLOW_READ_BYTES];
+    for(int fd : g_slow_fds){
+        ssize_t got=::recv(fd,buf,sizeof(buf),0);
+        if(got>0) g_slow_bytes+=got;
+    }
+}
+
+// run every bot for seconds; samples go to st when it is not null
+bool run_bots(std::vector<Bot>& bots, double seconds, StepStats* st){
+    std::vector<epoll_event> events(1024);
+    double end=now_seconds()+seconds;
+
+    while(true){
+        double now=now_seconds();
+        if(now>=end) break;
+        read_slow(now);
+
+        for(auto& b : bots){
+            if(b.player_id>0 && now>=b.next_input_time) next_input(b,now);
+        }
+
+        int n=epoll_wait(g_epoll,events.data(),static_cast<int>(events.size()),5);
+        if(n<0){
+            if(errno==EINTR) continue;
+            cerr<<"epoll_wait() failed: "<<std::strerror(errno)<<nl;
+            return false;
+        }
+        now=now_seconds();
+        for(int i=0;i<n;i++){
+            Bot& b=bots[events[i].data.u32];
+            while(true){
+                ssize_t got=b.in.fill(b.fd);
+                if(got>0){
+                    b.bytes+=got;
+                    if(st) st->bytes+=got;
+                    process_input(b,now,st);
+                    continue;
+                }
+                if(got==0){
+                    cerr<<"Server closed bot connection; stopping.\n";
+                    return false;
+                }
+                if(errno==EINTR) continue;
+                if(errno!=EAGAIN && errno!=EWOULDBLOCK){
+                    cerr<<"recv() failed: "<<std::strerror(errno)<<nl;
+                    return false;
+                }
+                break;
+            }
+        }
+    }
+    return true;
+}
+
+// ---- idle connections ----
+
+// rss_bytes and tcp_connections from the server's stats endpoint
+bool read_server_stats(long& rss, long& connections){
+    int fd=::socket(AF_INET,SOCK_STREAM,0);
+    if(fd<0) return false;
+    sockaddr_in addr;
+    std::memset(&addr,0,sizeof(addr));
+    addr.sin_family=AF_INET;
+    addr.sin_addr.s_addr=htonl(INADDR_LOOPBACK);
+    addr.sin_port=htons(static_cast<uint16_t>(g_stats_port));
+    if(::connect(fd,(sockaddr*)&addr,sizeof(addr))<0){
+        cerr<<"stats port "<<g_stats_port<<": "<<std::strerror(errno)<<nl;
+        ::close(fd);
+        return false;
+    }
+    std::string text;
+    char buf[4096];
+    ssize_t n;
+    while((n=::recv(fd,buf,sizeof(buf),0))>0) text.append(buf,static_cast<size_t>(n));
+    ::close(fd);
+
+    rss=-1;
+    connections=-1;
+    std::istringstream lines(text);
+    std::string line;
+    while(std::getline(lines,line)){
+        proto::FieldReader f(line);
+        std::string_view name=f.word();
+        if(name=="rss_bytes") f.read(rss);
+        else if(name=="tcp_connections") f.read(connections);
+    }
+    if(rss<=0 || connections<0){
+        cerr<<"stats port "<<g_stats_port<<" did not report rss_bytes and tcp_connections\n";
+        return false;
+    }
+    return true;
+}
+
+// open g_num_idle silent connections and report the server's memory per
+// connection once it has accepted all of them
+int run_idle(){
+    long rss_before,conns_before;
+    if(!read_server_stats(rss_before,conns_before)) return 1;
+
+    std::vector<int> fds;
+    fds.reserve(static_cast<size_t>(g_num_idle));
+    for(int i=0;i<g_num_idle;i++){
+        int fd=connect_bot();
+        if(fd<0){
+            cerr<<"Could not open idle connection "<<i+1<<" (check ulimit -n); stopping.\n";
+            for(int f : fds) ::close(f);
+            return 1;
+        }
+        fds.push_back(fd);
+    }
+
+    long rss=0,conns=0;
+    double give_up=now_seconds()+IDLE_ACCEPT_TIMEOUT;
+    while(true){
+        if(!read_server_stats(rss,conns)) break;
+        if(conns>=conns_before+g_num_idle || now_seconds()>give_up) break;
+        sleep_for_seconds(0.2);
+    }
+    int ok=1;
+    if(rss>0){
+        long opened=conns-conns_before;
+        cout<<"idle connections: "<<opened<<" of "<<g_num_idle<<" accepted"<<nl;
+        cout<<"server rss: "<<rss_before/1024<<" KiB before, "<<rss/1024<<" KiB after"<<nl;
+        if(opened>0){
+            cout<<"bytes per connection: "<<(rss-rss_before)/opened<<nl;
+            ok=0;
+        }
+    }
+    for(int fd : fds) ::close(fd);
+    return ok;
+}
+
+double percentile(std::vector<double>& v, double p){
+    if(v.empty()) return 0.0;
+    size_t k=static_cast<size_t>(p*(v.size()-1));
+    std::nth_element(v.begin(),v.begin()+k,v.end());
+    return v[k];
+}
+
+void mean_stddev(const std::vector<double>& v, double& mean, double& stddev){
+    mean=0.0;
+    stddev=0.0;
+    if(v.empty()) return;
+    for(double x : v) mean+=x;
+    mean/=v.size();
+    for(double x : v) stddev+=(x-mean)*(x-mean);
+    stddev=std::sqrt(stddev/v.size());
+}
+
+void print_header(){
+    cout<<std::left<<std::setw(7)<<"bots"
+        <<std::setw(8)<<"active"
+        <<std::setw(11)<<"tick ms"
+        <<std::setw(11)<<"tick sd"
+        <<std::setw(11)<<"tick p99"
+        <<std::setw(9)<<"snap/s"
+        <<std::setw(12)<<"jitter sd"
+        <<std::setw(12)<<"jitter p99"
+        <<"B/s per bot"<<nl;
+}
+
+void print_step(int bots, int active, StepStats& st){
+    double tick_mean,tick_sd,arr_mean,arr_sd;
+    mean_stddev(st.tick_intervals,tick_mean,tick_sd);
+    mean_stddev(st.arrival_intervals,arr_mean,arr_sd);
+    double tick_p99=percentile(st.tick_intervals,0.99);
+
+    // jitter: how far each inter-arrival time strays from the server time
+    // between the same two snapshots
+    std::vector<double> deviation;
+    deviation.reserve(st.arrival_intervals.size());
+    for(size_t i=0;i<st.arrival_intervals.size();i++){
+        deviation.push_back(std::fabs(st.arrival_intervals[i]-st.send_intervals[i]));
+    }
+    double jitter_p99=percentile(deviation,0.99);
+
+    double bytes_per_bot=active>0 ? st.bytes/g_step_seconds/active : 0.0;
+
+    cout<<std::left<<std::setw(7)<<bots
+        <<std::setw(8)<<active
+        <<std::fixed<<std::setprecision(2)
+        <<std::setw(11)<<tick_mean*1e3
+        <<std::setw(11)<<tick_sd*1e3
+        <<std::setw(11)<<tick_p99*1e3
+        <<std::setw(9)<<std::setprecision(1)<<(active>0 ? st.frames/g_step_seconds/active : 0.0)
+        <<std::setprecision(2)
+        <<std::setw(12)<<arr_sd*1e3
+        <<std::setw(12)<<jitter_p99*1e3
+        <<std::setprecision(0)<<bytes_per_bot<<nl;
+}
+
+std::vector<int> parse_ramp(const std::string& arg){
+    std::vector<int> ramp;
+    std::istringstream iss(arg);
+    std::string item;
+    while(std::getline(iss,item,',')){
+        int n=std::atoi(item.c_str());
+        if(n<=0 || (!ramp.empty() && n<=ramp.back())) return {};
+        ramp.push_back(n);
+    }
+    return ramp;
+}
+
+int main(int argc, char** argv){
+    for(int i=1;i<argc;i++){
+        std::string arg=argv[i];
+        if(arg=="--ramp" && i+1<argc){
+            g_ramp=parse_ramp(argv[++i]);
+            if(g_ramp.empty()){
+                cerr<<"--ramp takes increasing bot counts, e.g. 10,100,1000\n";
+                return 1;
+            }
+        }
+        else if(arg=="--duration" && i+1<argc){
+            g_step_seconds=std::atof(argv[++i]);
+            if(g_step_seconds<=0.0){
+                cerr<<"--duration must be positive\n";
+                return 1;
+            }
+        }
+        else if(arg=="--pattern" && i+1<argc){
+            std::string p=argv[++i];
+            if(p=="random") g_pattern=Pattern::Random;
+            else if(p=="circle") g_pattern=Pattern::Circle;
+            else{
+                cerr<<"--pattern must be random or circle\n";
+                return 1;
+            }
+        }
+        else if(arg=="--slow-readers" && i+1<argc){
+            g_num_slow_readers=std::atoi(argv[++i]);
+            if(g_num_slow_readers<0){
+                cerr<<"--slow-readers must not be negative\n";
+                return 1;
+            }
+        }
+        else if(arg=="--idle" && i+1<argc){
+            g_num_idle=std::atoi(argv[++i]);
+            if(g_num_idle<=0){
+                cerr<<"--idle must be positive\n";
+                return 1;
+            }
+        }
+        else if(arg=="--stats-port" && i+1<argc){
+            g_stats_port=std::atoi(argv[++i]);
+            if(g_stats_port<1 || g_stats_port>65535){
+                cerr<<"--stats-port must be between 1 and 65535\n";
+                return 1;
+            }
+        }
+        else if(arg=="--port" && i+1<argc){
+            g_port=std::atoi(argv[++i]);
+            if(g_port<1 || g_port>65535){
+                cerr<<"--port must be between 1 and 65535\n";
+                return 1;
+            }
+        }
+        else if(arg[0]!='-'){
+            g_host=arg;
+        }
+        else{
+            cerr<<"Unknown option: "<<arg<<nl;
+            cerr<<"Usage: loadgen [--ramp N,N,...] [--duration S] [--pattern random|circle]"
+                  " [--slow-readers N] [--idle N --stats-port PORT] [--port PORT] [SERVER_IP]\n";
+            return 1;
+        }
+    }
+
+    if(g_num_idle>0){
+        if(g_stats_port==0){
+            cerr<<"--idle reads the server's memory from its stats endpoint; give its --stats-port\n";
+            return 1;
+        }
+        cout<<"loadgen: "<<g_host<<":"<<g_port<<", "<<g_num_idle<<" idle connections"<<nl;
+        return run_idle();
+    }
+
+    g_epoll=epoll_create1(0);
+    if(g_epoll<0){
+        cerr<<"epoll_create1() failed: "<<std::strerror(errno)<<endl;
+        return 1;
+    }
+
+    // bots never move in memory once connected (epoll refers to them by index)
+    std::vector<Bot> bots;
+    bots.reserve(g_ramp.back());
+
+    cout<<"loadgen: "<<g_host<<":"<<g_port<<", "<<g_step_seconds
+        <<" s per step, "<<(g_pattern==Pattern::Random ? "random walk" : "circle")<<" input"<<nl;
+
+    for(int i=0;i<g_num_slow_readers;i++){
+        int fd=connect_bot(SLOW_RCVBUF);
+        if(fd<0){
+            cerr<<"Could not connect slow reader "<<i+1<<"; stopping.\n";
+            return 1;
+        }
+        send_line(fd,"JOIN slow");
+        g_slow_fds.push_back(fd);
+    }
+    if(g_num_slow_readers>0){
+        cout<<g_num_slow_readers<<" slow readers, "
+            <<static_cast<int>(SLOW_READ_BYTES/SLOW_READ_INTERVAL)<<" B/s each"<<nl;
+    }
+    print_header();
+
+    for(int target : g_ramp){
+        while(static_cast<int>(bots.size())<target){
+            int fd=connect_bot();
+            if(fd<0){
+                cerr<<"Could not connect bot "<<bots.size()+1<<" (check ulimit -n); stopping.\n";
+                return 1;
+            }
+            bots.emplace_back();
+            Bot& b=bots.back();
+            b.fd=fd;
+
+            epoll_event ev{};
+            ev.events=EPOLLIN;
+            ev.data.u32=static_cast<uint32_t>(bots.size()-1);
+            epoll_ctl(g_epoll,EPOLL_CTL_ADD,fd,&ev);
+            send_line(fd,"JOIN bot");
+        }
+
+        // let new bots get a slot and a keyframe before measuring
+        if(!run_bots(bots,1.0,nullptr)) return 1;
+
+        StepStats st;
+        if(!run_bots(bots,g_step_seconds,&st)) return 1;
+
+        int active=0;
+        for(const auto& b : bots){
+            if(b.player_id>0) active++;
+        }
+        print_step(target,active,st);
+    }
+
+    if(g_num_slow_readers>0){
+        cout<<"slow readers took "<<g_slow_bytes<<" bytes in total"<<nl;
+    }
+    for(auto& b : bots) ::close(b.fd);
+    for(int fd : g_slow_fds) ::close(fd);
+    ::close(g_epoll);
+    return 0;
+}
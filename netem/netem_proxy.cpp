@@ -0,0 +1,736 @@
+// network-conditioning proxy for local testing: sits between clients and the
+// server and makes localhost look like a real link. every read from a TCP
+// connection and every UDP datagram is held for a delay drawn from a
+// distribution, may be lost or reordered (UDP only) and is paced to a
+// bandwidth cap, for each direction separately:
+//
+//   server --port 40001
+//   netem-proxy --to 127.0.0.1:40001 --delay 50 --jitter 10 --down-loss 2
+//   client 127.0.0.1
+//
+// the proxy listens for TCP and UDP on the same port (--listen, default
+// the server's usual one), so clients need no changes. options apply to
+// both directions; --up-X only to client->server and --down-X only to
+// server->client. every TCP connection and every UDP client address gets
+// its own pair of links, so a bandwidth cap is per client.
+//
+// a TCP connection is a byte stream: its data can only be delayed and
+// paced, and comes out in the order it went in. when a link holds more
+// than LINK_QUEUE_LIMIT of backlog the proxy stops reading from that side,
+// which is what a slow line does to a TCP sender. UDP datagrams beyond the
+// backlog are dropped instead.
+
+#include <iostream>
+#include <vector>
+#include <string>
+#include <queue>
+#include <unordered_map>
+#include <random>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <cstdlib>
+#include <cstdint>
+#include <csignal>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+#include "../common/utils.hpp"
+#include "../common/protocol.hpp"
+
+using std::cout;
+using std::cerr;
+using std::endl;
+
+#define nl "\n"
+
+// ---- link model ----
+
+enum class Dist{
+    Constant, // always delay
+    Uniform,  // delay +- jitter
+    Normal,   // mean delay, standard deviation jitter
+    Pareto    // delay plus a long-tailed extra that averages jitter
+};
+
+struct LinkParams{
+    double delay=0.0;   // seconds
+    double jitter=0.0;  // seconds
+    Dist dist=Dist::Uniform;
+    double loss=0.0;    // probability, UDP only
+    double reorder=0.0; // probability a datagram skips the delay, UDP only
+    double rate=0.0;    // bytes per second, 0: unlimited
+};
+
+enum{ UP=0, DOWN=1 }; // client->server, server->client
+
+LinkParams g_params[2];
+
+// most backlog a capped link holds before UDP drops and TCP stops reading
+constexpr double LINK_QUEUE_LIMIT=0.5; // seconds at the link's rate
+// the same for uncapped TCP links, in bytes
+constexpr size_t UNCAPPED_QUEUE_BYTES=4*1024*1024;
+
+// a UDP client that sends nothing for this long loses its upstream socket
+constexpr double UDP_SESSION_TIMEOUT=30.0;
+
+constexpr double STATS_INTERVAL=5.0;
+
+std::mt19937 g_rng;
+
+struct LinkStats{
+    uint64_t packets=0;
+    uint64_t bytes=0;
+    uint64_t lost=0;
+    uint64_t reordered=0;
+    uint64_t overflow=0; // UDP datagrams dropped for a full queue
+};
+LinkStats g_stats[2];
+
+double uniform01(){
+    return std::uniform_real_distribution<double>(0.0,1.0)(g_rng);
+}
+
+double sample_delay(const LinkParams& p){
+    double d=p.delay;
+    switch(p.dist){
+    case Dist::Constant:
+        break;
+    case Dist::Uniform:
+        d+=std::uniform_real_distribution<double>(-p.jitter,p.jitter)(g_rng);
+        break;
+    case Dist::Normal:
+        if(p.jitter>0.0) d=std::normal_distribution<double>(p.delay,p.jitter)(g_rng);
+        break;
+    case Dist::Pareto:
+        // shape 3: the extra has mean jitter/2 before the doubling
+        d+=2.0*p.jitter*(std::pow(1.0-uniform01(),-1.0/3.0)-1.0);
+        break;
+    }
+    return std::max(d,0.0);
+}
+
+// one direction of one client's link
+struct Link{
+    int dir=UP;
+    double busy_until=0.0;   // when everything admitted so far is on the wire
+    double last_release=0.0; // TCP: keeps the stream in order
+    size_t queued=0;         // bytes admitted and not written out yet
+
+    // when a packet of len bytes arriving now comes out, or <0 if it is
+    // dropped. stream packets are never lost or reordered.
+    double admit(size_t len, double now, bool stream){
+        const LinkParams& p=g_params[dir];
+        LinkStats& st=g_stats[dir];
+        if(!stream && p.loss>0.0 && uniform01()<p.loss){
+            st.lost++;
+            return -1.0;
+        }
+
+        double sent=now;
+        if(p.rate>0.0){
+            double start=std::max(now,busy_until);
+            if(!stream && start-now>LINK_QUEUE_LIMIT){
+                st.overflow++;
+                return -1.0;
+            }
+            busy_until=start+static_cast<double>(len)/p.rate;
+            sent=busy_until;
+        }
+
+        double at;
+        if(!stream && p.reorder>0.0 && uniform01()<p.reorder){
+            at=sent;
+            st.reordered++;
+        }
+        else{
+            at=sent+sample_delay(p);
+        }
+        if(stream){
+            at=std::max(at,last_release);
+            last_release=at;
+        }
+
+        st.packets++;
+        st.bytes+=len;
+        queued+=len;
+        return at;
+    }
+
+    // TCP: stop reading the sending side while this is over
+    size_t queue_cap() const{
+        const LinkParams& p=g_params[dir];
+        if(p.rate<=0.0) return UNCAPPED_QUEUE_BYTES;
+        return std::max(static_cast<size_t>(p.rate*LINK_QUEUE_LIMIT),size_t(64*1024));
+    }
+};
+
+// ---- sessions ----
+
+// one proxied TCP connection. side UP is the client's socket (read for the
+// up link), side DOWN the server's.
+struct TcpSession{
+    int fd[2]={-1,-1};   // [UP]=client, [DOWN]=server
+    Link link[2];        // [UP] carries client->server
+    std::string out[2];  // bytes link dir released, not yet written to the other side
+    bool eof[2]={false,false};    // fd[side] has been read to its end
+    bool closed[2]={false,false}; // link dir has released its sender's close
+    bool shut[2]={false,false};   // ...and passed it on: fd[peer(dir)] is shut for writing
+    bool watched[2]={true,true};  // fd[side] is still in the epoll set
+    uint32_t events[2]={0,0};
+};
+
+// one UDP client address and the socket it talks to the server through
+struct UdpSession{
+    sockaddr_in client{};
+    int upstream=-1;
+    Link link[2];
+    double last_seen=0.0;
+};
+
+// a packet held back until its release time
+struct Pending{
+    double at=0.0;
+    uint64_t order=0; // breaks ties in arrival order
+    uint64_t session=0;
+    int dir=UP;
+    bool udp=false;
+    bool close=false; // TCP: the sender closed; passed on once everything before it is out
+    std::vector<uint8_t> data;
+};
+
+struct PendingLater{
+    bool operator()(const Pending& a, const Pending& b) const{
+        if(a.at!=b.at) return a.at>b.at;
+        return a.order>b.order;
+    }
+};
+
+std::priority_queue<Pending,std::vector<Pending>,PendingLater> g_pending;
+uint64_t g_next_order=0;
+
+std::unordered_map<uint64_t,TcpSession> g_tcp;
+std::unordered_map<uint64_t,UdpSession> g_udp;
+uint64_t g_next_session=1;
+
+// what an epoll event belongs to
+constexpr uint64_t TAG_TCP_LISTEN=0;
+constexpr uint64_t TAG_UDP_LISTEN=1;
+constexpr uint64_t TAG_TIMER=2;
+// otherwise session<<2 | kind, kind 0/1: TCP side UP/DOWN, kind 2: UDP upstream
+constexpr uint64_t KIND_UDP_UPSTREAM=2;
+
+int g_epoll=-1;
+int g_udp_listen=-1;
+sockaddr_in g_server_addr{};
+
+std::unordered_map<uint64_t,uint64_t> g_udp_by_addr; // address key -> session
+
+volatile std::sig_atomic_t g_stop=0;
+
+void on_signal(int){ g_stop=1; }
+
+bool set_nonblocking(int fd){
+    int flags=fcntl(fd,F_GETFL,0);
+    return flags>=0 && fcntl(fd,F_SETFL,flags|O_NONBLOCK)==0;
+}
+
+uint64_t addr_key(const sockaddr_in& a){
+    return (static_cast<uint64_t>(a.sin_addr.s_addr)<<16)|a.sin_port;
+}
+
+void queue_packet(double at, uint64_t session, int dir, bool udp, const uint8_t* data, size_t len){
+    Pending p;
+    p.at=at;
+    p.order=g_next_order++;
+    p.session=session;
+    p.dir=dir;
+    p.udp=udp;
+    p.data.assign(data,data+len);
+    g_pending.push(std::move(p));
+}
+
+// ---- TCP ----
+
+// the link that fd[side] feeds, and the side that link is written to
+inline int peer(int side){ return side^1; }
+
+void set_events(TcpSession& s, uint64_t id, int side){
+    if(!s.watched[side]) return;
+    if(s.eof[side] && s.shut[peer(side)]){
+        // nothing more to read from or write to this socket. a socket closed
+        // both ways reports EPOLLHUP on every wait, so stop watching it.
+        epoll_ctl(g_epoll,EPOLL_CTL_DEL,s.fd[side],nullptr);
+        s.watched[side]=false;
+        return;
+    }
+    Link& feeds=s.link[side];
+    uint32_t want=0;
+    if(!s.eof[side] && feeds.queued<feeds.queue_cap()) want|=EPOLLIN;
+    if(!s.out[peer(side)].empty()) want|=EPOLLOUT; // bytes for this socket
+    if(want==s.events[side]) return;
+    s.events[side]=want;
+    epoll_event ev{};
+    ev.events=want;
+    ev.data.u64=(id<<2)|static_cast<uint64_t>(side);
+    epoll_ctl(g_epoll,EPOLL_CTL_MOD,s.fd[side],&ev);
+}
+
+void close_tcp(uint64_t id){
+    auto it=g_tcp.find(id);
+    if(it==g_tcp.end()) return;
+    for(int fd : it->second.fd){
+        if(fd<0) continue;
+        epoll_ctl(g_epoll,EPOLL_CTL_DEL,fd,nullptr);
+        ::close(fd);
+    }
+    g_tcp.erase(it);
+}
+
+// write what link dir has released to its destination, fd[peer(dir)], and
+// once its sender's close has come out and everything before it is
+// written, pass the close on by shutting fd[peer(dir)] for writing. false
+// once the connection is over: it broke, or both directions are closed.
+bool flush_tcp(TcpSession& s, uint64_t id, int dir){
+    std::string& buf=s.out[dir];
+    int fd=s.fd[peer(dir)];
+    while(!buf.empty()){
+        ssize_t n=::send(fd,buf.data(),buf.size(),MSG_NOSIGNAL);
+        if(n<0){
+            if(errno==EINTR) continue;
+            if(errno==EAGAIN || errno==EWOULDBLOCK) break;
+            return false;
+        }
+        buf.erase(0,static_cast<size_t>(n));
+        s.link[dir].queued-=static_cast<size_t>(n);
+    }
+    if(buf.empty() && s.closed[dir] && !s.shut[dir]){
+        ::shutdown(fd,SHUT_WR);
+        s.shut[dir]=true;
+    }
+    set_events(s,id,dir);
+    set_events(s,id,peer(dir));
+    return !(s.shut[UP] && s.shut[DOWN]);
+}
+
+void accept_tcp(int listen_fd){
+    while(true){
+        int client=::accept(listen_fd,nullptr,nullptr);
+        if(client<0){
+            if(errno!=EAGAIN && errno!=EWOULDBLOCK && errno!=EINTR){
+                cerr<<"accept() failed: "<<std::strerror(errno)<<nl;
+            }
+            return;
+        }
+
+        // a local connect, so waiting for it here is fine
+        int server=::socket(AF_INET,SOCK_STREAM,0);
+        if(server<0 || ::connect(server,(const sockaddr*)&g_server_addr,sizeof(g_server_addr))<0){
+            cerr<<"cannot reach the server: "<<std::strerror(errno)<<nl;
+            if(server>=0) ::close(server);
+            ::close(client);
+            continue;
+        }
+
+        uint64_t id=g_next_session++;
+        TcpSession& s=g_tcp[id];
+        s.fd[UP]=client;
+        s.fd[DOWN]=server;
+        for(int side=UP;side<=DOWN;side++){
+            set_nonblocking(s.fd[side]);
+            // the delay is ours to add; Nagle would only add more
+            int nodelay=1;
+            setsockopt(s.fd[side],IPPROTO_TCP,TCP_NODELAY,&nodelay,sizeof(nodelay));
+            s.link[side].dir=side;
+            s.events[side]=EPOLLIN;
+            epoll_event ev{};
+            ev.events=EPOLLIN;
+            ev.data.u64=(id<<2)|static_cast<uint64_t>(side);
+            epoll_ctl(g_epoll,EPOLL_CTL_ADD,s.fd[side],&ev);
+        }
+    }
+}
+
+// read what fd[side] has into its link
+void read_tcp(uint64_t id, int side, double now){
+    auto it=g_tcp.find(id);
+    if(it==g_tcp.end()) return;
+    TcpSession& s=it->second;
+    Link& link=s.link[side];
+
+    uint8_t buf[16384];
+    while(!s.eof[side] && link.queued<link.queue_cap()){
+        ssize_t n=::recv(s.fd[side],buf,sizeof(buf),0);
+        if(n<0){
+            if(errno==EINTR) continue;
+            if(errno==EAGAIN || errno==EWOULDBLOCK) break;
+            n=0; // a reset ends the connection like a close
+        }
+        if(n==0){
+            // the close travels behind the data and is passed on as a
+            // half-close, see flush_tcp
+            s.eof[side]=true;
+            Pending p;
+            p.at=std::max(now,link.last_release);
+            p.order=g_next_order++;
+            p.session=id;
+            p.dir=side;
+            p.close=true;
+            g_pending.push(std::move(p));
+            break;
+        }
+        double at=link.admit(static_cast<size_t>(n),now,true);
+        queue_packet(at,id,side,false,buf,static_cast<size_t>(n));
+    }
+    set_events(s,id,side);
+}
+
+void release_tcp(Pending& p){
+    auto it=g_tcp.find(p.session);
+    if(it==g_tcp.end()) return;
+    TcpSession& s=it->second;
+    // the close comes out behind all of its direction's data; the other
+    // direction keeps going until its own close
+    if(p.close) s.closed[p.dir]=true;
+    else s.out[p.dir].append(reinterpret_cast<const char*>(p.data.data()),p.data.size());
+    if(!flush_tcp(s,p.session,p.dir)) close_tcp(p.session);
+}
+
+// ---- UDP ----
+
+void read_udp_client(double now){
+    uint8_t buf[proto::UDP_MAX_PACKET];
+    while(true){
+        sockaddr_in from;
+        socklen_t from_len=sizeof(from);
+        ssize_t n=::recvfrom(g_udp_listen,buf,sizeof(buf),0,(sockaddr*)&from,&from_len);
+        if(n<0){
+            if(errno==EINTR) continue;
+            return;
+        }
+
+        uint64_t key=addr_key(from);
+        auto found=g_udp_by_addr.find(key);
+        uint64_t id;
+        if(found==g_udp_by_addr.end()){
+            int up=::socket(AF_INET,SOCK_DGRAM,0);
+            if(up<0 || ::connect(up,(const sockaddr*)&g_server_addr,sizeof(g_server_addr))<0){
+                cerr<<"cannot open a UDP socket to the server: "<<std::strerror(errno)<<nl;
+                if(up>=0) ::close(up);
+                continue;
+            }
+            set_nonblocking(up);
+            id=g_next_session++;
+            UdpSession& s=g_udp[id];
+            s.client=from;
+            s.upstream=up;
+            s.link[UP].dir=UP;
+            s.link[DOWN].dir=DOWN;
+            g_udp_by_addr[key]=id;
+
+            epoll_event ev{};
+            ev.events=EPOLLIN;
+            ev.data.u64=(id<<2)|KIND_UDP_UPSTREAM;
+            epoll_ctl(g_epoll,EPOLL_CTL_ADD,up,&ev);
+        }
+        else{
+            id=found->second;
+        }
+
+        UdpSession& s=g_udp[id];
+        s.last_seen=now;
+        double at=s.link[UP].admit(static_cast<size_t>(n),now,false);
+        if(at>=0.0) queue_packet(at,id,UP,true,buf,static_cast<size_t>(n));
+    }
+}
+
+void read_udp_server(uint64_t id, double now){
+    auto it=g_udp.find(id);
+    if(it==g_udp.end()) return;
+    UdpSession& s=it->second;
+    uint8_t buf[proto::UDP_MAX_PACKET];
+    while(true){
+        ssize_t n=::recv(s.upstream,buf,sizeof(buf),0);
+        if(n<0){
+            if(errno==EINTR) continue;
+            return; // EAGAIN, or ICMP refused while the server is down
+        }
+        double at=s.link[DOWN].admit(static_cast<size_t>(n),now,false);
+        if(at>=0.0) queue_packet(at,id,DOWN,true,buf,static_cast<size_t>(n));
+    }
+}
+
+void release_udp(const Pending& p){
+    auto it=g_udp.find(p.session);
+    if(it==g_udp.end()) return;
+    UdpSession& s=it->second;
+    s.link[p.dir].queued-=p.data.size();
+    if(p.dir==UP){
+        ::send(s.upstream,p.data.data(),p.data.size(),0);
+    }
+    else{
+        ::sendto(g_udp_listen,p.data.data(),p.data.size(),0,(const sockaddr*)&s.client,sizeof(s.client));
+    }
+}
+
+void expire_udp(double now){
+    for(auto it=g_udp.begin();it!=g_udp.end();){
+        if(now-it->second.last_seen<UDP_SESSION_TIMEOUT){
+            ++it;
+            continue;
+        }
+        epoll_ctl(g_epoll,EPOLL_CTL_DEL,it->second.upstream,nullptr);
+        ::close(it->second.upstream);
+        g_udp_by_addr.erase(addr_key(it->second.client));
+        it=g_udp.erase(it);
+    }
+}
+
+// ---- setup ----
+
+// arm timer_fd for the earliest held packet, or disarm it
+void arm_timer(int timer_fd){
+    itimerspec spec{};
+    if(!g_pending.empty()){
+        // now_seconds is CLOCK_MONOTONIC, like the timer
+        double at=std::max(g_pending.top().at,1e-9);
+        spec.it_value.tv_sec=static_cast<time_t>(at);
+        spec.it_value.tv_nsec=static_cast<long>((at-std::floor(at))*1e9);
+        if(spec.it_value.tv_sec==0 && spec.it_value.tv_nsec==0) spec.it_value.tv_nsec=1;
+    }
+    timerfd_settime(timer_fd,TFD_TIMER_ABSTIME,&spec,nullptr);
+}
+
+void print_stats(){
+    static const char* names[2]={"up  ","down"};
+    for(int dir=UP;dir<=DOWN;dir++){
+        const LinkStats& st=g_stats[dir];
+        cout<<"[netem] "<<names[dir]<<" "<<st.packets<<" packets, "<<st.bytes<<" bytes, "
+            <<st.lost<<" lost, "<<st.reordered<<" reordered, "<<st.overflow<<" dropped on a full queue"<<nl;
+    }
+    cout<<"[netem] "<<g_tcp.size()<<" TCP connections, "<<g_udp.size()<<" UDP clients, "
+        <<g_pending.size()<<" packets in flight"<<nl;
+}
+
+bool parse_dist(const std::string& name, Dist& out){
+    if(name=="constant") out=Dist::Constant;
+    else if(name=="uniform") out=Dist::Uniform;
+    else if(name=="normal") out=Dist::Normal;
+    else if(name=="pareto") out=Dist::Pareto;
+    else return false;
+    return true;
+}
+
+// --delay, --jitter, --dist, --loss, --reorder, --rate, for one link
+bool parse_link_option(const std::string& name, const char* value, LinkParams& p){
+    double v=std::atof(value);
+    if(name=="delay") p.delay=v/1000.0;
+    else if(name=="jitter") p.jitter=v/1000.0;
+    else if(name=="loss") p.loss=v/100.0;
+    else if(name=="reorder") p.reorder=v/100.0;
+    else if(name=="rate") p.rate=v*1000.0/8.0;
+    else if(name=="dist") return parse_dist(value,p.dist);
+    else return false;
+    return v>=0.0 && p.loss<=1.0 && p.reorder<=1.0;
+}
+
+void usage(){
+    cerr<<"Usage: netem-proxy [--listen PORT] [--to HOST:PORT] [--seed N]\n"
+          "                   [--[up-|down-]delay MS] [--[up-|down-]jitter MS]\n"
+          "                   [--[up-|down-]dist constant|uniform|normal|pareto]\n"
+          "                   [--[up-|down-]loss PCT] [--[up-|down-]reorder PCT]\n"
+          "                   [--[up-|down-]rate KBIT]\n"
+          "up is client->server, down server->client; without a prefix both.\n";
+}
+
+int open_listener(int type, int port){
+    int fd=::socket(AF_INET,type,0);
+    if(fd<0) return -1;
+    int opt=1;
+    setsockopt(fd,SOL_SOCKET,SO_REUSEADDR,&opt,sizeof(opt));
+    sockaddr_in addr;
+    std::memset(&addr,0,sizeof(addr));
+    addr.sin_family=AF_INET;
+    addr.sin_addr.s_addr=htonl(INADDR_ANY);
+    addr.sin_port=htons(static_cast<uint16_t>(port));
+    if(bind(fd,(sockaddr*)&addr,sizeof(addr))<0 ||
+       (type==SOCK_STREAM && listen(fd,SOMAXCONN)<0)){
+        ::close(fd);
+        return -1;
+    }
+    set_nonblocking(fd);
+    return fd;
+}
+
+int main(int argc, char** argv){
+    int listen_port=proto::SERVER_PORT;
+    std::string target="127.0.0.1:"+std::to_string(proto::SERVER_PORT+1);
+    uint32_t seed=std::random_device{}();
+
+    for(int i=1;i<argc;i++){
+        std::string arg=argv[i];
+        if(arg=="--listen" && i+1<argc){
+            listen_port=std::atoi(argv[++i]);
+        }
+        else if(arg=="--to" && i+1<argc){
+            target=argv[++i];
+        }
+        else if(arg=="--seed" && i+1<argc){
+            seed=static_cast<uint32_t>(std::strtoul(argv[++i],nullptr,10));
+        }
+        else if(arg.rfind("--",0)==0 && i+1<argc){
+            std::string name=arg.substr(2);
+            const char* value=argv[++i];
+            bool ok;
+            if(name.rfind("up-",0)==0) ok=parse_link_option(name.substr(3),value,g_params[UP]);
+            else if(name.rfind("down-",0)==0) ok=parse_link_option(name.substr(5),value,g_params[DOWN]);
+            else ok=parse_link_option(name,value,g_params[UP]) && parse_link_option(name,value,g_params[DOWN]);
+            if(!ok){
+                cerr<<"Bad option: "<<arg<<" "<<value<<nl;
+                usage();
+                return 1;
+            }
+        }
+        else{
+            cerr<<"Unknown option: "<<arg<<nl;
+            usage();
+            return 1;
+        }
+    }
+    if(listen_port<1 || listen_port>65535){
+        cerr<<"--listen must be between 1 and 65535\n";
+        return 1;
+    }
+
+    size_t colon=target.rfind(':');
+    std::string host=colon==std::string::npos ? target : target.substr(0,colon);
+    int port=colon==std::string::npos ? proto::SERVER_PORT : std::atoi(target.c_str()+colon+1);
+    g_server_addr.sin_family=AF_INET;
+    g_server_addr.sin_port=htons(static_cast<uint16_t>(port));
+    if(port<1 || port>65535 || inet_pton(AF_INET,host.c_str(),&g_server_addr.sin_addr)<=0){
+        cerr<<"--to takes IP:PORT, got "<<target<<nl;
+        return 1;
+    }
+    g_rng.seed(seed);
+
+    int tcp_listen=open_listener(SOCK_STREAM,listen_port);
+    g_udp_listen=open_listener(SOCK_DGRAM,listen_port);
+    if(tcp_listen<0 || g_udp_listen<0){
+        cerr<<"cannot listen on port "<<listen_port<<": "<<std::strerror(errno)<<endl;
+        return 1;
+    }
+    int timer_fd=timerfd_create(CLOCK_MONOTONIC,TFD_NONBLOCK|TFD_CLOEXEC);
+    g_epoll=epoll_create1(0);
+    if(timer_fd<0 || g_epoll<0){
+        cerr<<"timerfd/epoll setup failed: "<<std::strerror(errno)<<endl;
+        return 1;
+    }
+
+    epoll_event ev{};
+    ev.events=EPOLLIN;
+    ev.data.u64=TAG_TCP_LISTEN;
+    epoll_ctl(g_epoll,EPOLL_CTL_ADD,tcp_listen,&ev);
+    ev.data.u64=TAG_UDP_LISTEN;
+    epoll_ctl(g_epoll,EPOLL_CTL_ADD,g_udp_listen,&ev);
+    ev.data.u64=TAG_TIMER;
+    epoll_ctl(g_epoll,EPOLL_CTL_ADD,timer_fd,&ev);
+
+    std::signal(SIGINT,on_signal);
+    std::signal(SIGTERM,on_signal);
+
+    static const char* dist_names[]={"constant","uniform","normal","pareto"};
+    for(int dir=UP;dir<=DOWN;dir++){
+        const LinkParams& p=g_params[dir];
+        cout<<(dir==UP ? "up:   " : "down: ")<<p.delay*1e3<<" ms +- "<<p.jitter*1e3<<" ms "
+            <<dist_names[static_cast<int>(p.dist)]<<", "<<p.loss*100.0<<"% loss, "
+            <<p.reorder*100.0<<"% reordered, ";
+        if(p.rate>0.0) cout<<p.rate*8.0/1000.0<<" kbit/s"<<nl;
+        else cout<<"no rate cap"<<nl;
+    }
+    cout<<"Proxying TCP and UDP port "<<listen_port<<" to "<<host<<":"<<port<<" (seed "<<seed<<")"<<nl;
+
+    std::vector<epoll_event> events(256);
+    double next_report=now_seconds()+STATS_INTERVAL;
+    double next_expire=now_seconds()+1.0;
+    while(!g_stop){
+        int n=epoll_wait(g_epoll,events.data(),static_cast<int>(events.size()),1000);
+        if(n<0){
+            if(errno==EINTR) continue;
+            cerr<<"epoll_wait() failed: "<<std::strerror(errno)<<endl;
+            break;
+        }
+
+        double now=now_seconds();
+        for(int i=0;i<n;i++){
+            uint64_t tag=events[i].data.u64;
+            if(tag==TAG_TCP_LISTEN){
+                accept_tcp(tcp_listen);
+            }
+            else if(tag==TAG_UDP_LISTEN){
+                read_udp_client(now);
+            }
+            else if(tag==TAG_TIMER){
+                uint64_t expirations;
+                ssize_t r=::read(timer_fd,&expirations,sizeof(expirations));
+                (void)r;
+            }
+            else{
+                uint64_t id=tag>>2;
+                uint64_t kind=tag&3;
+                if(kind==KIND_UDP_UPSTREAM){
+                    read_udp_server(id,now);
+                    continue;
+                }
+                int side=static_cast<int>(kind);
+                auto it=g_tcp.find(id);
+                if(it==g_tcp.end()) continue;
+                if(events[i].events&EPOLLOUT){
+                    if(!flush_tcp(it->second,id,peer(side))){
+                        close_tcp(id);
+                        continue;
+                    }
+                }
+                if(events[i].events&(EPOLLIN|EPOLLHUP|EPOLLERR)){
+                    read_tcp(id,side,now);
+                }
+            }
+        }
+
+        // everything due by now goes out, in release order
+        now=now_seconds();
+        while(!g_pending.empty() && g_pending.top().at<=now){
+            Pending p=std::move(const_cast<Pending&>(g_pending.top()));
+            g_pending.pop();
+            if(p.udp) release_udp(p);
+            else release_tcp(p);
+        }
+        arm_timer(timer_fd);
+
+        if(now>=next_expire){
+            expire_udp(now);
+            next_expire=now+1.0;
+        }
+        if(now>=next_report){
+            print_stats();
+            next_report=now+STATS_INTERVAL;
+        }
+    }
+
+    print_stats();
+    for(auto& kv : g_tcp){
+        for(int fd : kv.second.fd) if(fd>=0) ::close(fd);
+    }
+    for(auto& kv : g_udp) ::close(kv.second.upstream);
+    ::close(timer_fd);
+    ::close(g_epoll);
+    ::close(g_udp_listen);
+    ::close(tcp_listen);
+    return 0;
+}
@@ -0,0 +1,316 @@
+// re-runs a match recorded with `server --record DIR` as fast as the CPU
+// allows. the log is memory-mapped and walked in place; every keyframe it
+// passes is compared bit for bit with the re-simulated world, so any
+// divergence between the server and this build shows up at the first
+// keyframe after it.
+//
+//   replay FILE               re-simulate everything, check every keyframe
+//   replay FILE --seek TICK   start from the nearest keyframe at or before
+//                             TICK and print the world as TICK starts
+//
+// exits 1 if a keyframe does not match.
+
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <string>
+#include <sstream>
+#include <cstring>
+#include <cstdlib>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "../common/utils.hpp"
+#include "../common/protocol.hpp"
+#include "../common/coin_field.hpp"
+#include "../server/world.hpp"
+#include "../server/recording.hpp"
+
+using std::cout;
+using std::cerr;
+using std::endl;
+
+#define nl "\n"
+
+// one record, pointing into the mapped file
+struct Record{
+    uint8_t type=0;
+    int tick=0;
+    const uint8_t* body=nullptr; // after type and tick
+    size_t body_len=0;
+};
+
+struct Recording{
+    uint16_t max_players=0;
+    uint16_t num_coins=0;
+    uint32_t seed=0;
+    int room_id=0;
+    uint16_t width=0;
+    uint16_t height=0;
+    std::vector<Record> records;
+    std::vector<size_t> keyframes; // indices into records
+    bool truncated=false;
+};
+
+// split the mapped log into records. a torn record at the end (the server
+// stopped mid-write) ends the list instead of failing the whole file, and
+// so does a tick that goes backwards or skips past where the next keyframe
+// should have been, which can only be damage.
+bool parse_recording(const uint8_t* data, size_t len, Recording& rec){
+    proto::detail::ByteReader hr(data,len);
+    uint32_t magic=hr.u32();
+    uint16_t version=hr.u16();
+    rec.max_players=hr.u16();
+    rec.num_coins=hr.u16();
+    rec.seed=hr.u32();
+    rec.room_id=hr.i32();
+    rec.width=hr.u16();
+    rec.height=hr.u16();
+    if(!hr.ok || magic!=REC_MAGIC){
+        cerr<<"not a match recording"<<nl;
+        return false;
+    }
+    if(version!=REC_VERSION){
+        cerr<<"recording version "<<version<<", this replay reads "<<REC_VERSION<<nl;
+        return false;
+    }
+    if(rec.max_players<1 || rec.max_players>proto::MAX_PLAYERS ||
+       rec.num_coins<1 || rec.num_coins>proto::MAX_COINS ||
+       rec.width<1 || rec.height<1 || rec.width>proto::MAX_WORLD_SIZE || rec.height>proto::MAX_WORLD_SIZE){
+        cerr<<"bad world size in header"<<nl;
+        return false;
+    }
+
+    proto::detail::ByteReader br(hr.p,static_cast<size_t>(data+len-hr.p));
+    int last_tick=0;
+    while(br.p<br.end){
+        Record r;
+        r.type=br.u8();
+        r.tick=br.i32();
+        if(br.ok && (r.tick<last_tick || r.tick>last_tick+REC_KEYFRAME_INTERVAL)){
+            cerr<<"record "<<rec.records.size()<<" jumps from tick "<<last_tick
+                <<" to "<<r.tick<<", ignoring the rest"<<nl;
+            rec.truncated=true;
+            break;
+        }
+        last_tick=r.tick;
+        size_t body_len=0;
+        if(r.type==REC_JOIN || r.type==REC_LEAVE) body_len=1;
+        else if(r.type==REC_INPUT) body_len=1+4+1+1;
+        else if(r.type==REC_KEYFRAME) body_len=br.u32();
+        else{
+            cerr<<"unknown record type "<<static_cast<int>(r.type)<<nl;
+            return false;
+        }
+        if(!br.ok || static_cast<size_t>(br.end-br.p)<body_len){
+            rec.truncated=true;
+            break;
+        }
+        r.body=br.p;
+        r.body_len=body_len;
+        br.p+=body_len;
+        if(r.type==REC_KEYFRAME) rec.keyframes.push_back(rec.records.size());
+        rec.records.push_back(r);
+    }
+    return true;
+}
+
+// apply one join, leave or input to w; w.tick is the record's tick
+void apply_record(World& w, const Record& r){
+    proto::detail::ByteReader br(r.body,r.body_len);
+    int slot=br.u8();
+    if(slot>=w.max_players) return;
+    if(r.type==REC_JOIN){
+        spawn_player(w,slot);
+    }
+    else if(r.type==REC_LEAVE){
+        w.players[slot].active=false;
+    }
+    else if(r.type==REC_INPUT){
+        int seq=br.i32();
+        int dx=static_cast<int8_t>(br.u8());
+        int dy=static_cast<int8_t>(br.u8());
+        apply_input(w,slot,seq,dx,dy);
+    }
+}
+
+// first field where the recorded keyframe and the replayed world differ
+std::string describe_mismatch(const World& replayed, const Record& kf){
+    World recorded;
+    recorded.max_players=replayed.max_players;
+    recorded.num_coins=replayed.num_coins;
+    if(!read_world_state(kf.body,kf.body_len,kf.tick,recorded)) return "keyframe unreadable";
+
+    std::ostringstream out;
+    for(int i=0;i<replayed.max_players;i++){
+        const Player& a=recorded.players[i];
+        const Player& b=replayed.players[i];
+        if(a.active!=b.active || a.x!=b.x || a.y!=b.y || a.vx!=b.vx || a.vy!=b.vy ||
+           a.score!=b.score || a.input_seq!=b.input_seq || a.input_tick!=b.input_tick){
+            out<<"player slot "<<i<<": recorded ("<<a.x<<", "<<a.y<<") score "<<a.score
+               <<", replayed ("<<b.x<<", "<<b.y<<") score "<<b.score;
+            return out.str();
+        }
+    }
+    for(int i=0;i<replayed.num_coins;i++){
+        if(recorded.coins.is_active(i)!=replayed.coins.is_active(i) ||
+           recorded.coins.x[i]!=replayed.coins.x[i] || recorded.coins.y[i]!=replayed.coins.y[i]){
+            out<<"coin "<<i<<": recorded ("<<recorded.coins.x[i]<<", "<<recorded.coins.y[i]
+               <<"), replayed ("<<replayed.coins.x[i]<<", "<<replayed.coins.y[i]<<")";
+            return out.str();
+        }
+    }
+    return "rng state";
+}
+
+void print_world(const World& w){
+    cout<<"tick "<<w.tick<<", "<<w.coins.active_count()<<" coins active"<<nl;
+    for(int i=0;i<w.max_players;i++){
+        const Player& p=w.players[i];
+        if(!p.active) continue;
+        cout<<"  player "<<p.id<<" at ("<<p.x<<", "<<p.y<<") score "<<p.score
+            <<" last input "<<p.input_seq<<nl;
+    }
+}
+
+int main(int argc, char** argv){
+    std::string path;
+    int seek_tick=-1;
+    for(int i=1;i<argc;i++){
+        std::string arg=argv[i];
+        if(arg=="--seek" && i+1<argc){
+            seek_tick=std::atoi(argv[++i]);
+        }
+        else if(path.empty() && arg[0]!='-'){
+            path=arg;
+        }
+        else{
+            cerr<<"Usage: replay FILE [--seek TICK]\n";
+            return 2;
+        }
+    }
+    if(path.empty()){
+        cerr<<"Usage: replay FILE [--seek TICK]\n";
+        return 2;
+    }
+
+    int fd=::open(path.c_str(),O_RDONLY);
+    if(fd<0){
+        cerr<<path<<": "<<std::strerror(errno)<<endl;
+        return 2;
+    }
+    struct stat st;
+    if(fstat(fd,&st)<0 || st.st_size==0){
+        cerr<<path<<": empty or unreadable"<<endl;
+        ::close(fd);
+        return 2;
+    }
+    size_t len=static_cast<size_t>(st.st_size);
+    void* map=mmap(nullptr,len,PROT_READ,MAP_PRIVATE,fd,0);
+    ::close(fd);
+    if(map==MAP_FAILED){
+        cerr<<"mmap() failed: "<<std::strerror(errno)<<endl;
+        return 2;
+    }
+    madvise(map,len,MADV_SEQUENTIAL);
+    const uint8_t* data=static_cast<const uint8_t*>(map);
+
+    Recording rec;
+    if(!parse_recording(data,len,rec)){
+        munmap(map,len);
+        return 2;
+    }
+    cout<<"room "<<rec.room_id<<", "<<rec.width<<"x"<<rec.height<<" world, "
+        <<rec.max_players<<" players, "<<rec.num_coins<<" coins, seed "<<rec.seed<<", "<<rec.records.size()<<" records, "
+        <<rec.keyframes.size()<<" keyframes"<<(rec.truncated ? " (truncated)" : "")<<nl;
+
+    World w;
+    w.id=rec.room_id;
+    w.max_players=rec.max_players;
+    w.num_coins=rec.num_coins;
+    w.coin_kernel=select_coin_kernel();
+    w.seed=rec.seed;
+    w.width=rec.width;
+    w.height=rec.height;
+    reset_world(w);
+
+    if(seek_tick>=0 && !rec.records.empty() && seek_tick>rec.records.back().tick){
+        cerr<<"the recording ends at tick "<<rec.records.back().tick<<", seeking there"<<nl;
+        seek_tick=rec.records.back().tick;
+    }
+
+    // with --seek, jump to the last keyframe at or before the target
+    size_t first=0;
+    if(seek_tick>=0){
+        for(size_t k : rec.keyframes){
+            const Record& kf=rec.records[k];
+            if(kf.tick>seek_tick) break;
+            first=k;
+        }
+        if(!rec.keyframes.empty() && rec.records[first].type==REC_KEYFRAME &&
+           rec.records[first].tick<=seek_tick){
+            const Record& kf=rec.records[first];
+            if(!read_world_state(kf.body,kf.body_len,kf.tick,w)){
+                cerr<<"keyframe at tick "<<kf.tick<<" is unreadable"<<nl;
+                munmap(map,len);
+                return 2;
+            }
+            first++;
+        }
+    }
+
+    std::vector<uint8_t> state;
+    long ticks=0;
+    long inputs=0;
+    int checked=0;
+    int mismatches=0;
+    double start=now_seconds();
+    for(size_t i=first;i<rec.records.size();i++){
+        const Record& r=rec.records[i];
+        if(seek_tick>=0 && r.tick>=seek_tick) break;
+        while(w.tick<r.tick){
+            update_world(w,w.tick);
+            w.tick++;
+            ticks++;
+        }
+
+        if(r.type==REC_KEYFRAME){
+            checked++;
+            write_world_state(w,state);
+            if(state.size()!=r.body_len || std::memcmp(state.data(),r.body,r.body_len)!=0){
+                if(mismatches==0){
+                    cerr<<"tick "<<r.tick<<" does not match the recording: "
+                        <<describe_mismatch(w,r)<<nl;
+                }
+                mismatches++;
+                // carry on from the recorded state to find later divergences
+                read_world_state(r.body,r.body_len,r.tick,w);
+            }
+            continue;
+        }
+        if(r.type==REC_INPUT) inputs++;
+        apply_record(w,r);
+    }
+    while(seek_tick>=0 && w.tick<seek_tick){
+        update_world(w,w.tick);
+        w.tick++;
+        ticks++;
+    }
+    double elapsed=now_seconds()-start;
+
+    cout<<ticks<<" ticks and "<<inputs<<" inputs in "<<std::fixed<<std::setprecision(3)
+        <<elapsed*1000.0<<" ms ("<<std::setprecision(0)
+        <<(elapsed>0.0 ? static_cast<double>(ticks)/elapsed : 0.0)<<" ticks/s, "
+        <<std::setprecision(1)<<(elapsed>0.0 ? static_cast<double>(ticks)/elapsed/proto::TICK_RATE : 0.0)
+        <<"x real time)"<<nl;
+    cout<<checked<<" keyframes checked, "<<mismatches<<" mismatched"<<nl;
+    if(seek_tick>=0){
+        cout<<std::defaultfloat<<std::setprecision(6);
+        print_world(w);
+    }
+
+    munmap(map,len);
+    return mismatches>0 ? 1 : 0;
+}
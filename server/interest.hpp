@@ -0,0 +1,149 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <algorithm>
+
+#include "../common/protocol.hpp"
+#include "../common/spatial_hash.hpp"
+#include "world.hpp"
+
+// area of interest (--interest R): each client is sent only the players and
+// coins within R of its own player, so what a client costs to encode and to
+// send depends on how crowded its surroundings are, not on the whole world.
+//
+// coins are looked up through a grid over the active coins, rebuilt only on
+// ticks where a coin changed. what each client was sent is kept per history
+// slot as a bitset of coin ids, so a delta against any acked baseline can
+// tell which coins came into range (sent active) and which went out of it
+// (sent inactive, like a collected coin). the client applies every coin
+// section on top of the last, so a delta also has to undo whatever the
+// frames sent after its baseline said: a coin that left range and came
+// back since is sent again. players entering and leaving
+// range fall out of the delta's joined and left sections by themselves,
+// since the filtered snapshot is what goes into the client's history.
+
+struct CoinInterestGrid{
+    SpatialHash grid;
+    bool valid=false;    // cleared when the room starts a new match
+    int built_after=-1;  // newest coin change the grid has seen
+
+    // cells half the radius across: a query touches about 5x5 cells
+    void reset(const World& w, float radius){
+        float cell=std::max(radius*0.5f,std::max(w.width,w.height)/MAX_GRID_SIDE);
+        grid.reset(std::max(cell,1.0f),w.width,w.height);
+        valid=false;
+    }
+
+    void update(const World& w){
+        int newest=w.coin_log.empty() ? -1 : w.coin_log.back().tick;
+        if(valid && newest==built_after) return;
+        grid.clear();
+        for(int i=0;i<w.num_coins;i++){
+            if(w.coins.is_active(i)) grid.insert(i,w.coins.x[i],w.coins.y[i]);
+        }
+        grid.build();
+        valid=true;
+        built_after=newest;
+    }
+};
+
+// the coins one client was sent with each snapshot still in its history
+struct CoinInterestHistory{
+    int words=0;
+    std::vector<uint64_t> sent; // SNAPSHOT_HISTORY x words, by tick % SNAPSHOT_HISTORY
+    std::vector<int> sent_tick; // tick each slot of sent holds, -1: none
+
+    // filled by since(): coins visible in the baseline and in every frame
+    // sent after it, and coins visible in any of them
+    std::vector<uint64_t> stable;
+    std::vector<uint64_t> seen;
+
+    void reset(int num_coins){
+        words=(num_coins+63)/64;
+        sent.assign(static_cast<size_t>(proto::SNAPSHOT_HISTORY*words),0);
+        sent_tick.assign(proto::SNAPSHOT_HISTORY,-1);
+        stable.assign(static_cast<size_t>(words),0);
+        seen.assign(static_cast<size_t>(words),0);
+    }
+
+    uint64_t* at(int tick){
+        return sent.data()+static_cast<size_t>(tick%proto::SNAPSHOT_HISTORY*words);
+    }
+
+    // the bits to fill for the frame being sent on tick
+    uint64_t* record(int tick){
+        sent_tick[tick%proto::SNAPSHOT_HISTORY]=tick;
+        return at(tick);
+    }
+
+    // stable and seen over base_tick (a tick this client was sent) and
+    // every frame recorded after it, before tick
+    void since(int base_tick, int tick){
+        const uint64_t* base=at(base_tick);
+        std::copy(base,base+words,stable.begin());
+        std::copy(base,base+words,seen.begin());
+        for(int t=base_tick+1;t<tick;t++){
+            if(sent_tick[t%proto::SNAPSHOT_HISTORY]!=t) continue;
+            const uint64_t* bits=at(t);
+            for(int k=0;k<words;k++){
+                stable[k]&=bits[k];
+                seen[k]|=bits[k];
+            }
+        }
+    }
+};
+
+// the players of all that are within radius of (cx,cy), plus self_id
+// wherever they are. keeps the id order.
+inline void filter_players(const proto::worldSnapshot& all, int self_id, float cx, float cy,
+                           float radius, proto::worldSnapshot& out){
+    const float r_sq=radius*radius;
+    out.tick=all.tick;
+    out.server_time=all.server_time;
+    out.num_players=0;
+    for(int i=0;i<all.num_players;i++){
+        const proto::playerState& p=all.players[i];
+        float dx=p.x-cx;
+        float dy=p.y-cy;
+        if(p.id==self_id || dx*dx+dy*dy<=r_sq) out.players[out.num_players++]=p;
+    }
+}
+
+// set the bit of every active coin within radius of (cx,cy)
+inline void visible_coins(const CoinInterestGrid& g, float cx, float cy, float radius,
+                          uint64_t* bits, int words){
+    std::fill(bits,bits+words,0);
+    g.grid.query(cx,cy,radius,[&](int id){
+        bits[id>>6]|=uint64_t(1)<<(id&63);
+    });
+}
+
+// coin section for one client. a keyframe (stable and seen null) lists
+// every visible coin. a delta against base_tick takes stable and seen from
+// CoinInterestHistory::since: it lists the coins visible now that were not
+// visible in every frame since base_tick or changed after it, and as
+// inactive the ones not visible now that were in any of those frames.
+inline void interest_coin_update(const World& w, const uint64_t* now, const uint64_t* stable,
+                                 const uint64_t* seen, int base_tick, int words,
+                                 proto::coinUpdate& out){
+    out.full=(seen==nullptr);
+    out.coins.clear();
+    for(int k=0;k<words;k++){
+        uint64_t kept=stable ? stable[k] : 0;
+        uint64_t bits=now[k]|(seen ? seen[k] : 0);
+        while(bits){
+            int b=__builtin_ctzll(bits);
+            bits&=bits-1;
+            int id=k*64+b;
+            bool in_now=(now[k]>>b)&1u;
+            bool in_all=(kept>>b)&1u;
+            if(in_now && (!in_all || w.coin_changed_tick[id]>base_tick)){
+                out.coins.push_back(proto::coinState{id,w.coins.x[id],w.coins.y[id],true});
+            }
+            else if(!in_now){
+                out.coins.push_back(proto::coinState{id,0.0f,0.0f,false});
+            }
+        }
+    }
+}
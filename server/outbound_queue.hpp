@@ -0,0 +1,112 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <cerrno>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/ioctl.h>
+#include <linux/sockios.h>
+
+// STATE frames waiting to go out on one non-blocking TCP socket. holds at
+// most two frames: the one the socket has taken part of (which must be
+// finished, or the stream loses its framing) and the newest one that has
+// not started. a frame that arrives while another is still waiting to start
+// replaces it; every frame is a keyframe or a delta against a snapshot the
+// client has acked, never against another queued frame, so a reader that
+// falls behind only ever gets the latest state next.
+//
+// owned by whichever worker is ticking the client's room.
+struct OutboundQueue{
+    std::vector<uint8_t> head; // frame being written
+    size_t head_sent=0;
+    std::vector<uint8_t> next; // newest frame not started yet
+    bool has_next=false;
+    double last_progress=0.0;  // when the socket last took any bytes
+
+    void reset(double now){
+        head.clear();
+        head_sent=0;
+        next.clear();
+        has_next=false;
+        last_progress=now;
+    }
+
+    bool empty() const{ return head_sent==head.size() && !has_next; }
+
+    // true if earlier frames are still waiting to go out on fd, either here
+    // or in the kernel's send buffer (bytes not yet sent, not ones sent and
+    // waiting for their TCP ack)
+    bool backlogged(int fd) const{
+        if(!empty()) return true;
+        int unsent=0;
+        return ::ioctl(fd,SIOCOUTQNSD,&unsent)==0 && unsent>0;
+    }
+
+    // queue a frame; true if it replaced one that never went out
+    bool push(const uint8_t* data, size_t len){
+        if(head_sent==head.size()){
+            store(head,data,len);
+            head_sent=0;
+            return false;
+        }
+        bool replaced=has_next;
+        store(next,data,len);
+        has_next=true;
+        return replaced;
+    }
+
+    // frames differ by a few bytes from tick to tick, so a buffer that has
+    // to grow gets half as much again on top; otherwise every frame longer
+    // than all before it would reallocate
+    static void store(std::vector<uint8_t>& buf, const uint8_t* data, size_t len){
+        if(buf.capacity()<len) buf.reserve(len+len/2);
+        buf.assign(data,data+len);
+    }
+
+    // write as much as the socket takes in one gathered write without
+    // blocking. sendmsg is writev with flags, here MSG_NOSIGNAL so a reset
+    // connection is an error rather than a SIGPIPE. returns the bytes
+    // written, 0 if the socket is full, -1 on an error.
+    ssize_t flush(int fd, double now){
+        if(empty()) return 0;
+        iovec iov[2];
+        int count=0;
+        if(head_sent<head.size()){
+            iov[count].iov_base=head.data()+head_sent;
+            iov[count].iov_len=head.size()-head_sent;
+            count++;
+        }
+        if(has_next){
+            iov[count].iov_base=next.data();
+            iov[count].iov_len=next.size();
+            count++;
+        }
+
+        msghdr msg{};
+        msg.msg_iov=iov;
+        msg.msg_iovlen=static_cast<size_t>(count);
+        ssize_t n;
+        do{
+            n=::sendmsg(fd,&msg,MSG_NOSIGNAL);
+        }while(n<0 && errno==EINTR);
+        if(n<0) return (errno==EAGAIN || errno==EWOULDBLOCK) ? 0 : -1;
+        if(n>0) last_progress=now;
+
+        size_t left=static_cast<size_t>(n);
+        size_t in_head=head.size()-head_sent;
+        if(left<in_head){
+            head_sent+=left;
+            return n;
+        }
+        left-=in_head;
+        head_sent=head.size();
+        if(has_next){
+            head.swap(next);
+            head_sent=left;
+            has_next=false;
+        }
+        return n;
+    }
+};
@@ -0,0 +1,245 @@
+#pragma once
+
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <sstream>
+#include <ostream>
+#include <streambuf>
+#include <vector>
+
+#include "../common/protocol.hpp"
+#include "world.hpp"
+
+// match recordings (--record): an append-only log with everything needed
+// to re-run a room's world tick for tick, for the replay tool.
+//
+// file header, little-endian like the wire protocol:
+//   u32 REC_MAGIC, u16 REC_VERSION, u16 max_players, u16 num_coins,
+//   u32 seed, i32 room id, u16 world width, u16 world height
+// then records, each u8 type and i32 tick:
+//   REC_JOIN/REC_LEAVE   u8 slot
+//   REC_INPUT            u8 slot, i32 seq, i8 dx, i8 dy
+//   REC_KEYFRAME         u32 length, world state (see write_world_state)
+//
+// a tick's records come in the order the server applied them, all before
+// that tick's update_world. keyframes hold the world as the tick starts, so
+// a replay can check itself against them or start from one.
+
+constexpr uint32_t REC_MAGIC=0x43455243; // "CREC"
+// bumped when the format or the rules update_world plays by change, since
+// an older recording would no longer replay to the same state
+constexpr uint16_t REC_VERSION=3;
+constexpr size_t REC_HEADER_SIZE=4+2+2+2+4+4+2+2;
+
+constexpr uint8_t REC_JOIN=1;
+constexpr uint8_t REC_LEAVE=2;
+constexpr uint8_t REC_INPUT=3;
+constexpr uint8_t REC_KEYFRAME=4;
+
+// one keyframe every 5 s of ticks; also how often the file is flushed
+constexpr int REC_KEYFRAME_INTERVAL=5*proto::TICK_RATE;
+
+// records are written out once this many bytes are waiting
+constexpr size_t REC_FLUSH_SIZE=64*1024;
+
+constexpr size_t REC_PLAYER_SIZE=1+4+4*4+4+4+4;
+constexpr size_t REC_COIN_SIZE=1+4+4;
+
+// ---- world state, as stored in keyframes ----
+
+// the rng as text is its 624 state words and position, at most 11
+// characters each with the separator
+constexpr size_t REC_RNG_TEXT_MAX=625*11;
+
+// ostream over a fixed buffer, so the rng can be written out without a
+// string stream allocating on every keyframe. fills up rather than grows:
+// the stream fails if the text does not fit.
+struct FixedStreamBuf : std::streambuf{
+    FixedStreamBuf(char* buf, size_t cap){ setp(buf,buf+cap); }
+    size_t size() const{ return static_cast<size_t>(pptr()-pbase()); }
+};
+
+inline size_t world_state_size(const World& w, size_t rng_len){
+    return 2+rng_len+
+           static_cast<size_t>(w.max_players)*REC_PLAYER_SIZE+
+           static_cast<size_t>(w.num_coins)*REC_COIN_SIZE;
+}
+
+// everything update_world reads: the rng, every player slot and every coin
+// slot (inactive coins keep their old position)
+inline size_t write_world_state(const World& w, std::vector<uint8_t>& out){
+    char rng_state[REC_RNG_TEXT_MAX];
+    FixedStreamBuf rng_buf(rng_state,sizeof(rng_state));
+    std::ostream rng_text(&rng_buf);
+    rng_text<<w.rng;
+    if(!rng_text) return 0;
+    size_t rng_len=rng_buf.size();
+
+    out.resize(world_state_size(w,rng_len));
+    proto::detail::ByteWriter bw(out.data(),out.size());
+    bw.u16(static_cast<uint16_t>(rng_len));
+    for(size_t i=0;i<rng_len;i++) bw.u8(static_cast<uint8_t>(rng_state[i]));
+    for(int i=0;i<w.max_players;i++){
+        const Player& p=w.players[i];
+        bw.u8(p.active ? 1 : 0);
+        bw.i32(p.id);
+        bw.f32(p.x);
+        bw.f32(p.y);
+        bw.f32(p.vx);
+        bw.f32(p.vy);
+        bw.i32(p.score);
+        bw.i32(p.input_seq);
+        bw.i32(p.input_tick);
+    }
+    for(int i=0;i<w.num_coins;i++){
+        bw.u8(w.coins.is_active(i) ? 1 : 0);
+        bw.f32(w.coins.x[i]);
+        bw.f32(w.coins.y[i]);
+    }
+    return bw.ok ? out.size() : 0;
+}
+
+// load a keyframe into w, which must already have the recording's
+// max_players and num_coins. the coin change log starts over.
+inline bool read_world_state(const uint8_t* data, size_t len, int tick, World& w){
+    proto::detail::ByteReader br(data,len);
+    size_t rng_len=br.u16();
+    if(!br.ok || static_cast<size_t>(br.end-br.p)<rng_len) return false;
+    std::istringstream rng_text(std::string(reinterpret_cast<const char*>(br.p),rng_len));
+    br.p+=rng_len;
+    rng_text>>w.rng;
+    if(rng_text.fail()) return false;
+
+    for(auto& p : w.players) p.active=false; // slots past max_players
+    for(int i=0;i<w.max_players;i++){
+        Player& p=w.players[i];
+        p.active=br.u8()!=0;
+        p.id=br.i32();
+        p.x=br.f32();
+        p.y=br.f32();
+        p.vx=br.f32();
+        p.vy=br.f32();
+        p.score=br.i32();
+        p.input_seq=br.i32();
+        p.input_tick=br.i32();
+    }
+    w.coins.resize(w.num_coins);
+    for(int i=0;i<w.num_coins;i++){
+        bool active=br.u8()!=0;
+        float x=br.f32();
+        float y=br.f32();
+        w.coins.x[i]=x;
+        w.coins.y[i]=y;
+        if(active) w.coins.set(i,x,y);
+    }
+    w.coin_changed_tick.assign(static_cast<size_t>(w.num_coins),-1);
+    w.coin_log.clear();
+    w.tick=tick;
+    return br.ok;
+}
+
+// ---- writer ----
+
+// owned by a room and only used by the thread ticking it (or the game loop
+// between ticks, to open and close). every call is a no-op while closed.
+struct MatchRecorder{
+    FILE* f=nullptr;
+    std::string path;
+    std::vector<uint8_t> buf;     // records not written yet
+    std::vector<uint8_t> scratch; // keyframe encoding
+
+    bool is_open() const{ return f!=nullptr; }
+
+    bool open(const std::string& file_path, const World& w){
+        close();
+        f=std::fopen(file_path.c_str(),"wb");
+        if(!f) return false;
+        path=file_path;
+
+        uint8_t header[REC_HEADER_SIZE];
+        proto::detail::ByteWriter bw(header,sizeof(header));
+        bw.u32(REC_MAGIC);
+        bw.u16(REC_VERSION);
+        bw.u16(static_cast<uint16_t>(w.max_players));
+        bw.u16(static_cast<uint16_t>(w.num_coins));
+        bw.u32(w.seed);
+        bw.i32(w.id);
+        bw.u16(static_cast<uint16_t>(w.width));
+        bw.u16(static_cast<uint16_t>(w.height));
+        // buf never holds more than REC_FLUSH_SIZE plus one record, the
+        // biggest being a keyframe, so nothing grows mid-match
+        scratch.reserve(world_state_size(w,REC_RNG_TEXT_MAX));
+        buf.reserve(REC_FLUSH_SIZE+1+4+4+scratch.capacity());
+        buf.assign(header,header+sizeof(header));
+        return true;
+    }
+
+    void join(int tick, int slot){ slot_record(REC_JOIN,tick,slot); }
+    void leave(int tick, int slot){ slot_record(REC_LEAVE,tick,slot); }
+
+    void input(int tick, int slot, int seq, int dx, int dy){
+        if(!f) return;
+        uint8_t rec[1+4+1+4+1+1];
+        proto::detail::ByteWriter bw(rec,sizeof(rec));
+        bw.u8(REC_INPUT);
+        bw.i32(tick);
+        bw.u8(static_cast<uint8_t>(slot));
+        bw.i32(seq);
+        bw.u8(static_cast<uint8_t>(static_cast<int8_t>(dx)));
+        bw.u8(static_cast<uint8_t>(static_cast<int8_t>(dy)));
+        append(rec,sizeof(rec));
+    }
+
+    // the world as w.tick starts; flushes the file so a crash loses at most
+    // one keyframe interval
+    void keyframe(const World& w){
+        if(!f) return;
+        size_t len=write_world_state(w,scratch);
+        uint8_t head[1+4+4];
+        proto::detail::ByteWriter bw(head,sizeof(head));
+        bw.u8(REC_KEYFRAME);
+        bw.i32(w.tick);
+        bw.u32(static_cast<uint32_t>(len));
+        append(head,sizeof(head));
+        append(scratch.data(),len);
+        flush();
+        if(f) std::fflush(f);
+    }
+
+    void close(){
+        if(!f) return;
+        flush();
+        if(f) std::fclose(f);
+        f=nullptr;
+    }
+
+    ~MatchRecorder(){ close(); }
+
+    void slot_record(uint8_t type, int tick, int slot){
+        if(!f) return;
+        uint8_t rec[1+4+1];
+        proto::detail::ByteWriter bw(rec,sizeof(rec));
+        bw.u8(type);
+        bw.i32(tick);
+        bw.u8(static_cast<uint8_t>(slot));
+        append(rec,sizeof(rec));
+    }
+
+    void append(const uint8_t* data, size_t len){
+        buf.insert(buf.end(),data,data+len);
+        if(buf.size()>=REC_FLUSH_SIZE) flush();
+    }
+
+    // a failed write ends the recording rather than leaving a torn log
+    void flush(){
+        if(!f || buf.empty()) return;
+        if(std::fwrite(buf.data(),1,buf.size(),f)!=buf.size()){
+            std::fprintf(stderr,"recording %s: write failed, stopped\n",path.c_str());
+            std::fclose(f);
+            f=nullptr;
+        }
+        buf.clear();
+    }
+};
@@ -0,0 +1,568 @@
+#pragma once
+
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <random>
+#include <cmath>
+#include <cstring>
+#include <cstdint>
+#include <cerrno>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+
+#include "../common/utils.hpp"
+#include "../common/protocol.hpp"
+#include "../common/simulation.hpp"
+#include "../common/work_pool.hpp"
+#include "../common/spsc_ring.hpp"
+#include "../common/timing_wheel.hpp"
+#include "../common/histogram.hpp"
+#include "../common/tick_arena.hpp"
+#include "world.hpp"
+#include "recording.hpp"
+#include "outbound_queue.hpp"
+#include "interest.hpp"
+#include "send_rate.hpp"
+
+// one room and its tick: the settings every room is built from, the client
+// slots the network threads fill, and tick_room with everything it calls
+// (inputs, update_world, snapshot encoding and sending). kept apart from
+// server.cpp, which owns the rooms, sockets and threads, so the benchmarks
+// can run the server's real tick.
+
+// ---- metrics ----
+
+// server-wide counters and tick phase histograms, cumulative since startup.
+// ticks, the reactor and the UDP thread record into them with relaxed
+// atomics and the stats endpoint (--stats-port) reads them from its own
+// thread, so serving a snapshot never holds up a tick.
+struct ServerMetrics{
+    LatencyHistogram tick_input;     // sync_players and applying due inputs
+    LatencyHistogram tick_update;    // update_world
+    LatencyHistogram tick_broadcast; // building, encoding and sending STATE
+    LatencyHistogram tick_total;
+
+    std::atomic<uint64_t> late_ticks{0};
+    std::atomic<uint64_t> bytes_sent{0};
+    std::atomic<uint64_t> bytes_received{0};
+    std::atomic<uint64_t> inputs{0};
+    std::atomic<uint64_t> inputs_dropped{0};
+    std::atomic<uint64_t> send_failures{0};
+    std::atomic<uint64_t> snapshots_replaced{0}; // never sent, a newer one took their place
+    std::atomic<uint64_t> snapshots_sent{0};
+    std::atomic<int> tcp_connections{0}; // open now, with a slot or waiting for one
+
+    // per-second rates over the last STATS_INTERVAL, set by the game loop
+    std::atomic<double> inputs_per_sec{0.0};
+    std::atomic<double> bytes_sent_per_sec{0.0};
+    std::atomic<double> bytes_received_per_sec{0.0};
+    std::atomic<double> snapshots_per_sec{0.0};
+};
+
+inline ServerMetrics g_metrics;
+
+// a client whose socket takes nothing for this long is disconnected
+constexpr double SEND_STALL_SECONDS=5.0;
+
+// ---- rooms ----
+
+struct InputEvent{
+    int player_id=0; // slot index, 0..g_max_players-1
+    int seq=0;
+    int dx=0; // -1, 0, 1
+    int dy=0; // -1, 0, 1
+    double ready_time=0.0; // when to apply
+    uint32_t gen=0; // Room::client_gen of the connection that sent it
+};
+
+// inputs in flight from one connection to its room's tick. the reactor (or
+// UDP thread) is the only producer and the worker ticking the room the only
+// consumer, so no lock is needed.
+constexpr size_t INPUT_RING_SIZE=128;
+typedef SpscRing<InputEvent,INPUT_RING_SIZE> InputRing;
+
+// player slots per room (--players), at most proto::MAX_PLAYERS
+inline int g_max_players=proto::DEFAULT_PLAYERS;
+
+// coins in play at once in each room (--coins), at most proto::MAX_COINS.
+// a collected coin respawns on the next tick.
+inline int g_num_coins=1;
+inline CoinPickupKernel g_coin_kernel=coin_pickup_scalar;
+
+// world size (--world WxH) and interest radius (--interest R, 0: every
+// client gets every entity)
+inline float g_world_width=proto::WORLD_WIDTH;
+inline float g_world_height=proto::WORLD_HEIGHT;
+inline float g_interest=0.0f;
+
+// ticks between one client's snapshots: every client starts at
+// g_send_interval (--send-rate, which is also the fastest it goes,
+// g_send_interval_min) and never slows past g_send_interval_max
+// (--min-send-rate), see SendRate
+inline int g_send_interval=send_interval_for_rate(proto::SEND_RATE_DEFAULT);
+inline int g_send_interval_min=send_interval_for_rate(proto::SEND_RATE_DEFAULT);
+inline int g_send_interval_max=send_interval_for_rate(proto::SEND_RATE_MIN);
+
+inline proto::WorldInfo world_info(){
+    proto::WorldInfo info;
+    info.width=static_cast<int>(g_world_width);
+    info.height=static_cast<int>(g_world_height);
+    info.interest=static_cast<int>(g_interest);
+    return info;
+}
+
+// snapshots recently sent to one client, indexed by tick % SNAPSHOT_HISTORY,
+// plus the newest tick that client has ACKed. deltas are encoded against it.
+// with --interest, sent holds the filtered snapshots and sent_coins the
+// coins that went with each.
+//
+// acked_time is when the newest ACK arrived, stored before acked_tick; if
+// another ACK lands between the worker's two loads the RTT it takes is a
+// little long, which the smoothing absorbs.
+struct ClientHistory{
+    proto::worldSnapshot sent[proto::SNAPSHOT_HISTORY];
+    double sent_time[proto::SNAPSHOT_HISTORY]={};
+    CoinInterestHistory sent_coins;
+    std::atomic<int> acked_tick{-1};
+    std::atomic<double> acked_time{0.0};
+    int rtt_tick=-1; // newest acked tick already turned into an RTT sample
+    SendRate rate;
+
+    void reset(){
+        for(auto& s : sent) s.tick=-1;
+        if(g_interest>0.0f) sent_coins.reset(g_num_coins);
+        acked_tick=-1;
+        rtt_tick=-1;
+        rate.reset(g_send_interval,g_send_interval_min,g_send_interval_max);
+    }
+
+    // feed the round trip of the newest ACK to the send rate, once
+    void sample_rtt(){
+        int acked=acked_tick.load();
+        if(acked<=rtt_tick) return;
+        rtt_tick=acked;
+        int slot=acked%proto::SNAPSHOT_HISTORY;
+        if(sent[slot].tick!=acked) return; // overwritten since
+        rate.on_rtt(acked_time.load()-sent_time[slot]);
+    }
+};
+
+// ---- UDP transport state (--udp) ----
+
+constexpr int UDP_SENT_WINDOW=256;
+
+struct UdpPeer{
+    sockaddr_in addr{};
+    uint32_t salt=0;
+    uint16_t next_seq=0;
+    proto::AckTracker recv_acks;
+    // which tick each recently sent STATE packet carried, by seq % window
+    uint16_t sent_seq[UDP_SENT_WINDOW]={};
+    int sent_tick[UDP_SENT_WINDOW]={};
+    int last_input_seq=-1;
+    double last_recv_time=0.0;
+};
+
+// tick durations of one room since the last stats report
+struct RoomStats{
+    long ticks=0;
+    long late=0; // ticks that finished after their deadline
+    double total=0.0;
+    double worst=0.0;
+
+    void record(double seconds, bool missed){
+        ticks++;
+        total+=seconds;
+        if(seconds>worst) worst=seconds;
+        if(missed) late++;
+    }
+
+    void reset(){
+        *this=RoomStats{};
+    }
+};
+
+// one independent match: its own world, clients and inputs. a room's tick
+// runs on one pool worker at a time; the reactor and UDP threads only touch
+// the client slots (under clients_mutex / udp_mutex) and the input rings.
+struct Room{
+    int id=0;
+
+    // world, owned by whichever worker is ticking the room
+    World world;
+    bool started=false;
+
+    // coin sections for this tick's frames
+    proto::coinUpdate all_coins;
+    proto::coinUpdate changed_coins;
+
+    // scratch for one tick (the text STATE line), reset as the tick starts
+    TickArena arena;
+
+    // --interest: active coins by cell, and the snapshot being filtered
+    // for one client
+    CoinInterestGrid coin_grid;
+    proto::worldSnapshot view;
+
+    // client slots, g_max_players of them
+    int client_socks[proto::MAX_PLAYERS]={};
+    std::atomic<bool> client_connected[proto::MAX_PLAYERS]={};
+    // bumped each time a slot is handed to a new connection, before it is
+    // marked connected; every input carries the generation it was sent
+    // under, so a slot's next player never gets the last one's inputs
+    std::atomic<uint32_t> client_gen[proto::MAX_PLAYERS]={};
+    // generation each slot's player was spawned for, owned by the ticking worker
+    uint32_t player_gen[proto::MAX_PLAYERS]={};
+    std::unique_ptr<ClientHistory[]> client_history;
+    std::unique_ptr<OutboundQueue[]> client_out; // TCP STATE not yet written
+    // guards TCP slot assignment in client_socks/client_connected; the
+    // reactor takes it to (un)assign slots, the ticking worker while
+    // broadcasting
+    std::mutex clients_mutex;
+
+    std::unique_ptr<UdpPeer[]> udp_peers;
+    std::mutex udp_mutex; // guards udp_peers
+
+    // per-slot input rings, and the wheel that holds drained inputs until
+    // the tick they become ready on. the wheel is owned by the ticking worker.
+    std::unique_ptr<InputRing[]> input_rings;
+    TimingWheel<InputEvent> input_wheel;
+    std::atomic<long> dropped_inputs{0}; // pushed into a full ring
+
+    double deadline=0.0; // when the current tick must be done
+    RoomStats stats;
+
+    MatchRecorder recorder; // writes the current match while --record is on
+    int matches=0;          // started so far, to name recordings
+
+    explicit Room(int room_id)
+        : id(room_id),
+          client_history(new ClientHistory[g_max_players]),
+          client_out(new OutboundQueue[g_max_players]),
+          udp_peers(new UdpPeer[g_max_players]),
+          input_rings(new InputRing[g_max_players]){}
+};
+
+// rooms (--rooms); see g_rooms in server.cpp
+inline int g_max_rooms=64;
+
+// threads one room's update_world may use (--sim-threads). the pool is
+// shared: a room that finds it busy with another room steps serially,
+// which gives the same world.
+inline int g_sim_threads=1;
+inline WorkPool* g_sim_pool=nullptr;
+inline std::mutex g_sim_mutex;
+
+// STATE encoding, binary by default; --text-state switches to text for debugging
+inline proto::StateFormat g_state_format=proto::StateFormat::Binary;
+
+inline bool g_use_udp=false;
+inline int g_udp_sock=-1;
+
+// extra seconds every input waits before it is applied (--input-delay).
+// 0 by default; for realistic network conditions put netem-proxy between
+// the clients and the server instead
+inline double g_input_delay=0.0;
+
+// ---- the tick ----
+
+// fresh world for a room that is about to start
+inline void reset_room(Room& r){
+    World& w=r.world;
+    w.id=r.id;
+    w.max_players=g_max_players;
+    w.num_coins=g_num_coins;
+    w.coin_kernel=g_coin_kernel;
+    w.log_spawns=g_num_coins==1 && g_max_rooms==1;
+    w.log_pickups=g_num_coins==1;
+    w.seed=std::random_device{}();
+    w.width=g_world_width;
+    w.height=g_world_height;
+    reset_world(w);
+    // sized for every coin up front so no tick has to grow them
+    r.all_coins.coins.reserve(static_cast<size_t>(g_num_coins));
+    r.changed_coins.coins.reserve(static_cast<size_t>(g_num_coins));
+    r.coin_grid.reset(w,g_interest);
+    r.stats.reset();
+
+    // inputs left over from the previous match
+    InputEvent stale;
+    for(int i=0;i<g_max_players;i++){
+        while(r.input_rings[i].pop(stale)){}
+    }
+    r.input_wheel.reset(0);
+}
+
+// bring the world's player set in line with the connected clients. runs at
+// the start of each tick so update_world never races with joins and leaves.
+// a slot that was given to a new connection since the last tick gets a
+// fresh player, even if this tick never saw it free.
+inline void sync_players(Room& r){
+    for(int i=0;i<g_max_players;i++){
+        bool connected=r.client_connected[i];
+        uint32_t gen=r.client_gen[i];
+        Player& p=r.world.players[i];
+        if(connected && p.active && r.player_gen[i]!=gen){
+            p.active=false;
+            r.recorder.leave(r.world.tick,i);
+            std::cout<<"Room "<<r.id<<": player "<<(i+1)<<" left the world\n";
+        }
+        if(connected && !p.active){
+            spawn_player(r.world,i);
+            r.player_gen[i]=gen;
+            r.recorder.join(r.world.tick,i);
+            std::cout<<"Room "<<r.id<<": player "<<p.id<<" entered the world\n";
+        }
+        else if(!connected && p.active){
+            p.active=false;
+            r.recorder.leave(r.world.tick,i);
+            std::cout<<"Room "<<r.id<<": player "<<(i+1)<<" left the world\n";
+        }
+    }
+}
+
+inline void queue_input(Room& r, int player_id, int seq, int dx, int dy){
+    InputEvent ev;
+    ev.player_id=player_id;
+    ev.seq=seq;
+    ev.dx=dx;
+    ev.dy=dy;
+    ev.ready_time=now_seconds()+g_input_delay;
+    ev.gen=r.client_gen[player_id];
+
+    g_metrics.inputs.fetch_add(1,std::memory_order_relaxed);
+    if(!r.input_rings[player_id].push(ev)){
+        r.dropped_inputs++;
+        g_metrics.inputs_dropped.fetch_add(1,std::memory_order_relaxed);
+    }
+}
+
+// ---- UDP helpers, callers hold the room's udp_mutex ----
+
+inline proto::UdpHeader next_udp_header(UdpPeer& p, uint8_t type){
+    proto::UdpHeader h;
+    h.type=type;
+    h.seq=p.next_seq++;
+    h.ack=p.recv_acks.ack;
+    h.ack_bits=p.recv_acks.ack_bits;
+    return h;
+}
+
+inline void udp_send_to(const UdpPeer& p, const uint8_t* data, size_t len){
+    ssize_t n=::sendto(g_udp_sock,data,len,0,(const sockaddr*)&p.addr,sizeof(p.addr));
+    if(n<0){
+        g_metrics.send_failures.fetch_add(1,std::memory_order_relaxed);
+        std::cerr<<"sendto() failed: "<<std::strerror(errno)<<"\n";
+        return;
+    }
+    g_metrics.bytes_sent.fetch_add(static_cast<uint64_t>(n),std::memory_order_relaxed);
+}
+
+// encode the frame for client slot: a delta against its newest acked
+// snapshot when that is still in history, otherwise a full keyframe. with
+// --interest both only cover what is near the client's player; without it
+// r.all_coins must already hold this tick's full coin set.
+inline size_t encode_for_client(Room& r, int slot, const proto::worldSnapshot& s,
+                         uint8_t* buf, size_t cap){
+    ClientHistory& h=r.client_history[slot];
+    const proto::worldSnapshot* view=&s;
+    const uint64_t* coins_now=nullptr;
+    if(g_interest>0.0f){
+        const Player& self=r.world.players[slot];
+        filter_players(s,self.id,self.x,self.y,g_interest,r.view);
+        view=&r.view;
+        uint64_t* bits=h.sent_coins.record(s.tick);
+        visible_coins(r.coin_grid,self.x,self.y,g_interest,bits,h.sent_coins.words);
+        coins_now=bits;
+    }
+
+    int base_tick=h.acked_tick.load();
+    size_t len=0;
+    if(base_tick>=0 && base_tick<s.tick && s.tick-base_tick<proto::SNAPSHOT_HISTORY){
+        const proto::worldSnapshot& base=h.sent[base_tick%proto::SNAPSHOT_HISTORY];
+        if(base.tick==base_tick){
+            if(coins_now){
+                h.sent_coins.since(base_tick,s.tick);
+                interest_coin_update(r.world,coins_now,h.sent_coins.stable.data(),
+                                     h.sent_coins.seen.data(),base_tick,
+                                     h.sent_coins.words,r.changed_coins);
+            }
+            else{
+                collect_coin_changes(r.world,base_tick,r.changed_coins);
+            }
+            len=proto::encode_state_delta(*view,base,r.changed_coins,buf,cap);
+        }
+    }
+    if(len==0){
+        if(coins_now){
+            interest_coin_update(r.world,coins_now,nullptr,nullptr,-1,h.sent_coins.words,
+                                 r.changed_coins);
+            len=proto::encode_state_binary(*view,r.changed_coins,buf,cap);
+        }
+        else{
+            len=proto::encode_state_binary(*view,r.all_coins,buf,cap);
+        }
+    }
+    h.sent[s.tick%proto::SNAPSHOT_HISTORY]=*view;
+    return len;
+}
+
+// queue one STATE frame for TCP client i and write what its socket will
+// take now. a client that stops reading only loses stale frames, until it
+// has taken nothing for SEND_STALL_SECONDS. caller holds clients_mutex.
+inline void send_state_tcp(Room& r, int i, const uint8_t* data, size_t len, double now){
+    OutboundQueue& q=r.client_out[i];
+    if(q.push(data,len)){
+        g_metrics.snapshots_replaced.fetch_add(1,std::memory_order_relaxed);
+    }
+    ssize_t n=q.flush(r.client_socks[i],now);
+    if(n>0){
+        g_metrics.bytes_sent.fetch_add(static_cast<uint64_t>(n),std::memory_order_relaxed);
+        return;
+    }
+    if(n<0 || now-q.last_progress>SEND_STALL_SECONDS){
+        g_metrics.send_failures.fetch_add(1,std::memory_order_relaxed);
+        std::cerr<<"Failed to send STATE to player "<<(i+1)<<" in room "<<r.id<<"\n";
+        // let the reactor see the connection close and free the slot
+        ::shutdown(r.client_socks[i],SHUT_RDWR);
+    }
+}
+
+// snapshot for tick to every client whose send rate has one due. the world
+// is only turned into a snapshot when at least one client gets it. the
+// slots are held for the whole broadcast, so a client can not be dropped
+// or (re)connected between the due scan and its send: clients_mutex over
+// TCP, udp_mutex over UDP, where the receive thread also updates each
+// peer's RTT and acked baseline.
+inline void broadcast_state(Room& r, int tick) {
+    std::lock_guard<std::mutex> slots_lock(g_use_udp ? r.udp_mutex : r.clients_mutex);
+
+    bool due[proto::MAX_PLAYERS];
+    int num_due=0;
+    for (int i=0;i<g_max_players;++i){
+        due[i]=false;
+        if (!r.client_connected[i]) continue;
+        ClientHistory& h=r.client_history[i];
+        h.sample_rtt();
+        if (!h.rate.due(tick)) continue;
+        due[i]=true;
+        num_due++;
+    }
+    if(num_due==0) return;
+    g_metrics.snapshots_sent.fetch_add(static_cast<uint64_t>(num_due),std::memory_order_relaxed);
+
+    proto::worldSnapshot s=build_snapshot(r.world,tick);
+    if(g_interest>0.0f) r.coin_grid.update(r.world);
+    else collect_all_coins(r.world,r.all_coins);
+
+    double now=now_seconds();
+    int slot=tick%proto::SNAPSHOT_HISTORY;
+
+    if(g_state_format==proto::StateFormat::Text){
+        // one line shared by every client due this tick
+        size_t cap=proto::text_state_bound(s,r.all_coins)+1;
+        char* line=r.arena.alloc_array<char>(cap);
+        size_t len=proto::encode_state(s,r.all_coins,line,cap-1);
+        line[len++]='\n';
+        for (int i=0;i<g_max_players;++i){
+            if (!due[i]) continue;
+            ClientHistory& h=r.client_history[i];
+            bool backlog=r.client_out[i].backlogged(r.client_socks[i]);
+            send_state_tcp(r,i,reinterpret_cast<const uint8_t*>(line),len,now);
+            h.sent_time[slot]=now;
+            h.rate.on_sent(tick,backlog);
+        }
+        return;
+    }
+
+    if(g_use_udp){
+        // STATE packets are fire-and-forget; acks come back on INPUT packets.
+        // there is no send queue to look at, so only the RTT slows a peer down.
+        static thread_local uint8_t packet[proto::UDP_HEADER_SIZE+proto::MAX_FRAME_SIZE];
+        for (int i=0;i<g_max_players;++i){
+            if (!due[i]) continue;
+            UdpPeer& p=r.udp_peers[i];
+            proto::UdpHeader h=next_udp_header(p,proto::PKT_STATE);
+            proto::write_udp_header(h,packet,sizeof(packet));
+            size_t len=encode_for_client(r,i,s,
+                                         packet+proto::UDP_HEADER_SIZE,
+                                         sizeof(packet)-proto::UDP_HEADER_SIZE);
+            p.sent_seq[h.seq%UDP_SENT_WINDOW]=h.seq;
+            p.sent_tick[h.seq%UDP_SENT_WINDOW]=tick;
+            udp_send_to(p,packet,proto::UDP_HEADER_SIZE+len);
+            ClientHistory& hist=r.client_history[i];
+            hist.sent_time[slot]=now;
+            hist.rate.on_sent(tick,false);
+        }
+        return;
+    }
+
+    static thread_local uint8_t frame_buf[proto::MAX_FRAME_SIZE];
+    for (int i=0;i<g_max_players;++i){
+        if (!due[i]) continue;
+        ClientHistory& h=r.client_history[i];
+        bool backlog=r.client_out[i].backlogged(r.client_socks[i]);
+        size_t len=encode_for_client(r,i,s,frame_buf,sizeof(frame_buf));
+        send_state_tcp(r,i,frame_buf,len,now);
+        h.sent_time[slot]=now;
+        h.rate.on_sent(tick,backlog);
+    }
+}
+
+const double TICK_DT=sim::TICK_DT;
+
+// one tick of one room; runs on a pool worker
+inline void tick_room(void* arg){
+    Room& r=*static_cast<Room*>(arg);
+    double frame_start=now_seconds();
+    uint64_t t0=now_nanos();
+    r.arena.reset();
+
+    if(r.world.tick%REC_KEYFRAME_INTERVAL==0) r.recorder.keyframe(r.world);
+    sync_players(r);
+
+    // file new inputs under the first tick that starts at or after their
+    // ready_time, then apply everything due now. a late arrival no longer
+    // holds back inputs queued behind it. inputs still in flight from a
+    // connection that has since left are dropped rather than applied to
+    // whoever took its slot.
+    InputEvent ev;
+    for(int i=0;i<g_max_players;i++){
+        while(r.input_rings[i].pop(ev)){
+            long ahead=static_cast<long>(std::ceil((ev.ready_time-frame_start)/TICK_DT));
+            r.input_wheel.schedule(r.world.tick+ahead,ev);
+        }
+    }
+    r.input_wheel.advance(r.world.tick,[&](const InputEvent& e){
+        if(e.gen!=r.player_gen[e.player_id] || !r.world.players[e.player_id].active) return;
+        apply_input(r.world,e.player_id,e.seq,e.dx,e.dy);
+        r.recorder.input(r.world.tick,e.player_id,e.seq,e.dx,e.dy);
+    });
+
+    uint64_t t1=now_nanos();
+
+    if(g_sim_pool && g_sim_mutex.try_lock()){
+        update_world(r.world,r.world.tick,g_sim_pool);
+        g_sim_mutex.unlock();
+    }
+    else update_world(r.world,r.world.tick);
+    uint64_t t2=now_nanos();
+
+    broadcast_state(r,r.world.tick);
+    r.world.tick++;
+    uint64_t t3=now_nanos();
+
+    g_metrics.tick_input.record(t1-t0);
+    g_metrics.tick_update.record(t2-t1);
+    g_metrics.tick_broadcast.record(t3-t2);
+    g_metrics.tick_total.record(t3-t0);
+
+    double frame_end=now_seconds();
+    bool missed=frame_end>r.deadline;
+    if(missed) g_metrics.late_ticks.fetch_add(1,std::memory_order_relaxed);
+    r.stats.record(frame_end-frame_start,missed);
+}
@@ -0,0 +1,106 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+
+#include "../common/simulation.hpp"
+
+// how often one client is sent a snapshot. the world is simulated every
+// tick, but each client only gets a snapshot every interval ticks, and the
+// interval moves between the fastest and slowest the server allows:
+//
+//   - it doubles when the client falls behind: its TCP send queue still
+//     held earlier frames when the next one was due, or its smoothed RTT
+//     has risen well above the lowest seen (the extra is time spent
+//     queued somewhere on the path)
+//   - it shrinks by one tick after SEND_CLEAN_TO_SPEED_UP sends in a row
+//     without either
+//
+// after a back-off there is no further one for a round trip, so the queue
+// that caused it gets the chance to drain first.
+//
+// owned by whichever worker is ticking the client's room.
+
+// sends in a row without congestion before the rate goes up a step
+constexpr int SEND_CLEAN_TO_SPEED_UP=8;
+
+// smoothed RTT this far above the floor counts as queueing
+constexpr double RTT_QUEUE_SLACK=0.030;
+
+// gains of the RTT averages: srtt as in TCP (RFC 6298), the floor creeps
+// up slowly so a path that really got longer is not read as congestion
+// forever
+constexpr double RTT_GAIN=0.125;
+constexpr double RTT_FLOOR_GAIN=0.002;
+
+// ticks between snapshots for a rate in snapshots per second
+inline int send_interval_for_rate(int rate){
+    int interval=static_cast<int>(std::lround(static_cast<double>(proto::TICK_RATE)/rate));
+    return std::max(interval,1);
+}
+
+struct SendRate{
+    int interval=1;      // ticks between snapshots
+    int min_interval=1;  // fastest allowed
+    int max_interval=1;  // slowest allowed
+    int next_tick=0;     // first tick the next snapshot may go out on
+    int hold_until=0;    // no back-off before this tick
+    int clean=0;         // sends in a row without congestion
+
+    double srtt=0.0;      // smoothed round trip in seconds, 0 until sampled
+    double rtt_floor=0.0; // lowest smoothed round trip, the path without queueing
+
+    // start a new client at start ticks between snapshots; the first one is
+    // due straight away
+    void reset(int start, int fastest, int slowest){
+        min_interval=fastest;
+        max_interval=std::max(fastest,slowest);
+        interval=std::clamp(start,min_interval,max_interval);
+        next_tick=0;
+        hold_until=0;
+        clean=0;
+        srtt=0.0;
+        rtt_floor=0.0;
+    }
+
+    bool due(int tick) const{ return tick>=next_tick; }
+
+    // round trip from sending a snapshot to its ACK coming back
+    void on_rtt(double sample){
+        if(sample<0.0) return;
+        if(srtt==0.0){
+            srtt=sample;
+            rtt_floor=sample;
+            return;
+        }
+        srtt+=(sample-srtt)*RTT_GAIN;
+        // the floor follows the smoothed RTT, not single samples: on a
+        // jittery path the fastest sample is far below the usual round
+        // trip, and measuring against it would read jitter as queueing
+        if(srtt<rtt_floor) rtt_floor=srtt;
+        else rtt_floor+=(srtt-rtt_floor)*RTT_FLOOR_GAIN;
+    }
+
+    bool queueing() const{
+        return srtt>0.0 && srtt>rtt_floor+RTT_QUEUE_SLACK;
+    }
+
+    // a snapshot went out on tick. backlog tells whether the earlier ones
+    // were still waiting in the client's send queue when it was due.
+    void on_sent(int tick, bool backlog){
+        if(backlog || queueing()){
+            clean=0;
+            if(tick>=hold_until && interval<max_interval){
+                interval=std::min(interval*2,max_interval);
+                hold_until=tick+interval+static_cast<int>(std::ceil(srtt/sim::TICK_DT));
+            }
+        }
+        else if(++clean>=SEND_CLEAN_TO_SPEED_UP){
+            clean=0;
+            if(interval>min_interval) interval--;
+        }
+        next_tick=tick+interval;
+    }
+
+    double rate() const{ return static_cast<double>(proto::TICK_RATE)/interval; }
+};
@@ -1,21 +1,46 @@
 #include <iostream>
 #include <thread>
 #include <vector>
-#include <queue>
+#include <deque>
+#include <unordered_map>
+#include <memory>
+#include <algorithm>
 #include <mutex>
 #include <atomic>
 #include <cmath>
 #include <random>
 #include <string>
+#include <sstream>
+#include <fstream>
 #include <cstring>
+#include <cstdlib>
+#include <cstdio>
+#include <ctime>
 #include <unistd.h>
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
+#include <sys/time.h>
+#include <sys/epoll.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <netinet/tcp.h>
 
 #include "../common/utils.hpp"
 #include "../common/protocol.hpp"
+#include "../common/simulation.hpp"
+#include "../common/spatial_hash.hpp"
+#include "../common/coin_field.hpp"
+#include "../common/work_pool.hpp"
+#include "../common/spsc_ring.hpp"
+#include "../common/timing_wheel.hpp"
+#include "../common/histogram.hpp"
+#include "../common/tick_scheduler.hpp"
+#include "../common/stream_framer.hpp"
+#include "../common/tick_arena.hpp"
+#include "world.hpp"
+#include "room.hpp"
 
 using std::cout;
 using std::cerr;
@@ -23,331 +48,967 @@ using std::endl;
 
 #define nl "\n"
 
+//----- metrics -----
+
+// g_metrics is in room.hpp, with the tick that records into it
+double g_start_time=0.0;
+
 //----- networking helpers -----
 
-bool send_all(int sock, const std::string& data){
-    const char* buf=data.c_str();
+// client sockets are non-blocking (the reactor owns their reads), so a
+// full send buffer is waited out with poll() for up to SEND_TIMEOUT_MS.
+// only the reactor's one-off lines use this; STATE goes through each
+// client's OutboundQueue and never waits.
+constexpr int SEND_TIMEOUT_MS=100;
+
+bool send_all(int sock, const char* buf, size_t len){
     size_t total=0;
-    size_t len=data.size();
     while(total<len){
-        ssize_t n=::send(sock,buf+total,len-total,0);
+        ssize_t n=::send(sock,buf+total,len-total,MSG_NOSIGNAL);
+        if(n<0 && (errno==EAGAIN || errno==EWOULDBLOCK || errno==EINTR)){
+            pollfd pfd{sock,POLLOUT,0};
+            if(errno!=EINTR && ::poll(&pfd,1,SEND_TIMEOUT_MS)<=0){
+                g_metrics.send_failures.fetch_add(1,std::memory_order_relaxed);
+                return false;
+            }
+            continue;
+        }
         if(n<=0){
+            g_metrics.send_failures.fetch_add(1,std::memory_order_relaxed);
             return false;
         }
         total+=static_cast<size_t>(n);
+        g_metrics.bytes_sent.fetch_add(static_cast<uint64_t>(n),std::memory_order_relaxed);
     }
     return true;
 }
 
-// same but automatically append '\n'
-bool send_line(int sock, const std::string& line){
-    std::string data=line;
-    data.push_back('\n');
-    return send_all(sock,data);
+bool send_all(int sock, const std::string& data){
+    return send_all(sock,data.c_str(),data.size());
 }
 
+// same but automatically append '\n'; takes the line by value so a
+// temporary is extended in place rather than copied
+bool send_line(int sock, std::string line){
+    line.push_back('\n');
+    return send_all(sock,line);
+}
 
-// --- Game structures ---
+// ---- rooms ----
 
-struct Player{
-    int id=0;
-    float x=0.0f;
-    float y=0.0f;
-    float vx=0.0f;
-    float vy=0.0f;
-    int score=0;
-};
+// rooms are created up front (--rooms) so the lobby and the scheduler can
+// index them without locking the list
+std::vector<std::unique_ptr<Room>> g_rooms;
+constexpr int MAX_ROOMS=1024;
 
-struct Coin{
-    float x=0.0f;
-    float y=0.0f;
-    bool active=false;
-};
+// serializes slot assignment across rooms (TCP reactor and UDP thread)
+std::mutex g_lobby_mutex;
 
-struct InputEvent{
-    int player_id=0; // 0 or 1
-    int seq=0;
-    int dx=0; // -1, 0, 1
-    int dy=0; // -1, 0, 1
-    double ready_time=0.0; // when to apply
-};
+// tick workers (--workers), 0 = one per hardware thread
+int g_num_workers=0;
 
-Player g_players[2];
-Coin g_coin;
+std::atomic<bool> g_running{true};
 
-int g_client_socks[2]={-1,-1};
-std::atomic<bool> g_client_connected[2]={false,false};
+// directory to record every match into (--record), empty = off
+std::string g_record_dir;
 
-std::mutex g_input_mutex;
-std::queue<InputEvent> g_input_queue;
+// port for TCP and UDP (--port)
+int g_port=proto::SERVER_PORT;
 
-std::atomic<bool> g_running{true};
+// ---- lobby ----
 
-// random generator
-std::mt19937 g_rng{std::random_device{}()};
+int connected_players(const Room& r){
+    int n=0;
+    for(int i=0;i<g_max_players;i++){
+        if(r.client_connected[i]) n++;
+    }
+    return n;
+}
 
-// game logic helpers
+// first free player slot, filling rooms in order so new connections are
+// paired up in the lowest room still short of players. caller holds
+// g_lobby_mutex. returns nullptr when every room is full.
+Room* find_free_slot(int& slot){
+    for(auto& room : g_rooms){
+        for(int i=0;i<g_max_players;i++){
+            if(!room->client_connected[i]){
+                slot=i;
+                return room.get();
+            }
+        }
+    }
+    return nullptr;
+}
 
-void spawn_coin(){
-    std::uniform_real_distribution<float> dist_x(proto::COIN_RADIUS,
-                                                 proto::WORLD_WIDTH-proto::COIN_RADIUS);
-    std::uniform_real_distribution<float> dist_y(proto::COIN_RADIUS,
-                                                 proto::WORLD_HEIGHT-proto::COIN_RADIUS);
+// ---- TCP reactor ----
 
-    g_coin.x=dist_x(g_rng);
-    g_coin.y=dist_y(g_rng);
-    g_coin.active=true;
-    cout<<"Spawned coint at ("<<g_coin.x<<", "<<g_coin.y<<")\n";
-}
+// one accepted TCP connection, owned by the reactor thread
+struct TcpConn{
+    int fd=-1;
+    Room* room=nullptr; // nullptr while queued for a free player slot
+    int player_id=-1;
+    StreamFramer in; // client lines are short, the default capacity is plenty
+};
 
-void init_players() {
-    // Two starting positions: left and right side of the world
-    g_players[0].id=1;
-    g_players[0].x=proto::WORLD_WIDTH * 0.25f;
-    g_players[0].y=proto::WORLD_HEIGHT * 0.5f;
-    g_players[0].vx=0.0f;
-    g_players[0].vy=0.0f;
-    g_players[0].score = 0;
-
-    g_players[1].id=2;
-    g_players[1].x=proto::WORLD_WIDTH * 0.75f;
-    g_players[1].y=proto::WORLD_HEIGHT * 0.5f;
-    g_players[1].vx=0.0f;
-    g_players[1].vy=0.0f;
-    g_players[1].score=0;
+bool set_nonblocking(int fd){
+    int flags=fcntl(fd,F_GETFL,0);
+    return flags>=0 && fcntl(fd,F_SETFL,flags|O_NONBLOCK)==0;
 }
 
-void apply_input_event(const InputEvent& ev){
-    Player& p=g_players[ev.player_id];
-    p.vx=static_cast<float>(ev.dx)*proto::PLAYER_SPEED;
-    p.vy=static_cast<float>(ev.dy)*proto::PLAYER_SPEED;
+// give c the first free player slot in any room, if there is one
+bool assign_slot(TcpConn& c){
+    std::lock_guard<std::mutex> lobby_lock(g_lobby_mutex);
+    int slot=-1;
+    Room* r=find_free_slot(slot);
+    if(!r) return false;
+
+    std::lock_guard<std::mutex> lock(r->clients_mutex);
+    c.room=r;
+    c.player_id=slot;
+    r->client_history[slot].reset();
+    r->client_out[slot].reset(now_seconds());
+    r->client_socks[slot]=c.fd;
+    r->client_gen[slot]++;
+    r->client_connected[slot]=true;
+
+    cout<<"Room "<<r->id<<": player "<<(slot+1)<<" joined on fd "<<c.fd<<nl;
+    // WELCOME <id> <world width> <world height> <interest radius>
+    proto::WorldInfo info=world_info();
+    send_line(c.fd,"WELCOME "+std::to_string(slot+1)+" "+std::to_string(info.width)+" "+
+                   std::to_string(info.height)+" "+std::to_string(info.interest));
+    return true;
 }
 
-void update_world(double dt){
-    for(int i=0;i<2;i++){
-        Player& p=g_players[i];
-        p.x+=p.vx*static_cast<float>(dt);
-        p.y+=p.vy*static_cast<float>(dt);
+void handle_client_line(TcpConn& c, std::string_view line){
+    int player_id=c.player_id;
 
-        if(p.x<proto::PLAYER_RADIUS) p.x=proto::PLAYER_RADIUS;
-        if(p.x>proto::WORLD_WIDTH-proto::PLAYER_RADIUS)
-            p.x=proto::WORLD_WIDTH-proto::PLAYER_RADIUS;
-        if(p.y<proto::PLAYER_RADIUS) p.y=proto::PLAYER_RADIUS;
-        if(p.y>proto::WORLD_HEIGHT-proto::PLAYER_RADIUS)
-            p.y=proto::WORLD_HEIGHT-proto::PLAYER_RADIUS;
+    // parse input
+    if(line.rfind("INPUT ", 0)==0){
+        if(!c.room) return; // still waiting for a slot
+        proto::FieldReader f(line);
+        int seq,dx,dy;
+        if(f.skip() && f.read(seq) && f.read(dx) && f.read(dy)){
+            queue_input(*c.room,player_id,seq,dx,dy);
+        }
+    }
+    else if(line.rfind("ACK ", 0)==0){
+        if(!c.room) return;
+        // newest snapshot the client holds, usable as a delta baseline
+        proto::FieldReader f(line);
+        int acked;
+        if(!(f.skip() && f.read(acked))) return;
+        ClientHistory& h=c.room->client_history[player_id];
+        if(acked>h.acked_tick.load()){
+            h.acked_time=now_seconds();
+            h.acked_tick=acked;
+        }
+    }
+    else if(line.rfind("JOIN", 0)==0){
+        // Not strictly needed if we auto-assign player index,
+        // but you could parse player name here if you want.
+        cout<<"Connection on fd "<<c.fd<<" sent JOIN.\n";
     }
+    else{
+        // Unknown message type; ignore for now.
+        cout<<"Unknown message on fd "<<c.fd<<": "<<line<<nl;
+    }
+}
 
-    // player collision
-    float dx=g_players[0].x-g_players[1].x;
-    float dy=g_players[0].y-g_players[1].y;
-    float dist=std::sqrt(dx*dx+dy*dy);
+// read everything available on c. false once the peer is gone.
+// a line that does not fit the framer's buffer is an error, so is any
+// binary frame: clients only send text.
+bool drain_client(TcpConn& c){
+    while(true){
+        ssize_t n=c.in.fill(c.fd);
+        if(n==0) return false;
+        if(n<0){
+            if(errno==EAGAIN || errno==EWOULDBLOCK) break;
+            if(errno==EINTR) continue;
+            return false;
+        }
 
-    float minDist=proto::PLAYER_RADIUS*2.0f;
-    if (dist<minDist && dist > 0.0f){
-        float push=(minDist - dist)*0.5f;
-        float nx=dx/dist;
-        float ny=dy/dist;
+        g_metrics.bytes_received.fetch_add(static_cast<uint64_t>(n),std::memory_order_relaxed);
 
-        g_players[0].x+=nx*push;
-        g_players[0].y+=ny*push;
-        g_players[1].x-=nx*push;
-        g_players[1].y-=ny*push;
+        StreamFramer::Frame f;
+        while(c.in.next(f)){
+            if(f.binary) return false;
+            handle_client_line(c,f.data);
+        }
     }
+    return true;
+}
 
-    // coin spawning
-    if(!g_coin.active){
-        spawn_coin();
+// single event loop for every TCP connection: accepts continuously, parses
+// input from all of them and hands InputEvents to their room.
+// connections beyond the rooms' player slots wait in FIFO order for one to
+// free up.
+void tcp_reactor_loop(int listen_sock){
+    int ep=epoll_create1(0);
+    if(ep<0){
+        cerr<<"epoll_create1() failed: "<<std::strerror(errno)<<endl;
+        g_running=false;
+        return;
     }
 
-    // coin pickup checks
-    const float pickup_dist=proto::PLAYER_RADIUS+proto::COIN_RADIUS;
-    const float pickup_dist_sq=pickup_dist*pickup_dist;
+    epoll_event ev{};
+    ev.events=EPOLLIN;
+    ev.data.fd=listen_sock;
+    epoll_ctl(ep,EPOLL_CTL_ADD,listen_sock,&ev);
+
+    std::unordered_map<int,TcpConn> conns;
+    std::deque<int> waiting;
+
+    auto close_conn=[&](int fd){
+        auto it=conns.find(fd);
+        if(it==conns.end()) return;
+        Room* r=it->second.room;
+        int player_id=it->second.player_id;
+        epoll_ctl(ep,EPOLL_CTL_DEL,fd,nullptr);
+        g_metrics.tcp_connections.fetch_sub(1,std::memory_order_relaxed);
+
+        if(!r){
+            ::close(fd);
+            conns.erase(it);
+            waiting.erase(std::remove(waiting.begin(),waiting.end(),fd),waiting.end());
+            return;
+        }
 
-    for(int i=0;i<2;i++){
-        if(!g_coin.active) break;
+        {
+            std::lock_guard<std::mutex> lock(r->clients_mutex);
+            ::close(fd);
+            conns.erase(it);
+            cerr<<"Room "<<r->id<<": player "<<(player_id+1)<<" disconnected or recv error. \n";
+            r->client_connected[player_id]=false;
+            r->client_socks[player_id]=-1;
+        }
 
-        Player& p=g_players[i];
-        float dx=p.x-g_coin.x;
-        float dy=p.y-g_coin.y;
-        float dist_sq=dx*dx+dy*dy;
+        // hand the freed slot to the longest-waiting connection
+        while(!waiting.empty()){
+            int next=waiting.front();
+            waiting.pop_front();
+            auto w=conns.find(next);
+            if(w!=conns.end() && assign_slot(w->second)) break;
+        }
+    };
 
-        if(dist_sq<=pickup_dist_sq){
-            p.score+=1;
-            g_coin.active=false;
-            cout<<"Player "<<p.id<<" picked up coin! Score is : "<<p.score<<nl;
+    std::vector<epoll_event> events(256);
+    while(g_running){
+        int n=epoll_wait(ep,events.data(),static_cast<int>(events.size()),100);
+        if(n<0){
+            if(errno==EINTR) continue;
+            cerr<<"epoll_wait() failed: "<<std::strerror(errno)<<endl;
+            break;
         }
-    }
-}
 
+        for(int i=0;i<n;i++){
+            int fd=events[i].data.fd;
+
+            if(fd==listen_sock){
+                while(true){
+                    sockaddr_in client_addr;
+                    socklen_t client_len=sizeof(client_addr);
+                    int client_sock=::accept(listen_sock,(sockaddr*)&client_addr,&client_len);
+                    if(client_sock<0){
+                        if(errno!=EAGAIN && errno!=EWOULDBLOCK && errno!=EINTR){
+                            cerr<<"accept() failed: "<<std::strerror(errno)<<endl;
+                        }
+                        break;
+                    }
+                    set_nonblocking(client_sock);
+                    // one small STATE frame per tick, written in one call;
+                    // Nagle would only hold it back waiting for an ACK
+                    int nodelay=1;
+                    setsockopt(client_sock,IPPROTO_TCP,TCP_NODELAY,&nodelay,sizeof(nodelay));
+
+                    TcpConn& c=conns[client_sock];
+                    c.fd=client_sock;
+                    g_metrics.tcp_connections.fetch_add(1,std::memory_order_relaxed);
+
+                    epoll_event cev{};
+                    cev.events=EPOLLIN|EPOLLRDHUP;
+                    cev.data.fd=client_sock;
+                    epoll_ctl(ep,EPOLL_CTL_ADD,client_sock,&cev);
+
+                    if(!assign_slot(c)){
+                        waiting.push_back(client_sock);
+                    }
+                }
+                continue;
+            }
 
-proto::worldSnapshot build_snapshot(int tick){
-    proto::worldSnapshot s;
-    s.tick=tick;
-    s.server_time=now_seconds();
+            auto it=conns.find(fd);
+            if(it==conns.end()) continue;
 
-    for(int i=0;i<2;i++){
-        s.players[i].id=g_players[i].id;
-        s.players[i].x=g_players[i].x;
-        s.players[i].y=g_players[i].y;
-        s.players[i].score=g_players[i].score;
+            bool alive=!(events[i].events&(EPOLLERR|EPOLLHUP));
+            if(alive && (events[i].events&(EPOLLIN|EPOLLRDHUP))){
+                alive=drain_client(it->second);
+            }
+            if(!alive){
+                close_conn(fd);
+            }
+        }
     }
 
-    s.coin_x=g_coin.x;
-    s.coin_y=g_coin.y;
-    s.coin_active=g_coin.active;
-
-    return s;
+    for(auto& kv : conns){
+        ::close(kv.first);
+    }
+    ::close(ep);
 }
 
-void broadcast_state(int tick) {
-    proto::worldSnapshot s=build_snapshot(tick);
-    std::string line=proto::encode_state(s);
+// ---- UDP receive thread ----
 
-    for (int i=0;i<2;++i){
-        if (!g_client_connected[i]) continue;
-        int sock=g_client_socks[i];
-        if(!send_line(sock, line)){
-            cerr<<"Failed to send STATE to player "<<(i+1)<<"\n";
-        }
-    }
+// where each connected UDP address plays, by address key.
+// only the receive thread touches this.
+struct UdpSlot{
+    Room* room=nullptr;
+    int slot=-1;
+};
+std::unordered_map<uint64_t,UdpSlot> g_udp_slots;
+
+// seconds between scans for timed-out peers; the socket's receive timeout
+// wakes the loop this often when nobody sends
+constexpr double UDP_TIMEOUT_SCAN=0.1;
+
+uint64_t addr_key(const sockaddr_in& a){
+    return (static_cast<uint64_t>(a.sin_addr.s_addr)<<16)|a.sin_port;
 }
 
-// network listener and client threads
+void drop_udp_peer(Room& r, int player_id, const char* reason){
+    cerr<<"Room "<<r.id<<": player "<<(player_id+1)<<" "<<reason<<nl;
+    std::lock_guard<std::mutex> lock(r.udp_mutex);
+    g_udp_slots.erase(addr_key(r.udp_peers[player_id].addr));
+    r.client_connected[player_id]=false;
+}
+
+void handle_udp_connect(const sockaddr_in& from, const uint8_t* data, size_t len){
+    uint32_t salt=0;
+    int unused=0;
+    if(!proto::decode_udp_handshake(data,len,proto::PKT_CONNECT,salt,unused)) return;
+
+    uint8_t reply[64];
+    auto it=g_udp_slots.find(addr_key(from));
+    if(it==g_udp_slots.end()){
+        std::lock_guard<std::mutex> lobby_lock(g_lobby_mutex);
+        int slot=-1;
+        Room* r=find_free_slot(slot);
+        if(!r){
+            UdpPeer tmp;
+            tmp.addr=from;
+            size_t n=proto::encode_udp_handshake(next_udp_header(tmp,proto::PKT_DENY),
+                                                 salt,0,reply,sizeof(reply));
+            udp_send_to(tmp,reply,n);
+            return;
+        }
 
-void handle_client(int player_id, int sock){
-    cout<<"Client thread started for player "<<(player_id+1)<<nl;
-    {
-        std::string welcome="WELCOME "+std::to_string(player_id+1);
-        send_line(sock,welcome);
+        std::lock_guard<std::mutex> lock(r->udp_mutex);
+        UdpPeer& p=r->udp_peers[slot];
+        p=UdpPeer{};
+        p.addr=from;
+        p.salt=salt;
+        p.last_recv_time=now_seconds();
+        r->client_history[slot].reset();
+        r->client_gen[slot]++;
+        r->client_connected[slot]=true;
+        it=g_udp_slots.emplace(addr_key(from),UdpSlot{r,slot}).first;
+
+        cout<<"Room "<<r->id<<": player "<<(slot+1)<<" connected over UDP from "
+            <<inet_ntoa(from.sin_addr)<<":"<<ntohs(from.sin_port)<<endl;
+    }
+    else if(it->second.room->udp_peers[it->second.slot].salt!=salt){
+        return; // stale CONNECT from an earlier session on the same port
     }
 
-    std::string buffer;
+    // (re)send ACCEPT; CONNECT is retried until the client sees one
+    Room& r=*it->second.room;
+    int slot=it->second.slot;
+    std::lock_guard<std::mutex> lock(r.udp_mutex);
+    UdpPeer& p=r.udp_peers[slot];
+    size_t n=proto::encode_udp_handshake(next_udp_header(p,proto::PKT_ACCEPT),
+                                         salt,slot+1,reply,sizeof(reply),world_info());
+    udp_send_to(p,reply,n);
+}
 
-    char recv_buf[1024];
-    while(g_running && g_client_connected[player_id]){
-        ssize_t n=::recv(sock,recv_buf,sizeof(recv_buf),0);
-        if(n<=0){
-            cerr<<"Player "<<(player_id+1)<<" disconnected or recv error. \n";
-            g_client_connected[player_id]=false;
-            ::close(sock);
-            g_client_socks[player_id]=-1;
-            break;
+void handle_udp_input(Room& r, int player_id, const proto::UdpHeader& h,
+                      const uint8_t* data, size_t len){
+    std::lock_guard<std::mutex> lock(r.udp_mutex);
+    UdpPeer& p=r.udp_peers[player_id];
+    if(!p.recv_acks.on_receive(h.seq)) return; // duplicate or too old
+    p.last_recv_time=now_seconds();
+
+    // acked STATE packets move the delta baseline forward
+    ClientHistory& hist=r.client_history[player_id];
+    proto::for_each_acked(h.ack,h.ack_bits,[&](uint16_t seq){
+        int idx=seq%UDP_SENT_WINDOW;
+        if(p.sent_seq[idx]==seq && p.sent_tick[idx]>hist.acked_tick.load()){
+            hist.acked_time=p.last_recv_time;
+            hist.acked_tick=p.sent_tick[idx];
         }
+    });
 
-        buffer.append(recv_buf,recv_buf+n);
+    proto::InputCmd cmds[proto::UDP_INPUT_REDUNDANCY];
+    int count=proto::decode_udp_input(data,len,cmds,proto::UDP_INPUT_REDUNDANCY);
 
-        size_t pos;
-        while((pos=buffer.find('\n'))!=std::string::npos){
-            std::string line=buffer.substr(0,pos);
-            buffer.erase(0,pos+1);
+    // newest first on the wire; queue anything not seen yet, oldest first
+    for(int i=count-1;i>=0;i--){
+        if(cmds[i].seq<=p.last_input_seq) continue;
+        p.last_input_seq=cmds[i].seq;
+        queue_input(r,player_id,cmds[i].seq,cmds[i].dx,cmds[i].dy);
+    }
+}
 
-            if(!line.empty() && line.back()=='\r'){
-                line.pop_back();
-            }
+void udp_receive_loop(){
+    uint8_t buf[proto::UDP_MAX_PACKET];
+    double next_timeout_scan=0.0;
 
-            if(line.empty()) continue;
-
-            // parse input
-            if(line.rfind("INPUT ", 0)==0){
-                std::istringstream iss(line);
-                std::string tag;
-                int seq,dx,dy;
-                if(iss>>tag>>seq>>dx>>dy){
-                    InputEvent ev;
-                    ev.player_id=player_id;
-                    ev.seq=seq;
-                    ev.dx=dx;
-                    ev.dy=dy;
-                    ev.ready_time=now_seconds()+proto::SIMULATED_LATENCY; // simulate latency
-
-                    std::lock_guard<std::mutex> lock(g_input_mutex);
-                    g_input_queue.push(ev);
+    while(g_running){
+        sockaddr_in from;
+        socklen_t from_len=sizeof(from);
+        ssize_t n=::recvfrom(g_udp_sock,buf,sizeof(buf),0,(sockaddr*)&from,&from_len);
+
+        if(n>0){
+            g_metrics.bytes_received.fetch_add(static_cast<uint64_t>(n),std::memory_order_relaxed);
+            proto::UdpHeader h;
+            if(proto::read_udp_header(buf,static_cast<size_t>(n),h)){
+                if(h.type==proto::PKT_CONNECT){
+                    handle_udp_connect(from,buf,static_cast<size_t>(n));
+                }
+                else{
+                    auto it=g_udp_slots.find(addr_key(from));
+                    if(it!=g_udp_slots.end()){
+                        Room& r=*it->second.room;
+                        int slot=it->second.slot;
+                        if(h.type==proto::PKT_INPUT){
+                            handle_udp_input(r,slot,h,buf,static_cast<size_t>(n));
+                        }
+                        else if(h.type==proto::PKT_DISCONNECT){
+                            drop_udp_peer(r,slot,"disconnected.");
+                        }
+                    }
                 }
             }
-            else if(line.rfind("JOIN", 0)==0){
-                // Not strictly needed if we auto-assign player index,
-                // but you could parse player name here if you want.
-                cout<<"Player "<<(player_id+1)<<" sent JOIN.\n";
-            }
-            else{
-                // Unknown message type; ignore for now.
-                cout<<"Unknown message from player "<<(player_id+1)<<": "<<line<<nl;
+        }
+
+        // no TCP close to tell us a client is gone, so time them out. only
+        // the connected peers are walked, and at most every
+        // UDP_TIMEOUT_SCAN, not after every packet. last_recv_time is only
+        // written on this thread.
+        double now=now_seconds();
+        if(now<next_timeout_scan) continue;
+        next_timeout_scan=now+UDP_TIMEOUT_SCAN;
+        for(auto it=g_udp_slots.begin();it!=g_udp_slots.end();){
+            UdpSlot peer=it->second;
+            ++it; // dropping the peer erases its entry
+            if(now-peer.room->udp_peers[peer.slot].last_recv_time>proto::UDP_TIMEOUT){
+                drop_udp_peer(*peer.room,peer.slot,"timed out.");
             }
         }
     }
-
-    cout<<"Client thread exiting for player "<<(player_id+1)<<nl;
 }
 
-// 2 client for now
-void accept_clients(int server_sock){
-    for(int i=0;i<2;i++){
-        cout<<"Waiting for player "<<(i+1)<<" to connect..."<<endl;
-
-        sockaddr_in client_addr;
-        socklen_t client_len=sizeof(client_addr);
-        int client_sock=::accept(server_sock,(sockaddr*)&client_addr, &client_len);
-        if(client_sock<0){
-            cerr<<"accept() failed: "<<std::strerror(errno)<<endl;
-            --i; // retry
-            continue;
-        }
-
-        cout<<"Player "<<(i+1)<<" connected from "
-            <<inet_ntoa(client_addr.sin_addr)<<":"<<ntohs(client_addr.sin_port)<<endl;
+// =============== GAME LOOP ====================
 
-        g_client_socks[i]=client_sock;
-        g_client_connected[i]=true;
+// how often per-room tick stats are printed
+constexpr double STATS_INTERVAL=5.0;
+
+// tick clock options: --tick-wait sleep|timerfd, --spin-us N,
+// --catch-up burst|skip, --pin-cpu N (-1 = not pinned)
+TickWait g_tick_wait=TickWait::Sleep;
+int g_spin_us=200;
+CatchUp g_catch_up=CatchUp::Burst;
+int g_pin_cpu=-1;
+TickScheduler g_tick_sched; // the stats endpoint reads its jitter histogram
+
+// record the match r is starting as <dir>/room<id>-<unix time>-<match>.rec
+void start_recording(Room& r){
+    r.matches++;
+    std::string path=g_record_dir+"/room"+std::to_string(r.id)+"-"+
+                     std::to_string(static_cast<long>(std::time(nullptr)))+"-"+
+                     std::to_string(r.matches)+".rec";
+    if(r.recorder.open(path,r.world)){
+        cout<<"Room "<<r.id<<": recording to "<<path<<nl;
+    }
+    else{
+        cerr<<"Room "<<r.id<<": cannot record to "<<path<<": "<<std::strerror(errno)<<nl;
+    }
+}
 
-        std::thread t(handle_client,i,client_sock);
-        t.detach();
+// start a room once two players are in (or one, for a one-slot room);
+// anyone after that joins the running match. a room everyone has left goes
+// back to waiting with a fresh world. runs between batches.
+void update_room_state(Room& r){
+    int players=connected_players(r);
+    if(!r.started && players>=std::min(2,g_max_players)){
+        reset_room(r);
+        r.started=true;
+        cout<<"Room "<<r.id<<": "<<players<<" players connected. Starting match.\n";
+        if(!g_record_dir.empty()) start_recording(r);
+    }
+    else if(r.started && players==0){
+        r.started=false;
+        r.recorder.close();
+        cout<<"Room "<<r.id<<": everyone left, back to waiting.\n";
     }
+}
 
-    cout<<"Both player connected. Starting game loop. \n";
+void report_room_stats(){
+    long ticks=0;
+    long late=0;
+    long dropped=0;
+    double total=0.0;
+    int running=0;
+    const Room* worst=nullptr;
+    for(auto& room : g_rooms){
+        const RoomStats& st=room->stats;
+        dropped+=room->dropped_inputs.exchange(0);
+        if(st.ticks==0) continue;
+        running++;
+        ticks+=st.ticks;
+        late+=st.late;
+        total+=st.total;
+        if(!worst || st.worst>worst->stats.worst) worst=room.get();
+    }
+    if(running==0) return;
+
+    cout<<"[stats] "<<running<<" rooms, "<<ticks<<" ticks, avg "
+        <<static_cast<int>(total/ticks*1e6)<<" us, worst "
+        <<static_cast<int>(worst->stats.worst*1e6)<<" us (room "<<worst->id<<"), "
+        <<late<<" late, "<<dropped<<" inputs dropped"<<nl;
+    const LatencyHistogram& jitter=g_tick_sched.start_jitter;
+    cout<<"[stats]   tick start jitter p50 "<<jitter.percentile(0.50)/1000<<" us, p99 "
+        <<jitter.percentile(0.99)/1000<<" us, max "<<jitter.max_ns.load(std::memory_order_relaxed)/1000
+        <<" us, "<<g_tick_sched.skipped.load(std::memory_order_relaxed)<<" ticks skipped"<<nl;
+    for(auto& room : g_rooms){
+        const RoomStats& st=room->stats;
+        if(st.late>0){
+            cout<<"[stats]   room "<<room->id<<": "<<st.late<<"/"<<st.ticks
+                <<" ticks late, avg "<<static_cast<int>(st.total/st.ticks*1e6)
+                <<" us, max "<<static_cast<int>(st.worst*1e6)<<" us"<<nl;
+        }
+    }
+    for(auto& room : g_rooms) room->stats.reset();
 }
 
-// =============== GAME LOOP ====================
+// counter totals at the last rate update
+struct MetricTotals{
+    double time=0.0;
+    uint64_t inputs=0;
+    uint64_t bytes_sent=0;
+    uint64_t bytes_received=0;
+    uint64_t snapshots=0;
+};
+
+// turn the counters' growth since last into per-second rates
+void update_metric_rates(MetricTotals& last, double now){
+    MetricTotals cur;
+    cur.time=now;
+    cur.inputs=g_metrics.inputs.load(std::memory_order_relaxed);
+    cur.bytes_sent=g_metrics.bytes_sent.load(std::memory_order_relaxed);
+    cur.bytes_received=g_metrics.bytes_received.load(std::memory_order_relaxed);
+    cur.snapshots=g_metrics.snapshots_sent.load(std::memory_order_relaxed);
+
+    double dt=cur.time-last.time;
+    if(dt>0.0){
+        g_metrics.inputs_per_sec=static_cast<double>(cur.inputs-last.inputs)/dt;
+        g_metrics.bytes_sent_per_sec=static_cast<double>(cur.bytes_sent-last.bytes_sent)/dt;
+        g_metrics.bytes_received_per_sec=static_cast<double>(cur.bytes_received-last.bytes_received)/dt;
+        g_metrics.snapshots_per_sec=static_cast<double>(cur.snapshots-last.snapshots)/dt;
+    }
+    last=cur;
+}
 
+// runs every started room's tick on the worker pool once per TICK_DT, as
+// paced by g_tick_sched. a room's tick is late if it finishes after the
+// next tick is due.
 void game_loop(){
-    init_players();
-    spawn_coin();
+    WorkPool pool(g_num_workers);
+    std::unique_ptr<WorkPool> sim_pool;
+    if(g_sim_threads>1){
+        sim_pool.reset(new WorkPool(g_sim_threads));
+        g_sim_pool=sim_pool.get();
+    }
+    cout<<"Lobby open: "<<g_max_rooms<<" rooms of "<<g_max_players<<" players, "
+        <<pool.num_workers<<" tick workers, coin kernel "<<coin_kernel_name(g_coin_kernel)<<nl;
+    if(g_sim_pool) cout<<"World step runs on up to "<<g_sim_threads<<" threads"<<nl;
+    cout<<"Simulating at "<<proto::TICK_RATE<<" Hz, snapshots every "<<g_send_interval_min<<"-"
+        <<g_send_interval_max<<" ticks per client (starting at "<<g_send_interval<<")"<<nl;
+    cout<<"World "<<g_world_width<<"x"<<g_world_height<<", ";
+    if(g_interest>0.0f) cout<<"interest radius "<<g_interest<<nl;
+    else cout<<"every client sees everything"<<nl;
+
+    std::vector<PoolTask> tasks;
+    tasks.reserve(g_rooms.size());
+
+    if(g_pin_cpu>=0){
+        if(pin_current_thread(g_pin_cpu)) cout<<"Game loop pinned to CPU "<<g_pin_cpu<<nl;
+        else cerr<<"could not pin the game loop to CPU "<<g_pin_cpu<<", running unpinned"<<nl;
+    }
+    if(!g_tick_sched.init(static_cast<uint64_t>(TICK_DT*1e9),g_tick_wait,
+                          static_cast<uint64_t>(g_spin_us)*1000,g_catch_up)){
+        cerr<<"timerfd_create() failed: "<<std::strerror(errno)<<", using clock_nanosleep"<<nl;
+        g_tick_sched.init(static_cast<uint64_t>(TICK_DT*1e9),TickWait::Sleep,
+                          static_cast<uint64_t>(g_spin_us)*1000,g_catch_up);
+    }
 
-    const double dt=1.0/static_cast<double>(proto::TICK_RATE);
-    double next_tick_time=now_seconds();
-    int tick=0;
+    double next_report=now_seconds()+STATS_INTERVAL;
+    MetricTotals last_totals;
+    update_metric_rates(last_totals,now_seconds());
 
     while(g_running){
+        double next_tick_time=static_cast<double>(g_tick_sched.wait())*1e-9;
         double now=now_seconds();
-        if(now<next_tick_time){
-            sleep_for_seconds(next_tick_time-now);
-            continue;
+
+        tasks.clear();
+        for(auto& room : g_rooms){
+            update_room_state(*room);
+            if(!room->started) continue;
+            room->deadline=next_tick_time+TICK_DT;
+            tasks.push_back(PoolTask{tick_room,room.get()});
         }
-        double frame_start=now_seconds();
+        pool.run_batch(tasks.data(),static_cast<int>(tasks.size()));
 
-        {
-            std::lock_guard<std::mutex> lock(g_input_mutex);
-            while(!g_input_queue.empty()){
-                InputEvent& ev=g_input_queue.front();
-                if(ev.ready_time<=frame_start){
-                    apply_input_event(ev);
-                    g_input_queue.pop();
-                }
-                else break;
-            }
+        if(now>=next_report){
+            update_metric_rates(last_totals,now);
+            report_room_stats();
+            next_report=now+STATS_INTERVAL;
         }
+    }
+    g_sim_pool=nullptr;
+}
 
-        update_world(dt);
-        broadcast_state(tick);
+// =============== STATS ENDPOINT ====================
+
+// --stats-port: a plain-text snapshot of g_metrics for anyone who connects
+// to 127.0.0.1:port, e.g. `nc 127.0.0.1 40001`. sending "reset" first clears
+// the phase histograms after the snapshot is taken.
+int g_stats_port=0;
+
+void write_phase(std::ostringstream& out, const char* name, const LatencyHistogram& h){
+    out<<name<<" count "<<h.total.load(std::memory_order_relaxed)
+       <<" mean "<<h.mean()/1000.0
+       <<" p50 "<<h.percentile(0.50)/1000.0
+       <<" p90 "<<h.percentile(0.90)/1000.0
+       <<" p99 "<<h.percentile(0.99)/1000.0
+       <<" p999 "<<h.percentile(0.999)/1000.0
+       <<" max "<<h.max_ns.load(std::memory_order_relaxed)/1000.0<<nl;
+}
+
+// resident set size of the server process, 0 if /proc is not there
+long resident_bytes(){
+    std::ifstream statm("/proc/self/statm");
+    long pages=0,resident=0;
+    if(!(statm>>pages>>resident)) return 0;
+    return resident*sysconf(_SC_PAGESIZE);
+}
 
-        tick++;
-        next_tick_time+=dt;
+std::string format_stats(){
+    int clients=0;
+    for(auto& room : g_rooms) clients+=connected_players(*room);
+
+    std::ostringstream out;
+    out<<std::fixed;
+    out.precision(1);
+    out<<"uptime_s "<<now_seconds()-g_start_time<<nl;
+    out<<"clients_connected "<<clients<<nl;
+    out<<"tcp_connections "<<g_metrics.tcp_connections.load(std::memory_order_relaxed)<<nl;
+    out<<"rss_bytes "<<resident_bytes()<<nl;
+    out<<"ticks "<<g_metrics.tick_total.total.load(std::memory_order_relaxed)<<nl;
+    out<<"late_ticks "<<g_metrics.late_ticks.load(std::memory_order_relaxed)<<nl;
+    out<<"inputs "<<g_metrics.inputs.load(std::memory_order_relaxed)<<nl;
+    out<<"inputs_dropped "<<g_metrics.inputs_dropped.load(std::memory_order_relaxed)<<nl;
+    out<<"inputs_per_sec "<<g_metrics.inputs_per_sec.load()<<nl;
+    out<<"bytes_sent "<<g_metrics.bytes_sent.load(std::memory_order_relaxed)<<nl;
+    out<<"bytes_sent_per_sec "<<g_metrics.bytes_sent_per_sec.load()<<nl;
+    out<<"bytes_received "<<g_metrics.bytes_received.load(std::memory_order_relaxed)<<nl;
+    out<<"bytes_received_per_sec "<<g_metrics.bytes_received_per_sec.load()<<nl;
+    out<<"send_failures "<<g_metrics.send_failures.load(std::memory_order_relaxed)<<nl;
+    out<<"snapshots_sent "<<g_metrics.snapshots_sent.load(std::memory_order_relaxed)<<nl;
+    out<<"snapshots_sent_per_sec "<<g_metrics.snapshots_per_sec.load()<<nl;
+    out<<"snapshots_replaced "<<g_metrics.snapshots_replaced.load(std::memory_order_relaxed)<<nl;
+    out<<"# tick phases in microseconds"<<nl;
+    write_phase(out,"phase_input",g_metrics.tick_input);
+    write_phase(out,"phase_update",g_metrics.tick_update);
+    write_phase(out,"phase_broadcast",g_metrics.tick_broadcast);
+    write_phase(out,"phase_tick",g_metrics.tick_total);
+    out<<"ticks_skipped "<<g_tick_sched.skipped.load(std::memory_order_relaxed)<<nl;
+    write_phase(out,"tick_start_jitter",g_tick_sched.start_jitter);
+    return out.str();
+}
+
+int open_stats_socket(int port){
+    int fd=::socket(AF_INET,SOCK_STREAM,0);
+    if(fd<0){
+        cerr<<"stats socket() failed: "<<std::strerror(errno)<<endl;
+        return -1;
+    }
+    int opt=1;
+    setsockopt(fd,SOL_SOCKET,SO_REUSEADDR,&opt,sizeof(opt));
+
+    sockaddr_in addr;
+    std::memset(&addr,0,sizeof(addr));
+    addr.sin_family=AF_INET;
+    addr.sin_addr.s_addr=htonl(INADDR_LOOPBACK); // local only
+    addr.sin_port=htons(static_cast<uint16_t>(port));
+    if(bind(fd,(sockaddr*)&addr,sizeof(addr))<0 || listen(fd,8)<0){
+        cerr<<"stats port "<<port<<": "<<std::strerror(errno)<<endl;
+        ::close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// one request at a time on its own thread; only reads atomics
+void stats_server_loop(int listen_fd){
+    while(g_running){
+        pollfd lp{listen_fd,POLLIN,0};
+        if(::poll(&lp,1,200)<=0) continue;
+        int fd=::accept(listen_fd,nullptr,nullptr);
+        if(fd<0) continue;
+
+        // an optional command line; plain connects just get the snapshot
+        char cmd[64]={};
+        pollfd cp{fd,POLLIN,0};
+        if(::poll(&cp,1,100)>0){
+            ssize_t n=::recv(fd,cmd,sizeof(cmd)-1,0);
+            if(n<0) cmd[0]=0;
+        }
+
+        std::string text=format_stats();
+        size_t sent=0;
+        while(sent<text.size()){
+            ssize_t n=::send(fd,text.data()+sent,text.size()-sent,MSG_NOSIGNAL);
+            if(n<=0) break;
+            sent+=static_cast<size_t>(n);
+        }
+        ::close(fd);
+
+        if(std::strncmp(cmd,"reset",5)==0){
+            g_metrics.tick_input.reset();
+            g_metrics.tick_update.reset();
+            g_metrics.tick_broadcast.reset();
+            g_metrics.tick_total.reset();
+            g_tick_sched.start_jitter.reset();
+        }
     }
 }
 
 // server setup
 
-int main(){
-    cout<<"Starting server on port "<<proto::SERVER_PORT<<"...\n";
+int run_udp_server(){
+    cout<<"Starting UDP server on port "<<g_port<<"...\n";
+    g_udp_sock=::socket(AF_INET,SOCK_DGRAM,0);
+    if(g_udp_sock<0){
+        cerr<<"socket() failed: "<<std::strerror(errno)<<endl;
+        return 1;
+    }
+
+    sockaddr_in addr;
+    std::memset(&addr,0,sizeof(addr));
+    addr.sin_family=AF_INET;
+    addr.sin_addr.s_addr=htonl(INADDR_ANY);
+    addr.sin_port=htons(static_cast<uint16_t>(g_port));
+
+    if(bind(g_udp_sock,(sockaddr*)&addr,sizeof(addr))<0){
+        cerr<<"bind() failed: "<<std::strerror(errno)<<endl;
+        ::close(g_udp_sock);
+        return 1;
+    }
+
+    // wake up regularly so timeouts are checked even when nobody sends
+    timeval tv{0,static_cast<suseconds_t>(UDP_TIMEOUT_SCAN*1e6)};
+    setsockopt(g_udp_sock,SOL_SOCKET,SO_RCVTIMEO,&tv,sizeof(tv));
+
+    std::thread recv_thread(udp_receive_loop);
+
+    game_loop();
+
+    cout<<"Shutting down server.\n";
+    g_running=false;
+    recv_thread.join();
+    ::close(g_udp_sock);
+    return 0;
+}
+
+int main(int argc, char** argv){
+    for(int i=1;i<argc;i++){
+        std::string arg=argv[i];
+        if(arg=="--text-state"){
+            g_state_format=proto::StateFormat::Text;
+        }
+        else if(arg=="--udp"){
+            g_use_udp=true;
+        }
+        else if(arg=="--players" && i+1<argc){
+            g_max_players=std::atoi(argv[++i]);
+            if(g_max_players<1 || g_max_players>proto::MAX_PLAYERS){
+                cerr<<"--players must be between 1 and "<<proto::MAX_PLAYERS<<nl;
+                return 1;
+            }
+        }
+        else if(arg=="--coins" && i+1<argc){
+            g_num_coins=std::atoi(argv[++i]);
+            if(g_num_coins<1 || g_num_coins>proto::MAX_COINS){
+                cerr<<"--coins must be between 1 and "<<proto::MAX_COINS<<nl;
+                return 1;
+            }
+        }
+        else if(arg=="--rooms" && i+1<argc){
+            g_max_rooms=std::atoi(argv[++i]);
+            if(g_max_rooms<1 || g_max_rooms>MAX_ROOMS){
+                cerr<<"--rooms must be between 1 and "<<MAX_ROOMS<<nl;
+                return 1;
+            }
+        }
+        else if(arg=="--port" && i+1<argc){
+            g_port=std::atoi(argv[++i]);
+            if(g_port<1 || g_port>65535){
+                cerr<<"--port must be between 1 and 65535\n";
+                return 1;
+            }
+        }
+        else if(arg=="--input-delay" && i+1<argc){
+            g_input_delay=std::atof(argv[++i]);
+            if(g_input_delay<0.0 || g_input_delay>1.0){
+                cerr<<"--input-delay must be between 0 and 1 second\n";
+                return 1;
+            }
+        }
+        else if(arg=="--record" && i+1<argc){
+            g_record_dir=argv[++i];
+        }
+        else if(arg=="--stats-port" && i+1<argc){
+            g_stats_port=std::atoi(argv[++i]);
+            if(g_stats_port<1 || g_stats_port>65535){
+                cerr<<"--stats-port must be between 1 and 65535\n";
+                return 1;
+            }
+        }
+        else if(arg=="--workers" && i+1<argc){
+            g_num_workers=std::atoi(argv[++i]);
+            if(g_num_workers<1){
+                cerr<<"--workers must be at least 1\n";
+                return 1;
+            }
+        }
+        else if(arg=="--sim-threads" && i+1<argc){
+            g_sim_threads=std::atoi(argv[++i]);
+            if(g_sim_threads<1){
+                cerr<<"--sim-threads must be at least 1\n";
+                return 1;
+            }
+        }
+        else if(arg=="--world" && i+1<argc){
+            int w=0,h=0;
+            const int min_side=static_cast<int>(proto::PLAYER_RADIUS*4.0f);
+            if(std::sscanf(argv[++i],"%dx%d",&w,&h)!=2 || w<min_side || h<min_side ||
+               w>proto::MAX_WORLD_SIZE || h>proto::MAX_WORLD_SIZE){
+                cerr<<"--world takes WIDTHxHEIGHT, each between "<<min_side<<" and "
+                    <<proto::MAX_WORLD_SIZE<<nl;
+                return 1;
+            }
+            g_world_width=static_cast<float>(w);
+            g_world_height=static_cast<float>(h);
+        }
+        else if(arg=="--interest" && i+1<argc){
+            int radius=std::atoi(argv[++i]);
+            if(radius<0 || radius>proto::MAX_WORLD_SIZE){
+                cerr<<"--interest must be between 0 and "<<proto::MAX_WORLD_SIZE<<nl;
+                return 1;
+            }
+            g_interest=static_cast<float>(radius);
+        }
+        else if(arg=="--send-rate" && i+1<argc){
+            int rate=std::atoi(argv[++i]);
+            if(rate<1 || rate>proto::TICK_RATE){
+                cerr<<"--send-rate must be between 1 and "<<proto::TICK_RATE<<nl;
+                return 1;
+            }
+            g_send_interval=send_interval_for_rate(rate);
+            g_send_interval_min=g_send_interval;
+        }
+        else if(arg=="--min-send-rate" && i+1<argc){
+            int rate=std::atoi(argv[++i]);
+            if(rate<1 || rate>proto::TICK_RATE){
+                cerr<<"--min-send-rate must be between 1 and "<<proto::TICK_RATE<<nl;
+                return 1;
+            }
+            g_send_interval_max=send_interval_for_rate(rate);
+        }
+        else if(arg=="--tick-wait" && i+1<argc){
+            std::string mode=argv[++i];
+            if(mode=="sleep") g_tick_wait=TickWait::Sleep;
+            else if(mode=="timerfd") g_tick_wait=TickWait::Timerfd;
+            else{
+                cerr<<"--tick-wait must be sleep or timerfd\n";
+                return 1;
+            }
+        }
+        else if(arg=="--spin-us" && i+1<argc){
+            g_spin_us=std::atoi(argv[++i]);
+            if(g_spin_us<0 || g_spin_us>static_cast<int>(TICK_DT*1e6)){
+                cerr<<"--spin-us must be between 0 and one tick\n";
+                return 1;
+            }
+        }
+        else if(arg=="--catch-up" && i+1<argc){
+            std::string policy=argv[++i];
+            if(policy=="burst") g_catch_up=CatchUp::Burst;
+            else if(policy=="skip") g_catch_up=CatchUp::Skip;
+            else{
+                cerr<<"--catch-up must be burst or skip\n";
+                return 1;
+            }
+        }
+        else if(arg=="--pin-cpu" && i+1<argc){
+            g_pin_cpu=std::atoi(argv[++i]);
+            if(g_pin_cpu<0){
+                cerr<<"--pin-cpu must be a CPU number\n";
+                return 1;
+            }
+        }
+        else{
+            cerr<<"Unknown option: "<<arg<<nl;
+            cerr<<"Usage: server [--port PORT] [--text-state] [--udp] [--players N] [--coins N]"
+                  " [--rooms N] [--workers N] [--sim-threads N] [--world WxH] [--interest R]"
+                  " [--send-rate HZ] [--min-send-rate HZ]"
+                  " [--stats-port PORT] [--record DIR]"
+                  " [--tick-wait sleep|timerfd] [--spin-us N] [--catch-up burst|skip]"
+                  " [--pin-cpu N] [--input-delay SECONDS]\n";
+            return 1;
+        }
+    }
+    if(g_use_udp && g_state_format==proto::StateFormat::Text){
+        cerr<<"--text-state is only supported over TCP\n";
+        return 1;
+    }
+    if(g_interest>0.0f && g_state_format==proto::StateFormat::Text){
+        cerr<<"--interest needs binary STATE, not --text-state\n";
+        return 1;
+    }
+    if(g_send_interval_max<g_send_interval_min){
+        cerr<<"--min-send-rate cannot be above --send-rate\n";
+        return 1;
+    }
+    g_send_interval=std::clamp(g_send_interval,g_send_interval_min,g_send_interval_max);
+
+    g_coin_kernel=select_coin_kernel();
+    for(int i=0;i<g_max_rooms;i++){
+        g_rooms.emplace_back(new Room(i+1));
+    }
+
+    g_start_time=now_seconds();
+    if(g_stats_port>0){
+        int stats_sock=open_stats_socket(g_stats_port);
+        if(stats_sock<0) return 1;
+        cout<<"Stats on 127.0.0.1:"<<g_stats_port<<nl;
+        // serves until exit; it never holds anything the tick needs
+        std::thread(stats_server_loop,stats_sock).detach();
+    }
+
+    if(g_use_udp){
+        return run_udp_server();
+    }
+
+    cout<<"Starting server on port "<<g_port<<"...\n";
     int server_sock=::socket(AF_INET,SOCK_STREAM,0);
     if(server_sock<0){
         cerr<<"socket() failed: "<<std::strerror(errno)<<endl;
@@ -363,7 +1024,7 @@ int main(){
     std::memset(&addr,0,sizeof(addr));
     addr.sin_family=AF_INET;
     addr.sin_addr.s_addr=htonl(INADDR_ANY);
-    addr.sin_port=htons(proto::SERVER_PORT);
+    addr.sin_port=htons(static_cast<uint16_t>(g_port));
 
     if(bind(server_sock, (sockaddr*)&addr, sizeof(addr))<0){
         cerr<<"bind() failed: "<<std::strerror(errno)<<endl;
@@ -371,7 +1032,13 @@ int main(){
         return 1;
     }
 
-    if(listen(server_sock,2)<0){
+    if(!set_nonblocking(server_sock)){
+        cerr<<"fcntl(O_NONBLOCK) failed: "<<std::strerror(errno)<<endl;
+        ::close(server_sock);
+        return 1;
+    }
+
+    if(listen(server_sock,SOMAXCONN)<0){
         cerr<<"listen() failed: "<<std::strerror(errno)<<endl;
         ::close(server_sock);
         return 1;
@@ -379,16 +1046,13 @@ int main(){
 
     cout<<"Server listening.\n";
 
-    accept_clients(server_sock);
+    std::thread reactor(tcp_reactor_loop,server_sock);
 
     game_loop();
 
     cout<<"Shutting down server.\n";
-    for(int i=0;i<2;i++){
-        if(g_client_connected[i]){
-            ::close(g_client_socks[i]);
-        }
-    }
+    g_running=false;
+    reactor.join();
     ::close(server_sock);
     return 0;
 }
@@ -0,0 +1,365 @@
+#pragma once
+
+#include <iostream>
+#include <vector>
+#include <algorithm>
+#include <random>
+#include <cmath>
+#include <cstdint>
+
+#include "../common/utils.hpp"
+#include "../common/protocol.hpp"
+#include "../common/simulation.hpp"
+#include "../common/spatial_hash.hpp"
+#include "../common/coin_field.hpp"
+#include "../common/work_pool.hpp"
+
+// one room's game world: players, coins and the fixed-step update. kept
+// free of sockets and threads so the benchmarks can drive it directly.
+
+struct Player{
+    int id=0;
+    float x=0.0f;
+    float y=0.0f;
+    float vx=0.0f;
+    float vy=0.0f;
+    int score=0;
+    int input_seq=-1; // last applied INPUT, echoed back for reconciliation
+    int input_tick=0;
+    bool active=false; // slot has a connected player in the world
+};
+
+// a coin that spawned or was collected on tick
+struct CoinChange{
+    int tick=0;
+    int id=0;
+};
+
+// cells per side the player grid is kept under, see World::player_grid
+constexpr int MAX_GRID_SIDE=128;
+
+struct World{
+    // set before reset_world
+    int id=0; // room id, for log lines
+    int max_players=proto::DEFAULT_PLAYERS; // at most proto::MAX_PLAYERS
+    int num_coins=1;                        // at most proto::MAX_COINS
+    CoinPickupKernel coin_kernel=coin_pickup_scalar;
+    bool log_spawns=false;
+    bool log_pickups=false;
+    uint32_t seed=0; // coin spawns are drawn from rng seeded with this
+    float width=proto::WORLD_WIDTH;
+    float height=proto::WORLD_HEIGHT;
+
+    Player players[proto::MAX_PLAYERS];
+    CoinField coins;
+    std::mt19937 rng; // reseeded by reset_world
+    int tick=0;
+
+    // broadphase for player collision, rebuilt every tick. cells are one
+    // player diameter, the largest interaction distance, or larger in big
+    // worlds to keep the grid (which is walked every tick) to at most
+    // MAX_GRID_SIDE cells a side. sized by reset_world.
+    SpatialHash player_grid;
+
+    // tick each coin last spawned or was collected on, plus a log of those
+    // changes in tick order covering the last SNAPSHOT_HISTORY ticks. deltas
+    // only carry the coins logged after the client's baseline.
+    std::vector<int> coin_changed_tick;
+    std::vector<CoinChange> coin_log;
+
+    // coins each player's pickup scan found this tick, filled in parallel
+    // by update_world and applied in slot order
+    std::vector<int> pickup_hits[proto::MAX_PLAYERS];
+};
+
+inline void log_coin_change(World& w, int tick, int id){
+    if(w.coin_changed_tick[id]==tick) return; // already logged this tick
+    w.coin_changed_tick[id]=tick;
+    w.coin_log.push_back(CoinChange{tick,id});
+}
+
+inline void spawn_coin(World& w, int tick, int id){
+    std::uniform_real_distribution<float> dist_x(proto::COIN_RADIUS,w.width-proto::COIN_RADIUS);
+    std::uniform_real_distribution<float> dist_y(proto::COIN_RADIUS,w.height-proto::COIN_RADIUS);
+
+    float x=dist_x(w.rng);
+    float y=dist_y(w.rng);
+    w.coins.set(id,x,y);
+    log_coin_change(w,tick,id);
+    if(w.log_spawns){
+        std::cout<<"Spawned coint at ("<<x<<", "<<y<<")\n";
+    }
+}
+
+// fresh world for a match that is about to start
+inline void reset_world(World& w){
+    for(auto& p : w.players) p.active=false;
+    w.coins.resize(w.num_coins);
+    w.coin_changed_tick.assign(static_cast<size_t>(w.num_coins),-1);
+    w.coin_log.clear();
+    // at most one entry per coin per tick (log_coin_change skips repeats)
+    // over the SNAPSHOT_HISTORY ticks it keeps; sized for that up front so
+    // a busy stretch of the match never grows it
+    w.coin_log.reserve(static_cast<size_t>(w.num_coins)*proto::SNAPSHOT_HISTORY);
+    w.rng.seed(w.seed);
+    w.tick=0;
+    // a player rarely covers more coins than one kernel call returns; room
+    // for that up front keeps the first big pickups from allocating mid-match
+    for(auto& hits : w.pickup_hits) hits.reserve(64);
+    float cell=std::max(proto::PLAYER_RADIUS*2.0f,std::max(w.width,w.height)/MAX_GRID_SIDE);
+    w.player_grid.reset(cell,w.width,w.height);
+}
+
+// put a newly connected player into the world. slots are spread around a
+// circle so that with two players they start left and right of centre.
+inline void spawn_player(World& w, int slot){
+    const float pi=3.14159265f;
+    float angle=pi+2.0f*pi*static_cast<float>(slot)/static_cast<float>(w.max_players);
+
+    Player& p=w.players[slot];
+    p.id=slot+1;
+    p.x=w.width*0.5f+std::cos(angle)*w.width*0.25f;
+    p.y=w.height*0.5f+std::sin(angle)*w.height*0.25f;
+    p.vx=0.0f;
+    p.vy=0.0f;
+    p.score=0;
+    p.input_seq=-1;
+    p.input_tick=0;
+    p.active=true;
+}
+
+// INPUT seq from the player in slot, applied on the current tick
+inline void apply_input(World& w, int slot, int seq, int dx, int dy){
+    Player& p=w.players[slot];
+    if(!p.active) return; // sent by a client that has since left
+    sim::velocity_from_input(dx,dy,p.vx,p.vy);
+    p.input_seq=seq;
+    p.input_tick=w.tick;
+}
+
+// ---- the world step ----
+//
+// update_world runs as phases. the two that scale with the entity count,
+// player collision and the coin pickup scan, go together as one phase
+// split into bands of grid cells, which run in parallel when a WorkPool is
+// passed. every band only writes the players in its own cells and only
+// reads the grid and the coins, and whatever a band finds that touches
+// shared state (coins picked up) is applied afterwards on the calling
+// thread in slot order. the result is bit-identical to the serial step for
+// any number of bands or threads.
+//
+// collision is resolved from the positions the grid was built with: each
+// player sums the pushes from every overlapping neighbour, including ones
+// in other bands' cells, in cell order. a pair's two pushes come from the
+// same float operations with the sign flipped, so both sides of a pair on
+// a band border agree without talking to each other.
+
+// bands a parallel phase is cut into, at most
+constexpr int MAX_WORLD_BANDS=64;
+
+// one band of a parallel phase: grid cells [begin,end)
+struct WorldBand{
+    World* w=nullptr;
+    int begin=0;
+    int end=0;
+};
+
+// coins within pickup range of p, ascending, appended to out
+inline void scan_pickups(const World& w, const Player& p, std::vector<int>& out){
+    const float pickup_dist=proto::PLAYER_RADIUS+proto::COIN_RADIUS;
+    const float pickup_dist_sq=pickup_dist*pickup_dist;
+    const int padded=static_cast<int>(w.coins.x.size());
+    const float* xs=w.coins.x.data();
+    const float* ys=w.coins.y.data();
+    const uint64_t* active=w.coins.active.data();
+
+    int hits[64];
+    int found=w.coin_kernel(xs,ys,active,padded,p.x,p.y,pickup_dist_sq,hits,64);
+    if(found<64){
+        out.insert(out.end(),hits,hits+found);
+        return;
+    }
+    // the coins are not cleared until every band is done, so an overflow
+    // cannot be resumed by scanning again. a window of 64 coins cannot
+    // overflow the buffer, so go over them a window at a time.
+    for(int base=0;base<padded;base+=64){
+        int n=std::min(64,padded-base);
+        found=w.coin_kernel(xs+base,ys+base,active+base/64,n,p.x,p.y,pickup_dist_sq,hits,64);
+        for(int k=0;k<found;k++) out.push_back(base+hits[k]);
+    }
+}
+
+// collision and pickup scan for the players in one band of cells
+inline void step_band(void* arg){
+    const WorldBand& band=*static_cast<WorldBand*>(arg);
+    World& w=*band.w;
+    const SpatialHash& g=w.player_grid;
+    const float minDist=proto::PLAYER_RADIUS*2.0f;
+    const float min_sq=minDist*minDist;
+
+    for(int c=band.begin;c<band.end;c++){
+        int cx=c%g.cols;
+        int cy=c/g.cols;
+        for(int e=g.cell_start[c];e<g.cell_start[c+1];e++){
+            float ex=g.sorted_x[e];
+            float ey=g.sorted_y[e];
+            float x=ex;
+            float y=ey;
+
+            // only players in neighbouring cells can touch
+            for(int ny=std::max(cy-1,0);ny<=std::min(cy+1,g.rows-1);ny++){
+                for(int nx=std::max(cx-1,0);nx<=std::min(cx+1,g.cols-1);nx++){
+                    int n=ny*g.cols+nx;
+                    for(int f=g.cell_start[n];f<g.cell_start[n+1];f++){
+                        float dx=ex-g.sorted_x[f];
+                        float dy=ey-g.sorted_y[f];
+                        float d2=dx*dx+dy*dy;
+                        if(f==e || d2>=min_sq) continue;
+                        float dist=std::sqrt(d2);
+                        if(dist>0.0f){
+                            float push=(minDist-dist)*0.5f;
+                            x+=dx/dist*push;
+                            y+=dy/dist*push;
+                        }
+                    }
+                }
+            }
+
+            int slot=g.sorted_ids[e];
+            Player& p=w.players[slot];
+            p.x=x;
+            p.y=y;
+
+            std::vector<int>& hits=w.pickup_hits[slot];
+            hits.clear();
+            scan_pickups(w,p,hits);
+        }
+    }
+}
+
+// run step_band over the grid, cut into bands holding about the same
+// number of players. without a pool it all runs on the calling thread as
+// one band.
+inline void step_bands(World& w, WorkPool* pool){
+    const SpatialHash& g=w.player_grid;
+    const int cells=g.cols*g.rows;
+    const int total=g.cell_start[cells];
+
+    int n=1;
+    if(pool) n=std::clamp(pool->num_workers*2,1,std::min(MAX_WORLD_BANDS,std::max(total,1)));
+
+    WorldBand bands[MAX_WORLD_BANDS];
+    PoolTask tasks[MAX_WORLD_BANDS];
+    int begin=0;
+    for(int k=0;k<n;k++){
+        int end=cells;
+        if(k+1<n){
+            // first cell holding player number total*(k+1)/n
+            auto at=std::lower_bound(g.cell_start.begin()+begin,g.cell_start.begin()+cells,
+                                     static_cast<int>(static_cast<long>(total)*(k+1)/n));
+            end=static_cast<int>(at-g.cell_start.begin());
+        }
+        bands[k]=WorldBand{&w,begin,end};
+        tasks[k]=PoolTask{step_band,&bands[k]};
+        begin=end;
+    }
+
+    if(n==1) step_band(&bands[0]);
+    else pool->run_batch(tasks,n);
+}
+
+// one fixed sim::TICK_DT step of the world. pool, if given, runs the
+// collision and pickup phase in parallel; the caller must be the only one
+// using it for the duration.
+inline void update_world(World& w, int tick, WorkPool* pool=nullptr){
+    // coin spawning: refill every slot collected last tick. draws from rng
+    // in slot order, so stays serial. nothing in this tick's player phases
+    // depends on it but the pickup scan, which comes after.
+    for(int i=0;i<w.num_coins;i++){
+        if(!w.coins.is_active(i)) spawn_coin(w,tick,i);
+    }
+
+    // movement is a handful of flops per player, cheaper than waking the pool
+    for(int i=0;i<w.max_players;i++){
+        Player& p=w.players[i];
+        if(!p.active) continue;
+        sim::step_player(p.x,p.y,p.vx,p.vy,w.width,w.height);
+    }
+
+    w.player_grid.clear();
+    for(int i=0;i<w.max_players;i++){
+        if(w.players[i].active) w.player_grid.insert(i,w.players[i].x,w.players[i].y);
+    }
+    w.player_grid.build();
+
+    step_bands(w,pool);
+
+    // apply the pickups. players go in slot order and a coin is cleared as
+    // soon as it is taken, so ties go to the lowest slot.
+    for(int i=0;i<w.max_players;i++){
+        Player& p=w.players[i];
+        if(!p.active) continue;
+        int picked=0;
+        for(int id : w.pickup_hits[i]){
+            if(!w.coins.is_active(id)) continue;
+            w.coins.clear(id);
+            log_coin_change(w,tick,id);
+            p.score+=1;
+            picked++;
+        }
+        if(picked>0 && w.log_pickups){
+            std::cout<<"Room "<<w.id<<": player "<<p.id<<" picked up coin! Score is : "<<p.score<<"\n";
+        }
+    }
+
+    // drop changes no client can still have as a delta baseline
+    size_t keep=0;
+    while(keep<w.coin_log.size() && w.coin_log[keep].tick<=tick-proto::SNAPSHOT_HISTORY) keep++;
+    if(keep>0) w.coin_log.erase(w.coin_log.begin(),w.coin_log.begin()+keep);
+}
+
+inline proto::worldSnapshot build_snapshot(const World& w, int tick){
+    proto::worldSnapshot s;
+    s.tick=tick;
+    s.server_time=now_seconds();
+
+    // slot order is id order, which keeps the list sorted
+    s.num_players=0;
+    for(int i=0;i<w.max_players;i++){
+        const Player& p=w.players[i];
+        if(!p.active) continue;
+        proto::playerState& ps=s.players[s.num_players++];
+        ps.id=p.id;
+        ps.x=p.x;
+        ps.y=p.y;
+        ps.score=p.score;
+        ps.input_seq=p.input_seq;
+        ps.input_tick=p.input_tick;
+    }
+
+    return s;
+}
+
+// every active coin, for keyframes and text STATE
+inline void collect_all_coins(const World& w, proto::coinUpdate& out){
+    out.full=true;
+    out.coins.clear();
+    for(int i=0;i<w.num_coins;i++){
+        if(!w.coins.is_active(i)) continue;
+        out.coins.push_back(proto::coinState{i,w.coins.x[i],w.coins.y[i],true});
+    }
+}
+
+// coins that spawned or were collected after base_tick, each once
+inline void collect_coin_changes(const World& w, int base_tick, proto::coinUpdate& out){
+    out.full=false;
+    out.coins.clear();
+    auto it=std::upper_bound(w.coin_log.begin(),w.coin_log.end(),base_tick,
+                             [](int t, const CoinChange& c){ return t<c.tick; });
+    for(;it!=w.coin_log.end();++it){
+        int id=it->id;
+        if(w.coin_changed_tick[id]!=it->tick) continue; // superseded later
+        bool active=w.coins.is_active(id);
+        out.coins.push_back(proto::coinState{id,w.coins.x[id],w.coins.y[id],active});
+    }
+}